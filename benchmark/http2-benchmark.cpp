@@ -0,0 +1,409 @@
+/**
+ * @file
+ * @brief  Benchmark of HTTP/1.1 and HTTP/2 (multiplexed) gateway requests
+ * @author gruzovator
+ * @date   2015-07-15
+ *
+ * Benchmark starts local stand-in WebHDFS gateway, which speaks both HTTP/1.1 and HTTP/2 with
+ * prior knowledge (h2c), and makes many concurrent GETFILESTATUS requests by client in both
+ * modes: requests per second and connections opened by the client.
+ *
+ * Usage: ./webhdfs-http2-benchmark [<requests>] [<parallelism>] [<repeats>]
+ */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <nghttp2/nghttp2.h>
+
+#include "WebHdfsClient.h"
+
+
+namespace
+{
+
+const char HTTP2_PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const std::string WEBHDFS_PREFIX = "/webhdfs/v1";
+
+/** reply of stand-in gateway to request of the target, file length is its path length */
+std::string statusReply(const std::string &target)
+{
+    const auto path = target.substr(WEBHDFS_PREFIX.size(),
+                                    target.find('?') - WEBHDFS_PREFIX.size());
+    return "{\"FileStatus\":{\"accessTime\":0,\"blockSize\":134217728,\"group\":\"supergroup\","
+           "\"length\":" + std::to_string(path.size()) + ",\"modificationTime\":0,"
+           "\"owner\":\"hdfs\",\"pathSuffix\":\"\",\"permission\":\"644\",\"replication\":3,"
+           "\"type\":\"FILE\"}}";
+}
+
+/** stand-in of gateway answering GETFILESTATUS of any path over HTTP/1.1 and h2c */
+class StandInServer
+{
+public:
+    StandInServer()
+        : m_connectionsCount(0)
+    {
+        m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int reuse = 1;
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addressSize = sizeof(address);
+        if (::bind(m_fd, reinterpret_cast<sockaddr *>(&address), addressSize) != 0 ||
+            ::listen(m_fd, 128) != 0 ||
+            getsockname(m_fd, reinterpret_cast<sockaddr *>(&address), &addressSize) != 0)
+        {
+            throw std::runtime_error("can't start stand-in server");
+        }
+        m_port = ntohs(address.sin_port);
+        m_acceptThread = std::thread(&StandInServer::acceptConnections, this);
+    }
+
+    /* stops accepting, drops open connections and waits for all server threads */
+    ~StandInServer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            ::shutdown(m_fd, SHUT_RDWR);
+            for (const auto fd : m_connections)
+            {
+                ::shutdown(fd, SHUT_RDWR);
+            }
+        }
+        m_acceptThread.join();
+        for (auto &thread : m_serveThreads)
+        {
+            thread.join();
+        }
+        ::close(m_fd);
+    }
+
+    int port() const { return m_port; }
+
+    /* number of connections accepted so far */
+    size_t connectionsCount() const { return m_connectionsCount; }
+
+private:
+    void acceptConnections()
+    {
+        while (true)
+        {
+            const int fd = ::accept(m_fd, nullptr, nullptr);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping)
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+                return;
+            }
+            if (fd >= 0)
+            {
+                ++m_connectionsCount;
+                m_connections.insert(fd);
+                m_serveThreads.push_back(std::thread(&StandInServer::serve, this, fd));
+            }
+        }
+    }
+
+    /* serve keep-alive connection until client closes it, protocol is chosen by preface */
+    void serve(int fd)
+    {
+        const int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        std::string input;
+        char buffer[16384];
+        while (input.size() < sizeof(HTTP2_PREFACE) - 1 &&
+               input.compare(0, std::string::npos, HTTP2_PREFACE, input.size()) == 0)
+        {
+            const auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            input.append(buffer, n);
+        }
+        if (input.compare(0, sizeof(HTTP2_PREFACE) - 1, HTTP2_PREFACE) == 0)
+        {
+            serveHttp2(fd, input);
+        }
+        else
+        {
+            serveHttp1(fd, input);
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connections.erase(fd);
+        ::close(fd);
+    }
+
+    static void serveHttp1(int fd, std::string &input)
+    {
+        char buffer[16384];
+        while (true)
+        {
+            const auto headersEnd = input.find("\r\n\r\n");
+            if (headersEnd == std::string::npos)
+            {
+                const auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                {
+                    return;
+                }
+                input.append(buffer, n);
+                continue;
+            }
+            const auto requestLine = input.substr(0, input.find("\r\n"));
+            input.erase(0, headersEnd + 4);
+            const auto targetBegin = requestLine.find(' ') + 1;
+            const auto target =
+                requestLine.substr(targetBegin, requestLine.find(' ', targetBegin) - targetBegin);
+            const auto body = statusReply(target);
+            const auto response = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\n"
+                                  "Content-Length: " + std::to_string(body.size()) +
+                                  "\r\n\r\n" + body;
+            if (!sendAll(fd, response.data(), response.size()))
+            {
+                return;
+            }
+        }
+    }
+
+    /* h2c session state, streams are answered when their requests end */
+    struct Http2Session
+    {
+        std::map<int32_t, std::string> targets; // :path of open streams
+        std::map<int32_t, std::pair<std::string, size_t>> replies; // body and sent size
+    };
+
+    static void serveHttp2(int fd, const std::string &input)
+    {
+        Http2Session state;
+        nghttp2_session_callbacks *callbacks = nullptr;
+        nghttp2_session_callbacks_new(&callbacks);
+        nghttp2_session_callbacks_set_on_header_callback(callbacks, &onHeader);
+        nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &onFrameRecv);
+        nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &onStreamClose);
+        nghttp2_session *session = nullptr;
+        nghttp2_session_server_new(&session, callbacks, &state);
+        nghttp2_session_callbacks_del(callbacks);
+
+        nghttp2_settings_entry settings[] = {{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 256}};
+        nghttp2_submit_settings(session, NGHTTP2_FLAG_NONE, settings, 1);
+        std::string pending = input;
+        char buffer[16384];
+        while (true)
+        {
+            if (!pending.empty() &&
+                nghttp2_session_mem_recv(session,
+                                         reinterpret_cast<const uint8_t *>(pending.data()),
+                                         pending.size()) < 0)
+            {
+                break;
+            }
+            pending.clear();
+            const uint8_t *data = nullptr;
+            ssize_t size = 0;
+            bool sent = true;
+            while (sent && (size = nghttp2_session_mem_send(session, &data)) > 0)
+            {
+                sent = sendAll(fd, reinterpret_cast<const char *>(data), size);
+            }
+            if (!sent || size < 0 ||
+                (!nghttp2_session_want_read(session) && !nghttp2_session_want_write(session)))
+            {
+                break;
+            }
+            const auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n <= 0)
+            {
+                break;
+            }
+            pending.assign(buffer, n);
+        }
+        nghttp2_session_del(session);
+    }
+
+    static int onHeader(nghttp2_session *, const nghttp2_frame *frame, const uint8_t *name,
+                        size_t nameSize, const uint8_t *value, size_t valueSize, uint8_t,
+                        void *userData)
+    {
+        auto &state = *static_cast<Http2Session *>(userData);
+        if (frame->hd.type == NGHTTP2_HEADERS &&
+            std::string(reinterpret_cast<const char *>(name), nameSize) == ":path")
+        {
+            state.targets[frame->hd.stream_id].assign(reinterpret_cast<const char *>(value),
+                                                      valueSize);
+        }
+        return 0;
+    }
+
+    static int onFrameRecv(nghttp2_session *session, const nghttp2_frame *frame,
+                           void *userData)
+    {
+        auto &state = *static_cast<Http2Session *>(userData);
+        const auto streamId = frame->hd.stream_id;
+        if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) ||
+            !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM) || !state.targets.count(streamId))
+        {
+            return 0;
+        }
+        state.replies[streamId] = std::make_pair(statusReply(state.targets[streamId]), 0);
+        auto makeHeader = [](const char *name, const std::string &value)
+        {
+            return nghttp2_nv{
+                reinterpret_cast<uint8_t *>(const_cast<char *>(name)),
+                reinterpret_cast<uint8_t *>(const_cast<char *>(value.c_str())),
+                std::strlen(name), value.size(), NGHTTP2_NV_FLAG_NONE};
+        };
+        const std::string status = "200";
+        const std::string contentType = "application/json";
+        const auto contentLength = std::to_string(state.replies[streamId].first.size());
+        nghttp2_nv headers[] = {makeHeader(":status", status),
+                                makeHeader("content-type", contentType),
+                                makeHeader("content-length", contentLength)};
+        nghttp2_data_provider provider;
+        provider.source.ptr = nullptr;
+        provider.read_callback = &readReply;
+        return nghttp2_submit_response(session, streamId, headers, 3, &provider);
+    }
+
+    static ssize_t readReply(nghttp2_session *, int32_t streamId, uint8_t *buffer,
+                             size_t length, uint32_t *flags, nghttp2_data_source *,
+                             void *userData)
+    {
+        auto &reply = static_cast<Http2Session *>(userData)->replies[streamId];
+        const auto size = std::min(length, reply.first.size() - reply.second);
+        std::memcpy(buffer, reply.first.data() + reply.second, size);
+        reply.second += size;
+        if (reply.second == reply.first.size())
+        {
+            *flags |= NGHTTP2_DATA_FLAG_EOF;
+        }
+        return size;
+    }
+
+    static int onStreamClose(nghttp2_session *, int32_t streamId, uint32_t, void *userData)
+    {
+        auto &state = *static_cast<Http2Session *>(userData);
+        state.targets.erase(streamId);
+        state.replies.erase(streamId);
+        return 0;
+    }
+
+    static bool sendAll(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            const auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    int m_fd;
+    int m_port;
+    std::atomic<size_t> m_connectionsCount;
+    bool m_stopping = false;
+    std::set<int> m_connections; // served sockets
+    std::thread m_acceptThread;
+    std::vector<std::thread> m_serveThreads;
+    std::mutex m_mutex;
+};
+
+/** run benchmark case, returns best time of repeats, s */
+double measure(size_t repeats, const std::function<void()> &run)
+{
+    auto best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < repeats; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+} // namespace
+
+
+int main(int argc, const char *argv[]) try
+{
+    const size_t requests = argc > 1 ? std::stoull(argv[1]) : 10000;
+    const size_t parallelism = argc > 2 ? std::stoull(argv[2]) : 64;
+    const size_t repeats = argc > 3 ? std::stoull(argv[3]) : 3;
+
+    StandInServer server;
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < requests; ++i)
+    {
+        paths.push_back("/data/file-" + std::to_string(i));
+    }
+
+    std::cout << requests << " GETFILESTATUS requests, " << parallelism
+              << " in parallel, best of " << repeats << " runs\n"
+              << std::setw(10) << std::left << "protocol" << std::setw(16) << "requests/s"
+              << "connections\n";
+    for (const auto http2 : {false, true})
+    {
+        std::cout << std::setw(10) << std::left << (http2 ? "HTTP/2" : "HTTP/1.1");
+        WebHDFS::ClientOptions options;
+        try
+        {
+            options.setHttp2(http2, parallelism);
+        }
+        catch (const WebHDFS::Exception &e)
+        {
+            std::cout << "skipped: " << e.what() << '\n';
+            continue;
+        }
+        WebHDFS::Client client("127.0.0.1", server.port(), options);
+        const auto connectionsBefore = server.connectionsCount();
+        const auto seconds = measure(repeats, [&]
+                                     {
+                                         std::vector<WebHDFS::FileStatus> statuses;
+                                         const auto found =
+                                             client.getFileStatuses(paths, statuses,
+                                                                    parallelism);
+                                         if (std::count(found.begin(), found.end(), true) !=
+                                                 static_cast<long>(paths.size()) ||
+                                             statuses.back().length != paths.back().size())
+                                         {
+                                             throw std::runtime_error("wrong file statuses");
+                                         }
+                                     });
+        std::cout << std::setw(16) << static_cast<size_t>(requests / seconds)
+                  << server.connectionsCount() - connectionsBefore << '\n';
+    }
+    return 0;
+}
+catch (const std::exception &e)
+{
+    std::cerr << "benchmark failed: " << e.what() << '\n';
+    return 1;
+}
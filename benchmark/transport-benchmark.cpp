@@ -0,0 +1,337 @@
+/**
+ * @file
+ * @brief  Benchmark of datanode data transports (libcurl and native epoll)
+ * @author gruzovator
+ * @date   2015-07-15
+ *
+ * Benchmark starts local stand-in WebHDFS server (namenode block locations and redirects,
+ * datanode reads of a virtual file) and reads the file with both transports: whole file
+ * (throughput) and many small ranges (per-request overhead).
+ *
+ * Usage: ./webhdfs-transport-benchmark [<file size MiB>] [<repeats>]
+ */
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "WebHdfsClient.h"
+#include "WebHdfsTransport.h"
+
+
+namespace
+{
+
+const size_t BLOCK_SIZE = 128 << 20;
+const size_t PATTERN_PERIOD = 251; // file byte at offset is offset % PATTERN_PERIOD
+
+/** stand-in of namenode and datanode serving one virtual file */
+class StandInServer
+{
+public:
+    explicit StandInServer(size_t fileSize)
+        : m_fileSize(fileSize)
+        , m_pattern(PATTERN_PERIOD * 4096)
+    {
+        for (size_t i = 0; i < m_pattern.size(); ++i)
+        {
+            m_pattern[i] = static_cast<char>(i % PATTERN_PERIOD);
+        }
+        m_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+        const int reuse = 1;
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address;
+        std::memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addressSize = sizeof(address);
+        if (::bind(m_fd, reinterpret_cast<sockaddr *>(&address), addressSize) != 0 ||
+            ::listen(m_fd, 128) != 0 ||
+            getsockname(m_fd, reinterpret_cast<sockaddr *>(&address), &addressSize) != 0)
+        {
+            throw std::runtime_error("can't start stand-in server");
+        }
+        m_port = ntohs(address.sin_port);
+        m_acceptThread = std::thread(&StandInServer::acceptConnections, this);
+    }
+
+    /* stops accepting, drops open connections and waits for all server threads */
+    ~StandInServer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+            ::shutdown(m_fd, SHUT_RDWR);
+            for (const auto fd : m_connections)
+            {
+                ::shutdown(fd, SHUT_RDWR);
+            }
+        }
+        m_acceptThread.join();
+        for (auto &thread : m_serveThreads)
+        {
+            thread.join();
+        }
+        ::close(m_fd);
+    }
+
+    int port() const { return m_port; }
+
+private:
+    void acceptConnections()
+    {
+        while (true)
+        {
+            const int fd = ::accept(m_fd, nullptr, nullptr);
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stopping)
+            {
+                if (fd >= 0)
+                {
+                    ::close(fd);
+                }
+                return;
+            }
+            if (fd >= 0)
+            {
+                m_connections.insert(fd);
+                m_serveThreads.push_back(std::thread(&StandInServer::serve, this, fd));
+            }
+        }
+    }
+
+    /* serve keep-alive connection until client closes it */
+    void serve(int fd)
+    {
+        const int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        std::string input;
+        char buffer[4096];
+        while (true)
+        {
+            const auto headersEnd = input.find("\r\n\r\n");
+            if (headersEnd == std::string::npos)
+            {
+                const auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                {
+                    break;
+                }
+                input.append(buffer, n);
+                continue;
+            }
+            const auto requestLine = input.substr(0, input.find("\r\n"));
+            input.erase(0, headersEnd + 4);
+            const auto targetBegin = requestLine.find(' ') + 1;
+            const auto target =
+                requestLine.substr(targetBegin, requestLine.find(' ', targetBegin) - targetBegin);
+            if (!reply(fd, target))
+            {
+                break;
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_connections.erase(fd);
+        ::close(fd);
+    }
+
+    bool reply(int fd, const std::string &target)
+    {
+        std::map<std::string, std::string> query;
+        std::istringstream iss(target.substr(target.find('?') + 1));
+        std::string item;
+        while (std::getline(iss, item, '&'))
+        {
+            const auto eq = item.find('=');
+            query[item.substr(0, eq)] = eq == std::string::npos ? "" : item.substr(eq + 1);
+        }
+        const auto offset = std::min<size_t>(std::stoull("0" + query["offset"]), m_fileSize);
+        const size_t length = query.count("length") ? std::stoull(query["length"])
+                                                  : m_fileSize - offset;
+        const auto end = std::min(m_fileSize, offset + length);
+        const auto self = "127.0.0.1:" + std::to_string(m_port);
+
+        if (query["op"] == "GETFILEBLOCKLOCATIONS")
+        {
+            std::ostringstream json;
+            json << "{\"BlockLocations\":{\"BlockLocation\":[";
+            for (size_t block = offset / BLOCK_SIZE * BLOCK_SIZE; block < end; block += BLOCK_SIZE)
+            {
+                json << (block > offset / BLOCK_SIZE * BLOCK_SIZE ? "," : "")
+                     << "{\"offset\":" << block
+                     << ",\"length\":" << std::min(BLOCK_SIZE, m_fileSize - block)
+                     << ",\"corrupt\":false,\"hosts\":[\"127.0.0.1\"],\"names\":[\"" << self
+                     << "\"],\"topologyPaths\":[\"/rack/" << self << "\"]}";
+            }
+            json << "]}}";
+            return send(fd, "200 OK", "Content-Type: application/json\r\n", json.str());
+        }
+        if (query["op"] == "OPEN" && !query.count("datanode"))
+        {
+            const auto path = target.substr(0, target.find('?'));
+            return send(fd, "307 Temporary Redirect",
+                        "Location: http://" + self + path + "?op=OPEN&datanode=true&offset=" +
+                            std::to_string(offset) + "\r\n",
+                        "");
+        }
+        if (query["op"] == "OPEN")
+        {
+            std::ostringstream headers;
+            headers << "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                    << "Content-Length: " << end - offset << "\r\n\r\n";
+            if (!sendAll(fd, headers.str().data(), headers.str().size()))
+            {
+                return false;
+            }
+            const size_t chunk = m_pattern.size() - PATTERN_PERIOD;
+            for (auto position = offset; position < end; position += chunk)
+            {
+                if (!sendAll(fd, m_pattern.data() + position % PATTERN_PERIOD,
+                             std::min(chunk, end - position)))
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+        return send(fd, "400 Bad Request", "",
+                    "{\"RemoteException\":{\"exception\":\"IllegalArgumentException\","
+                    "\"message\":\"bad op\"}}");
+    }
+
+    static bool send(int fd, const std::string &status, const std::string &headers,
+                     const std::string &body)
+    {
+        const auto response = "HTTP/1.1 " + status + "\r\n" + headers + "Content-Length: " +
+                              std::to_string(body.size()) + "\r\n\r\n" + body;
+        return sendAll(fd, response.data(), response.size());
+    }
+
+    static bool sendAll(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            const auto n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n <= 0)
+            {
+                return false;
+            }
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    const size_t m_fileSize;
+    std::vector<char> m_pattern;
+    int m_fd;
+    int m_port;
+    bool m_stopping = false;
+    std::set<int> m_connections; // served sockets
+    std::thread m_acceptThread;
+    std::vector<std::thread> m_serveThreads;
+    std::mutex m_mutex;
+};
+
+/** run benchmark case, returns best time of repeats, s */
+double measure(size_t repeats, const std::function<void()> &run)
+{
+    auto best = std::numeric_limits<double>::max();
+    for (size_t i = 0; i < repeats; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        best = std::min(best, elapsed.count());
+    }
+    return best;
+}
+
+} // namespace
+
+
+int main(int argc, const char *argv[]) try
+{
+    const size_t fileSize = (argc > 1 ? std::stoull(argv[1]) : 1024) << 20;
+    const size_t repeats = argc > 2 ? std::stoull(argv[2]) : 3;
+    const size_t rangeCount = 2000;
+    const size_t rangeSize = 4096;
+
+    StandInServer server(fileSize);
+    std::vector<WebHDFS::FileRange> ranges;
+    for (size_t i = 0; i < rangeCount; ++i)
+    {
+        ranges.push_back(WebHDFS::FileRange{i * (fileSize / rangeCount), rangeSize});
+    }
+
+    std::cout << "file " << (fileSize >> 20) << " MiB, " << rangeCount << " ranges of "
+              << rangeSize << " bytes, best of " << repeats << " runs\n"
+              << std::setw(10) << std::left << "transport" << std::setw(20) << "file read, MB/s"
+              << "ranges read, ranges/s\n";
+    for (const auto &name : {"libcurl", "epoll"})
+    {
+        WebHDFS::ClientOptions options;
+        if (name == std::string("epoll"))
+        {
+            options.setTransport(std::make_shared<WebHDFS::EpollTransport>());
+        }
+        WebHDFS::Client client("127.0.0.1", server.port(), options);
+
+        bool valid = true;
+        const auto fileTime = measure(repeats, [&]
+        {
+            size_t received = 0;
+            client.readFileDirect("/bench/file",
+                                  [&](size_t offset, const char *data, size_t size)
+                                  {
+                                      valid = valid && static_cast<unsigned char>(data[0]) ==
+                                                           offset % PATTERN_PERIOD;
+                                      received += size;
+                                      return true;
+                                  },
+                                  WebHDFS::DirectReadOptions().setParallelism(8));
+            valid = valid && received == fileSize;
+        });
+        const auto rangesTime = measure(repeats, [&]
+        {
+            size_t received = 0;
+            client.readRanges("/bench/file", ranges,
+                              [&](size_t, const char *, size_t size)
+                              {
+                                  received += size;
+                                  return true;
+                              },
+                              WebHDFS::RangeReadOptions().setMaxGap(0).setReadOptions(
+                                  WebHDFS::DirectReadOptions().setParallelism(8)));
+            valid = valid && received == rangeCount * rangeSize;
+        });
+        if (!valid)
+        {
+            throw std::runtime_error(std::string(name) + " transport read wrong data");
+        }
+        std::cout << std::setw(10) << name << std::setw(20) << std::fixed << std::setprecision(0)
+                  << fileSize / fileTime / 1e6 << rangeCount / rangesTime << '\n';
+    }
+    return 0;
+}
+catch (const std::exception &ex)
+{
+    std::cerr << "Exception: " << ex.what() << '\n';
+    return 1;
+}
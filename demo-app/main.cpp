@@ -5,15 +5,34 @@
  * @date   2015-07-15
  *
  * Usage example: ./webhdfs cat hdfs://hd0-dev/tmp/webhdfs-test.txt
+ *
+ * Batch mode example: ./webhdfs batch commands.txt 8
+ *
+ * Glob pattern example: ./webhdfs ls 'hdfs://hd0-dev/logs/2026-10-1?/hour=1?/part-*'
+ *
+ * Cross-cluster copy example: ./webhdfs cp -r hdfs://hd0-dev/data hdfs://hd1-prod/data
  */
 #include <fstream>
 #include <stdexcept>
+#include <map>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <unistd.h>
 
 #include <boost/regex.hpp>
 #include "boost/date_time/posix_time/posix_time.hpp"
 
 #include "utils.h"
 #include "WebHdfsClient.h"
+#include "WebHdfsGlob.h"
+#include "WebHdfsCopy.h"
 
 
 using utils::log_info;
@@ -34,48 +53,190 @@ bool parseRemotePath(const std::string &path, std::string &host, std::string &re
     return false;
 }
 
-int main(int argc, const char *argv[]) try
+/** print file status line of ls command */
+void printFileStatus(std::ostream &out, const std::string &name, const WebHDFS::FileStatus &item)
+{
+    std::ostringstream oss;
+    oss << std::setw(20) << std::left;
+    if (name.length() > 16)
+    {
+        oss << name.substr(0, 16) + "...";
+    }
+    else
+    {
+        oss << name;
+    }
+    oss << std::setw(10)
+        << (item.type == WebHDFS::FileStatus::PathObjectType::FILE ? "file" : "dir")
+        << std::setw(20) << item.owner << std::setw(20)
+        << boost::posix_time::from_time_t(item.modificationTime / 1000);
+    out << oss.str() << '\n';
+}
+
+/** print path matched by glob pattern (ls command) */
+void printGlobMatch(std::ostream &out, const WebHDFS::GlobMatch &match)
+{
+    std::ostringstream time;
+    time << boost::posix_time::from_time_t(match.status.modificationTime / 1000);
+    std::ostringstream oss;
+    oss << std::setw(10) << std::left
+        << (match.status.type == WebHDFS::FileStatus::PathObjectType::FILE ? "file" : "dir")
+        << std::setw(20) << match.status.owner << std::setw(16) << match.status.length
+        << std::setw(24) << time.str() << match.path;
+    out << oss.str() << '\n';
+}
+
+/** expand remote path glob pattern, throws if nothing matches */
+std::vector<WebHDFS::GlobMatch> expandGlob(WebHDFS::Client &client, const std::string &pattern)
+{
+    auto matches = WebHDFS::GlobPattern(pattern).expand(client);
+    if (matches.empty())
+    {
+        throw std::runtime_error("No paths match " + pattern);
+    }
+    return matches;
+}
+
+/** list files of remote directory tree (cp -r), destination directories are created */
+void listCopyTree(WebHDFS::Client &srcClient, const std::string &srcDir,
+                  WebHDFS::Client &dstClient, const std::string &dstDir,
+                  std::vector<WebHDFS::CopyFile> &files)
+{
+    dstClient.makeDir(dstDir);
+    const auto srcPrefix = srcDir.back() == '/' ? srcDir : srcDir + '/';
+    const auto dstPrefix = dstDir.back() == '/' ? dstDir : dstDir + '/';
+    for (const auto &item : srcClient.listDir(srcDir))
+    {
+        if (item.type == WebHDFS::FileStatus::PathObjectType::FILE)
+        {
+            files.push_back({srcPrefix + item.pathSuffix, dstPrefix + item.pathSuffix});
+        }
+        else
+        {
+            listCopyTree(srcClient, srcPrefix + item.pathSuffix, dstClient,
+                         dstPrefix + item.pathSuffix, files);
+        }
+    }
+}
+
+/** clients of remote hosts, client is created on first use and reused by next commands */
+class Clients
+{
+public:
+    explicit Clients(const WebHDFS::ClientOptions &clientOptions)
+        : m_clientOptions(clientOptions)
+    {
+    }
+
+    WebHDFS::Client &get(const std::string &host)
+    {
+        auto &client = m_clients[host];
+        if (!client)
+        {
+            client.reset(new WebHDFS::Client(host, m_clientOptions));
+        }
+        return *client;
+    }
+
+private:
+    const WebHDFS::ClientOptions m_clientOptions;
+    std::map<std::string, std::unique_ptr<WebHDFS::Client>> m_clients;
+};
+
+/** run command (args[0] is command name), returns false if command is unknown */
+bool runCommand(const std::vector<std::string> &args, Clients &clients, std::ostream &out)
 {
-    using namespace std;
     std::string remoteHost;
     std::string remotePath;
 
-    WebHDFS::ClientOptions clientOptions;
-    clientOptions.setConnectTimeout(10).setDataTransferTimeout(6000).setUserName(
-        "webhdfs-client");
-
     auto throwWrongRemotePathFormat = [](const std::string &op)
     {
         throw std::runtime_error(op + " command remote path argument has wrong format");
     };
 
-    if (argc == 3 && argv[1] == std::string("cat"))
+    if (args.size() == 2 && args[0] == "cat")
     {
-        std::string target(argv[2]);
+        const std::string &target(args[1]);
         if (!parseRemotePath(target, remoteHost, remotePath))
         {
             throwWrongRemotePathFormat("cat");
         }
         log_info("Printing", target, "...");
-        WebHDFS::Client client(remoteHost, clientOptions);
-        client.readFile(remotePath, std::cout);
+        clients.get(remoteHost).readFile(remotePath, out);
     }
-    else if (argc == 4 && argv[1] == std::string("cp"))
+    else if ((args.size() == 3 || (args.size() == 4 && args[1] == "-r")) && args[0] == "cp")
     {
-        const std::string src(argv[2]);
-        const std::string dest(argv[3]);
+        const bool recursive = args.size() == 4;
+        const std::string &src(args[args.size() - 2]);
+        const std::string &dest(args[args.size() - 1]);
+        std::string destHost;
+        std::string destPath;
 
-        if (parseRemotePath(src, remoteHost, remotePath))
+        if (parseRemotePath(src, remoteHost, remotePath) &&
+            parseRemotePath(dest, destHost, destPath))
         {
-            // remote to local
-            log_info("Copying", src, "to", dest, "...");
-            std::ofstream ofs(dest);
-            if (!ofs.is_open())
+            // remote to remote (other cluster), data doesn't go through local disk
+            auto &srcClient = clients.get(remoteHost);
+            auto &dstClient = clients.get(destHost);
+            const auto copyOptions =
+                WebHDFS::CopyOptions()
+                    .setWriteOptions(WebHDFS::WriteOptions().setOverwrite(true))
+                    .setParallelism(8);
+            std::vector<WebHDFS::CopyFile> files;
+            if (WebHDFS::GlobPattern::hasWildcards(remotePath))
+            {
+                // files matching pattern to directory
+                const auto dstPrefix = destPath.back() == '/' ? destPath : destPath + '/';
+                for (const auto &match : expandGlob(srcClient, remotePath))
+                {
+                    const auto name = match.path.substr(match.path.rfind('/') + 1);
+                    if (match.status.type == WebHDFS::FileStatus::PathObjectType::FILE)
+                    {
+                        files.push_back({match.path, dstPrefix + name});
+                    }
+                    else if (recursive)
+                    {
+                        listCopyTree(srcClient, match.path, dstClient, dstPrefix + name, files);
+                    }
+                }
+            }
+            else if (recursive && srcClient.getFileStatus(remotePath).type ==
+                                      WebHDFS::FileStatus::PathObjectType::DIRECTORY)
+            {
+                listCopyTree(srcClient, remotePath, dstClient, destPath, files);
+            }
+            else
             {
-                throw std::runtime_error("Can't open file " + dest);
+                files.push_back({remotePath, destPath});
             }
-            WebHDFS::Client client(remoteHost, clientOptions);
-            client.readFile(remotePath, ofs);
+            log_info("Copying", files.size(), "files from", src, "to", dest, "...");
+            WebHDFS::copyBetween(srcClient, dstClient, files, copyOptions);
+        }
+        else if (recursive)
+        {
+            throwWrongRemotePathFormat("cp -r");
+        }
+        else if (parseRemotePath(src, remoteHost, remotePath) &&
+            WebHDFS::GlobPattern::hasWildcards(remotePath))
+        {
+            // remote files matching pattern to local directory
+            auto &client = clients.get(remoteHost);
+            for (const auto &match : expandGlob(client, remotePath))
+            {
+                if (match.status.type != WebHDFS::FileStatus::PathObjectType::FILE)
+                {
+                    continue;
+                }
+                const auto localPath = dest + '/' + match.path.substr(match.path.rfind('/') + 1);
+                log_info("Copying", match.path, "to", localPath, "...");
+                client.downloadToFile(match.path, localPath);
+            }
+        }
+        else if (parseRemotePath(src, remoteHost, remotePath))
+        {
+            // remote to local
+            log_info("Copying", src, "to", dest, "...");
+            clients.get(remoteHost).downloadToFile(remotePath, dest);
         }
         else if (parseRemotePath(dest, remoteHost, remotePath))
         {
@@ -86,57 +247,66 @@ int main(int argc, const char *argv[]) try
             {
                 throw std::runtime_error("Can't open file " + src);
             }
-            WebHDFS::Client client(remoteHost, clientOptions);
-            client.writeFile(ifs, remotePath, WebHDFS::WriteOptions().setOverwrite(true));
+            clients.get(remoteHost).writeFile(ifs, remotePath,
+                                              WebHDFS::WriteOptions().setOverwrite(true));
         }
         else
         {
             throwWrongRemotePathFormat("cp");
         }
     }
-    else if (argc == 3 && argv[1] == std::string("rm"))
+    else if (args.size() == 2 && args[0] == "rm")
     {
-        std::string target(argv[2]);
-        if (parseRemotePath(target, remoteHost, remotePath))
+        const std::string &target(args[1]);
+        if (parseRemotePath(target, remoteHost, remotePath) &&
+            WebHDFS::GlobPattern::hasWildcards(remotePath))
+        {
+            auto &client = clients.get(remoteHost);
+            for (const auto &match : expandGlob(client, remotePath))
+            {
+                log_info("Removing", match.path, "...");
+                client.remove(match.path);
+            }
+        }
+        else if (parseRemotePath(target, remoteHost, remotePath))
         {
             log_info("Removing", target, "...");
-            WebHDFS::Client client(remoteHost, clientOptions);
-            client.remove(remotePath);
+            clients.get(remoteHost).remove(remotePath);
         }
         else
         {
             throwWrongRemotePathFormat("rm");
         }
     }
-    else if (argc == 3 && argv[1] == std::string("ls"))
+    else if (args.size() == 2 && args[0] == "ls")
     {
-        std::string target(argv[2]);
-        if (parseRemotePath(target, remoteHost, remotePath))
+        const std::string &target(args[1]);
+        if (parseRemotePath(target, remoteHost, remotePath) &&
+            WebHDFS::GlobPattern::hasWildcards(remotePath))
         {
-            log_info(target, "directory listing:");
-            WebHDFS::Client client(remoteHost, clientOptions);
-            const auto items = client.listDir(remotePath);
-            for (auto item : items)
+            log_info(target, "matches:");
+            for (const auto &match : expandGlob(clients.get(remoteHost), remotePath))
             {
-                std::ostringstream oss;
-                oss << std::setw(20) << std::left;
-                if (item.pathSuffix.length() > 16)
-                {
-                    oss << item.pathSuffix.substr(0, 16) + "...";
-                }
-                else if (!item.pathSuffix.empty())
-                {
-                    oss << item.pathSuffix;
-                }
-                else //remotePath is a file, just copy it 
+                printGlobMatch(out, match);
+            }
+        }
+        else if (parseRemotePath(target, remoteHost, remotePath))
+        {
+            auto &client = clients.get(remoteHost);
+            const auto status = client.getFileStatus(remotePath);
+            if (status.type == WebHDFS::FileStatus::PathObjectType::FILE)
+            {
+                log_info(target, "file status:");
+                printFileStatus(out, remotePath.substr(remotePath.find_last_of('/') + 1),
+                                status);
+            }
+            else
+            {
+                log_info(target, "directory listing:");
+                for (const auto &item : client.listDir(remotePath))
                 {
-                    oss << remotePath.substr(remotePath.find_last_of('/'));
+                    printFileStatus(out, item.pathSuffix, item);
                 }
-                oss << std::setw(10)
-                    << (item.type == WebHDFS::FileStatus::PathObjectType::FILE ? "file" : "dir")
-                    << std::setw(20) << item.owner << std::setw(20)
-                    << boost::posix_time::from_time_t(item.modificationTime / 1000);
-                cout << oss.str() << '\n';
             }
         }
         else
@@ -144,46 +314,60 @@ int main(int argc, const char *argv[]) try
             throwWrongRemotePathFormat("ls");
         }
     }
-    else if (argc == 3 && argv[1] == std::string("mkdir"))
+    else if (args.size() == 2 && args[0] == "du")
     {
-        std::string target(argv[2]);
+        const std::string &target(args[1]);
+        if (parseRemotePath(target, remoteHost, remotePath))
+        {
+            log_info(target, "disk usage:");
+            const auto summary = clients.get(remoteHost).getContentSummary(remotePath);
+            out << std::setw(16) << std::left << "length" << summary.length << '\n'
+                << std::setw(16) << "space consumed" << summary.spaceConsumed << '\n'
+                << std::setw(16) << "files" << summary.fileCount << '\n'
+                << std::setw(16) << "directories" << summary.directoryCount << '\n';
+        }
+        else
+        {
+            throwWrongRemotePathFormat("du");
+        }
+    }
+    else if (args.size() == 2 && args[0] == "mkdir")
+    {
+        const std::string &target(args[1]);
         if (parseRemotePath(target, remoteHost, remotePath))
         {
             log_info("Creating", target, "directory ...");
-            WebHDFS::Client client(remoteHost, clientOptions);
-            client.makeDir(remotePath);
+            clients.get(remoteHost).makeDir(remotePath);
         }
         else
         {
             throwWrongRemotePathFormat("mkdir");
         }
     }
-    else if (argc == 4 && argv[1] == std::string("rename"))
+    else if (args.size() == 3 && args[0] == "rename")
     {
-        const std::string from(argv[2]);
-        const std::string to(argv[3]);
+        const std::string &from(args[1]);
+        const std::string &to(args[2]);
 
         if (parseRemotePath(from, remoteHost, remotePath))
         {
-            // remote to local
             log_info("Renaming", from, "to", to, "...");
-            WebHDFS::Client client(remoteHost, clientOptions);
-            client.rename(remotePath, to);
+            clients.get(remoteHost).rename(remotePath, to);
         }
         else
         {
             throwWrongRemotePathFormat("rename");
         }
     }
-    else if (argc == 3 && argv[1] == std::string("test"))
+    else if (args.size() == 2 && args[0] == "test")
     {
-        const std::string remoteDirPath(argv[2]);
+        const std::string &remoteDirPath(args[1]);
 
         if (parseRemotePath(remoteDirPath, remoteHost, remotePath))
         {
             log_info("Testing...");
             remotePath+="/test.txt";
-            WebHDFS::Client client(remoteHost, clientOptions);
+            auto &client = clients.get(remoteHost);
             for(size_t i=0; i<2; ++i)
             {
                 log_info("Iteration", i);
@@ -197,7 +381,7 @@ int main(int argc, const char *argv[]) try
                     const auto items = client.listDir(remotePath);
                     for(const auto &item: items)
                     {
-                        cout << item.pathSuffix << endl;
+                        out << item.pathSuffix << std::endl;
                     }
                 }
                 {
@@ -208,8 +392,8 @@ int main(int argc, const char *argv[]) try
                 }
                 {
                     log_info("Cat temporary remote file", remotePath);
-                    client.readFile(remotePath, cout);
-                    cout << endl;
+                    client.readFile(remotePath, out);
+                    out << std::endl;
                 }
                 {
                     log_info("Overwriting temporary remote file", remotePath);
@@ -218,8 +402,8 @@ int main(int argc, const char *argv[]) try
                 }
                 {
                     log_info("Cat temporary remote file", remotePath);
-                    client.readFile(remotePath, cout);
-                    cout << endl;
+                    client.readFile(remotePath, out);
+                    out << std::endl;
                 }
                 {
                     log_info("Removing remote file", remotePath);
@@ -234,24 +418,223 @@ int main(int argc, const char *argv[]) try
     }
     else
     {
-        std::string app = argv[0];
-        auto sepPos = app.rfind('/');
-        if (sepPos != std::string::npos)
-        {
-            app = app.substr(sepPos + 1);
-        }
-        std::cerr << "*** WebHDFS client demo ***\n"
-                  << "Usage: " << app << " COMMAND OPTIONS\n\t"
-                  << app << " cat <hdfs path>\n\t"
-                  << app << " cp <local file> <hdfs file path>\n\t"
-                  << app << " cp <hdfs file path> <local file>\n\t"
-                  << app << " rm <hdfs path>\n\t"
-                  << app << " ls <hdfs dir path>\n\t"
-                  << app << " rename <hdfs path> <new path>\n"
-                  << app << " test <hdfs tmp dir path to r/w test files>\n"
-                  << "Example:\n\t"
-                  << app << " cat hdfs://hd0-dev/tmp/webhdfs-test.txt\n";
-        return 1;
+        return false;
+    }
+    return true;
+}
+
+/** open anonymous temporary file for command output (the file is removed on close) */
+std::unique_ptr<std::fstream> openSpoolFile()
+{
+    const char *tmpDir = std::getenv("TMPDIR");
+    std::string path = std::string(tmpDir && *tmpDir ? tmpDir : "/tmp") +
+                       "/webhdfs-client-XXXXXX";
+    const int fd = ::mkstemp(&path[0]);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Can't create temporary file " + path);
+    }
+    ::close(fd);
+    std::unique_ptr<std::fstream> file(new std::fstream(
+        path, std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary));
+    ::unlink(path.c_str());
+    if (!file->is_open())
+    {
+        throw std::runtime_error("Can't open temporary file " + path);
+    }
+    return file;
+}
+
+/**
+ * Run commands read from the stream (one command per line, empty lines and lines starting
+ * with '#' are skipped). Commands are run concurrently by worker threads, line "wait" waits
+ * for completion of all previous commands. Every worker reuses its clients of remote hosts.
+ * Output of a command is spooled to a temporary file and printed when the command is
+ * completed. Returns number of failed commands.
+ */
+size_t runBatch(std::istream &commands, size_t parallelism,
+                const WebHDFS::ClientOptions &clientOptions)
+{
+    struct Command
+    {
+        size_t lineNo;
+        std::vector<std::string> args;
+    };
+
+    std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<Command> queue;
+    size_t running = 0;
+    size_t failed = 0;
+    bool finished = false;
+
+    auto work = [&]()
+    {
+        Clients clients(clientOptions);
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            queueChanged.wait(lock, [&] { return finished || !queue.empty(); });
+            if (queue.empty())
+            {
+                return;
+            }
+            const Command command = std::move(queue.front());
+            queue.pop_front();
+            ++running;
+            queueChanged.notify_all();
+            lock.unlock();
+
+            std::unique_ptr<std::fstream> out;
+            bool ok = false;
+            try
+            {
+                // output (e.g. cat of a large file) isn't kept in memory
+                out = openSpoolFile();
+                ok = runCommand(command.args, clients, *out);
+                if (!ok)
+                {
+                    log_err("Line", command.lineNo, ": unknown command or wrong arguments");
+                }
+            }
+            catch (const std::exception &ex)
+            {
+                ok = false;
+                log_err("Line", command.lineNo, ": exception:", ex.what());
+            }
+            catch (...)
+            {
+                ok = false;
+                log_err("Line", command.lineNo, ": unknown exception");
+            }
+
+            lock.lock();
+            if (out && out->tellp() > 0)
+            {
+                out->seekg(0);
+                std::cout << out->rdbuf();
+            }
+            std::cout << std::flush;
+            failed += ok ? 0 : 1;
+            --running;
+            queueChanged.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < parallelism; ++i)
+    {
+        workers.emplace_back(work);
+    }
+
+    std::string line;
+    for (size_t lineNo = 1; std::getline(commands, line); ++lineNo)
+    {
+        std::istringstream iss(line);
+        std::vector<std::string> args{std::istream_iterator<std::string>(iss),
+                                      std::istream_iterator<std::string>()};
+        if (args.empty() || args[0][0] == '#')
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        if (args.size() == 1 && args[0] == "wait")
+        {
+            queueChanged.wait(lock, [&] { return queue.empty() && running == 0; });
+            continue;
+        }
+        // keep reading ahead limited, commands can be read from a pipe
+        queueChanged.wait(lock, [&] { return queue.size() < parallelism; });
+        queue.push_back(Command{lineNo, std::move(args)});
+        queueChanged.notify_all();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        finished = true;
+    }
+    queueChanged.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    return failed;
+}
+
+int main(int argc, const char *argv[]) try
+{
+    WebHDFS::ClientOptions clientOptions;
+    clientOptions.setConnectTimeout(10).setDataTransferTimeout(6000).setUserName(
+        "webhdfs-client");
+
+    if (argc >= 2 && argc <= 4 && argv[1] == std::string("batch"))
+    {
+        const std::string source(argc >= 3 ? argv[2] : "-");
+        size_t parallelism = 4;
+        if (argc == 4 && !(std::istringstream(argv[3]) >> parallelism))
+        {
+            throw std::runtime_error("batch parallelism argument has wrong format");
+        }
+        if (parallelism == 0)
+        {
+            throw std::runtime_error("batch parallelism must be positive");
+        }
+        size_t failed = 0;
+        if (source == "-")
+        {
+            failed = runBatch(std::cin, parallelism, clientOptions);
+        }
+        else
+        {
+            std::ifstream ifs(source);
+            if (!ifs.is_open())
+            {
+                throw std::runtime_error("Can't open file " + source);
+            }
+            failed = runBatch(ifs, parallelism, clientOptions);
+        }
+        if (failed)
+        {
+            log_err(failed, "commands failed");
+            return 1;
+        }
+    }
+    else
+    {
+        Clients clients(clientOptions);
+        const std::vector<std::string> args(argv + std::min(argc, 1), argv + argc);
+        if (!runCommand(args, clients, std::cout))
+        {
+            std::string app = argc > 0 ? argv[0] : "webhdfs-client";
+            auto sepPos = app.rfind('/');
+            if (sepPos != std::string::npos)
+            {
+                app = app.substr(sepPos + 1);
+            }
+            std::cerr << "*** WebHDFS client demo ***\n"
+                      << "Usage: " << app << " COMMAND OPTIONS\n\t"
+                      << app << " cat <hdfs path>\n\t"
+                      << app << " cp <local file> <hdfs file path>\n\t"
+                      << app << " cp <hdfs file path> <local file>\n\t"
+                      << app << " cp <hdfs path pattern> <local dir>\n\t"
+                      << app << " cp [-r] <hdfs path> <hdfs path>\n\t"
+                      << app << " rm <hdfs path>\n\t"
+                      << app << " ls <hdfs path>\n\t"
+                      << app << " du <hdfs path>\n\t"
+                      << app << " mkdir <hdfs path>\n\t"
+                      << app << " rename <hdfs path> <new path>\n\t"
+                      << app << " test <hdfs tmp dir path to r/w test files>\n\t"
+                      << app << " batch [<commands file> or - for stdin] [<parallelism>]\n"
+                      << "Batch mode runs commands (one per line) concurrently, "
+                      << "line 'wait' waits for previous commands\n"
+                      << "Paths of cp (source), rm and ls can be glob patterns "
+                      << "(*, ?, [a-z], {a,b})\n"
+                      << "cp between hdfs paths streams data from cluster to cluster, "
+                      << "-r copies directory tree\n"
+                      << "Example:\n\t"
+                      << app << " cat hdfs://hd0-dev/tmp/webhdfs-test.txt\n";
+            return 1;
+        }
     }
     log_info("Done");
     return 0;
@@ -87,20 +87,25 @@ void log_to_stream(std::ostream &os, Args &&... args)
     os << '\n';
 }
 
+// line is written at once to not mix up lines logged by several threads
 template <typename... Args>
 void log_info(Args &&... args)
 {
-    std::cerr << "\033[1;32m";
-    log_to_stream(std::cerr, std::forward<Args>(args)...);
-    std::cerr << "\033[0m";
+    std::ostringstream oss;
+    oss << "\033[1;32m";
+    log_to_stream(oss, std::forward<Args>(args)...);
+    oss << "\033[0m";
+    std::cerr << oss.str();
 }
 
 template <typename... Args>
 void log_err(Args &&... args)
 {
-    std::cerr << "\033[1;31m";
-    log_to_stream(std::cerr, std::forward<Args>(args)...);
-    std::cerr << "\033[0m";
+    std::ostringstream oss;
+    oss << "\033[1;31m";
+    log_to_stream(oss, std::forward<Args>(args)...);
+    oss << "\033[0m";
+    std::cerr << oss.str();
 }
 
 } //namespace utils
@@ -13,6 +13,10 @@
 #include <iostream>
 #include <map>
 #include <memory>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 /** @brief WebHDFS client namespace */
 namespace WebHDFS
@@ -25,6 +29,41 @@ public:
     Exception(const std::string &error);
 };
 
+/** @brief Server error reply
+ *
+ *  Type is a name of server side exception (e.g. FileNotFoundException, RetriableException,
+ *  StandbyException) or empty string if reply has no %RemoteException object.
+ */
+class RemoteException : public Exception
+{
+public:
+    RemoteException(const std::string &type, const std::string &message, long httpCode);
+
+    const std::string &type() const;
+
+    const std::string &message() const;
+
+    long httpCode() const;
+
+private:
+    std::string m_type;
+    std::string m_message;
+    long m_httpCode;
+};
+
+/** @brief Data transfer error (libcurl error code is available) */
+class TransportException : public Exception
+{
+public:
+    TransportException(int curlCode, const std::string &error);
+
+    /** @brief libcurl CURLcode value */
+    int curlCode() const;
+
+private:
+    int m_curlCode;
+};
+
 /** @defgroup Options Client operations options
  *
  *  See %WebHDFS project docs for detailed options info.
@@ -54,6 +93,9 @@ public:
     WriteOptions &setReplication(int replication);
     WriteOptions &setPermission(int permission);
     WriteOptions &setBufferSize(size_t bufferSize);
+
+    /** @brief Check if existing file is overwritten (default is false) */
+    bool overwrite() const;
 };
 
 class AppendOptions : public details::OptionsBase
@@ -82,9 +124,133 @@ public:
     RemoveOptions &setRecursive(bool recursive);
 };
 
+/** @brief Options of direct datanode reads (see Client::readFileDirect) */
+class DirectReadOptions
+{
+public:
+    DirectReadOptions();
+
+    /** @brief Set offset of the first byte to read (default is 0) */
+    DirectReadOptions &setOffset(size_t offset);
+
+    /** @brief Set number of bytes to read (default is 0, that means up to the end of file) */
+    DirectReadOptions &setLength(size_t length);
+
+    /** @brief Prefer block replicas located on the host */
+    DirectReadOptions &addPreferredHost(const std::string &host);
+
+    /** @brief Prefer block replicas located in the rack (e.g. "/default-rack") */
+    DirectReadOptions &addPreferredRack(const std::string &rack);
+
+    /** @brief Set max number of blocks fetched at once (default is 4) */
+    DirectReadOptions &setParallelism(size_t blocks);
+
+private:
+    friend class Client;
+    size_t m_offset;
+    size_t m_length;
+    std::vector<std::string> m_preferredHosts;
+    std::vector<std::string> m_preferredRacks;
+    size_t m_parallelism;
+};
+
+/** @brief Options of downloading to local file (see Client::downloadToFile) */
+class DownloadOptions
+{
+public:
+    DownloadOptions();
+
+    /** @brief Set options of reading blocks from datanodes (offset and length are ignored) */
+    DownloadOptions &setReadOptions(const DirectReadOptions &readOptions);
+
+    /** @brief Write with O_DIRECT files not smaller than the size (default is 0 - never) */
+    DownloadOptions &setDirectIoThreshold(size_t bytes);
+
+    /** @brief Flush file to disk before moving it to target path (default is true) */
+    DownloadOptions &setSync(bool sync);
+
+private:
+    friend class Client;
+    DirectReadOptions m_readOptions;
+    size_t m_directIoThreshold;
+    bool m_sync;
+};
+
+/** @brief Options of vectored read (see Client::readRanges) */
+class RangeReadOptions
+{
+public:
+    RangeReadOptions();
+
+    /**
+     * @brief Set options of reading blocks from datanodes (offset and length are ignored,
+     * parallelism is the number of merged ranges pieces fetched at once)
+     */
+    RangeReadOptions &setReadOptions(const DirectReadOptions &readOptions);
+
+    /** @brief Set max gap between ranges merged into one request, bytes (default is 128 KiB) */
+    RangeReadOptions &setMaxGap(size_t bytes);
+
+    /** @brief Set max size of merged range, bytes (default is 8 MiB) */
+    RangeReadOptions &setMaxMergedSize(size_t bytes);
+
+private:
+    friend class Client;
+    DirectReadOptions m_readOptions;
+    size_t m_maxGap;
+    size_t m_maxMergedSize;
+};
+
+/** @brief Options of multi-file upload (see Client::writeFiles) */
+class UploadOptions
+{
+public:
+    UploadOptions();
+
+    /** @brief Set options of created files */
+    UploadOptions &setWriteOptions(const WriteOptions &writeOptions);
+
+    /** @brief Set max number of files written to datanodes at once (default is 4) */
+    UploadOptions &setParallelism(size_t files);
+
+    /**
+     * @brief Set max number of files whose namenode CREATE requests are made ahead of data
+     * writing (default is 4)
+     */
+    UploadOptions &setCreateAhead(size_t files);
+
+private:
+    friend class Client;
+    WriteOptions m_writeOptions;
+    size_t m_parallelism;
+    size_t m_createAhead;
+};
+
 /** @} */
 
 
+/** @brief File block location
+ *
+ *  See %BlockLocation object desription in Hadoop FileSystem docs.
+ */
+struct BlockLocation
+{
+    size_t offset = 0;
+    size_t length = 0;
+    bool corrupt = false;
+    std::vector<std::string> hosts;         // replicas datanodes hostnames
+    std::vector<std::string> names;         // replicas datanodes ip:port
+    std::vector<std::string> topologyPaths; // replicas network locations (/rack/ip:port)
+};
+
+/** @brief Handler of a received piece of file data
+ *
+ *  Parameters are the piece offset in the file, data and data size. Return false to abort
+ *  the transfer.
+ */
+using RangeDataHandler = std::function<bool(size_t offset, const char *data, size_t size)>;
+
+
 /** @brief HDFS filesystem item info
  *
  *  See %FileStatus object desription in %WebHDFS project docs.
@@ -108,7 +274,421 @@ struct FileStatus
     PathObjectType type = PathObjectType::FILE;
 };
 
+/** @brief Handler of listed directory entry, returns false to stop listing */
+using FileStatusHandler = std::function<bool(const FileStatus &status)>;
+
+/** @brief Handler of entry of concurrently listed directories (see Client::listDirs)
+ *
+ *  Parameters are the directory index in the list and the entry. Return false to stop
+ *  listing.
+ */
+using DirEntryHandler = std::function<bool(size_t dirIndex, const FileStatus &status)>;
+
+/** @brief File range of vectored read (see Client::readRanges) */
+struct FileRange
+{
+    size_t offset;
+    size_t length;
+};
+
+/** @brief Handler of a whole range of vectored read
+ *
+ *  Parameters are the range index in the request list, range data and its size. Return
+ *  false to stop reading.
+ */
+using FileRangeHandler = std::function<bool(size_t rangeIndex, const char *data, size_t size)>;
+
+/** @brief Local file and its remote path of multi-file upload */
+struct UploadFile
+{
+    std::string localFilePath;
+    std::string remoteFilePath;
+};
+
+/** @brief %WebHDFS service endpoint (namenode host and port) */
+struct Endpoint
+{
+    Endpoint(const std::string &host, int port = 50070);
+    std::string host;
+    int port;
+};
+
+/** @brief Directory content summary
+ *
+ *  See %ContentSummary object desription in %WebHDFS project docs.
+ */
+struct ContentSummary
+{
+    size_t directoryCount = 0;
+    size_t fileCount = 0;
+    size_t length = 0;
+    long quota = -1;
+    size_t spaceConsumed = 0;
+    long spaceQuota = -1;
+};
+
 class Client;
+class TraceRecorder;
+class Transport;
+struct TransportRequest;
+
+/** @brief Retry policy of idempotent requests
+ *
+ *  Requests failed with retriable errors (RetriableException, 502/503/504 replies,
+ *  connection errors and timeouts) are retried with exponential backoff and jitter,
+ *  if no data was received yet. Retries are limited by client retry budget: every
+ *  successful request adds @a ratio retry tokens (up to @a maxTokens), every retry takes one.
+ */
+class RetryPolicy
+{
+public:
+    RetryPolicy();
+
+    /** @brief Set max attempts to make a request (default is 3, 1 disables retries) */
+    RetryPolicy &setMaxAttempts(int attempts);
+
+    /** @brief Set backoff of the first retry and max backoff (default is 100 ms and 5 s) */
+    RetryPolicy &setBackoff(int initialMilliseconds, int maxMilliseconds);
+
+    /** @brief Set randomly subtracted part of backoff, from 0 to 1 (default is 0.5) */
+    RetryPolicy &setJitter(double jitter);
+
+    /** @brief Set retry budget (default is 0.1 retry per successful request, up to 10) */
+    RetryPolicy &setBudget(double ratio, double maxTokens);
+
+private:
+    friend class Client;
+    int m_maxAttempts;
+    int m_initialBackoff;
+    int m_maxBackoff;
+    double m_jitter;
+    double m_budgetRatio;
+    double m_budgetMaxTokens;
+};
+
+/** @brief Statistics of memory budget */
+struct MemoryBudgetStats
+{
+    size_t limit = 0;
+    size_t used = 0;          ///< buffered bytes of in-flight transfers
+    size_t peak = 0;          ///< max of used bytes
+    size_t pauses = 0;        ///< transfers pauses because of exhausted budget
+    size_t overdrafts = 0;    ///< transfers and buffers allowed to exceed the limit
+    size_t waits = 0;         ///< buffer acquisitions which waited for memory
+};
+
+/** @brief Memory budget of client transfer buffers
+ *
+ *  Budget limits data buffered in memory by in-flight transfers (replies of metadata
+ *  operations and error replies) and read-ahead buffers of library components using the
+ *  client options (prefetching reader chunks, merged ranges of vectored reads). Transfer
+ *  which would exceed the budget is paused until other transfers complete. To guarantee
+ *  progress of replies larger than the whole budget, one paused transfer at a time is
+ *  allowed to exceed the limit. Applications can charge their own buffers with acquire()
+ *  and release(). Budget is thread safe and is intended to be shared by all clients of the
+ *  process.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  auto budget = std::make_shared<WebHDFS::MemoryBudget>(512 << 20);
+ *  WebHDFS::Client client("webhdfs.server.local",
+ *                         WebHDFS::ClientOptions().setMemoryBudget(budget));
+ *
+ *  @endcode
+ */
+class MemoryBudget
+{
+public:
+    explicit MemoryBudget(size_t limitBytes);
+
+    MemoryBudget(const MemoryBudget &) = delete;
+    MemoryBudget &operator=(const MemoryBudget &) = delete;
+
+    MemoryBudgetStats stats() const;
+
+    /** @brief Acquire memory of a buffer if it fits the limit */
+    bool tryAcquire(size_t bytes);
+
+    /**
+     * @brief Acquire memory of a buffer, waits until it fits the limit
+     *
+     * Buffer larger than the whole limit is acquired when nothing else is.
+     */
+    void acquire(size_t bytes);
+
+    /** @brief Acquire memory of a buffer even if it exceeds the limit (for buffers progress
+     *  of their holder depends on, e.g. the first one of a read) */
+    void forceAcquire(size_t bytes);
+
+    /** @brief Release memory of acquired buffer */
+    void release(size_t bytes);
+
+private:
+    friend class Client;
+
+    /* acquire memory, overdraft allows to exceed the limit (if nobody else does it) */
+    bool tryAcquire(size_t bytes, bool allowOverdraft, bool &overdraft);
+    void release(size_t bytes, bool overdraft);
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    MemoryBudgetStats m_stats;
+    bool m_overdraftTaken;
+};
+
+/** @brief Cache of resolved hosts addresses
+ *
+ *  Resolved addresses are pinned in transfers of clients using the cache, so requests don't
+ *  wait for DNS resolution. Addresses are resolved again on use after TTL expiration (old
+ *  addresses are kept if resolution fails). Cache is thread safe and can be shared by all
+ *  clients of the process.
+ */
+class DnsCache
+{
+public:
+    /** @brief Create cache, @a ttlSeconds is time of resolved addresses use */
+    explicit DnsCache(int ttlSeconds = 60);
+
+    DnsCache(const DnsCache &) = delete;
+    DnsCache &operator=(const DnsCache &) = delete;
+
+    /** @brief Resolve host if it isn't cached or its addresses are expired */
+    void resolve(const std::string &host, int port);
+
+    /** @brief Resolve again all cached hosts */
+    void refresh();
+
+private:
+    friend class Client;
+
+    struct Entry
+    {
+        std::string addresses; // comma separated
+        std::chrono::steady_clock::time_point expiration;
+    };
+
+    /* resolve host, returns false if it failed */
+    bool resolve(const std::string &host, int port, bool force);
+    /* get pinned addresses in libcurl CURLOPT_RESOLVE format if they are changed after
+     * the generation, generation is updated */
+    bool pinnedAddresses(unsigned long &generation, std::vector<std::string> &pinned) const;
+
+    const int m_ttlSeconds;
+    mutable std::mutex m_mutex;
+    std::map<std::pair<std::string, int>, Entry> m_entries;
+    unsigned long m_generation;
+};
+
+/** @brief Options of adaptive concurrency control */
+class ConcurrencyOptions
+{
+public:
+    ConcurrencyOptions();
+
+    /** @brief Set initial limit of in-flight requests of an endpoint (default is 4) */
+    ConcurrencyOptions &setInitialLimit(size_t requests);
+
+    /** @brief Set min and max limits of in-flight requests of an endpoint
+     *  (default is 1 and 64) */
+    ConcurrencyOptions &setLimits(size_t minRequests, size_t maxRequests);
+
+    /** @brief Set factor of limit decrease on overload, from 0 to 1 (default is 0.5) */
+    ConcurrencyOptions &setDecreaseFactor(double factor);
+
+    /** @brief Set ratio of request latency to base latency which is treated as queueing
+     *  if throughput doesn't grow (default is 2) */
+    ConcurrencyOptions &setLatencyTolerance(double ratio);
+
+private:
+    friend class ConcurrencyController;
+    size_t m_initialLimit;
+    size_t m_minLimit;
+    size_t m_maxLimit;
+    double m_decreaseFactor;
+    double m_latencyTolerance;
+};
+
+/** @brief Statistics of concurrency control of an endpoint */
+struct ConcurrencyStats
+{
+    size_t limit = 0;           ///< current limit of in-flight requests
+    size_t inFlight = 0;        ///< requests in flight
+    size_t peakInFlight = 0;    ///< max of requests in flight
+    size_t requests = 0;        ///< completed requests
+    size_t overloadErrors = 0;  ///< requests failed because of overload
+    size_t increases = 0;       ///< additive increases of the limit
+    size_t decreases = 0;       ///< multiplicative decreases of the limit
+    double latency = 0;         ///< mean latency of the last window requests, ms
+    double baseLatency = 0;     ///< latency of not loaded endpoint, ms
+    double requestRate = 0;     ///< requests per second in the last window
+    double throughput = 0;      ///< received bytes per second in the last window
+};
+
+/** @brief AIMD controller of concurrent requests
+ *
+ *  Controller limits requests in flight per endpoint (namenode or datanode host and port).
+ *  Requests are observed in windows of about @a limit completed requests. The limit is
+ *  increased by one after a window where it was reached, and is multiplied by decrease
+ *  factor on overload: error replies of busy server (RetriableException, 429 and 503
+ *  replies) and timeouts, or latency grown above tolerance without growth of request rate
+ *  or throughput. So parallel operations get as many requests in flight as servers can take
+ *  and back off when they get overloaded.
+ *
+ *  Parallelism options of operations (e.g. DirectReadOptions::setParallelism) remain upper
+ *  bounds of requests of a single call. Requests over the limit are deferred, one request
+ *  of a call is started anyway to guarantee progress. Reads by custom data transport
+ *  (ClientOptions::setTransport) are not controlled. Controller is thread safe and is
+ *  intended to be shared by all clients of the process.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  auto concurrency = std::make_shared<WebHDFS::ConcurrencyController>();
+ *  WebHDFS::Client client("webhdfs.server.local",
+ *                         WebHDFS::ClientOptions().setConcurrencyController(concurrency));
+ *  client.getFileStatuses(paths, statuses, 64);
+ *  for (const auto &endpoint : concurrency->stats())
+ *  {
+ *      std::cout << endpoint.first << ": " << endpoint.second.limit << '\n';
+ *  }
+ *
+ *  @endcode
+ */
+class ConcurrencyController
+{
+public:
+    explicit ConcurrencyController(const ConcurrencyOptions &opts = ConcurrencyOptions());
+
+    ConcurrencyController(const ConcurrencyController &) = delete;
+    ConcurrencyController &operator=(const ConcurrencyController &) = delete;
+
+    /** @brief Get statistics of endpoints (by "host:port") */
+    std::map<std::string, ConcurrencyStats> stats() const;
+
+private:
+    friend class Client;
+    using Clock = std::chrono::steady_clock;
+
+    struct EndpointState
+    {
+        ConcurrencyStats stats;
+        bool limited = false;   // limit was reached in the window
+        bool decreased = false; // limit was decreased in the window
+        size_t completed = 0;   // completed requests of the window
+        size_t succeeded = 0;
+        double latencySum = 0;
+        size_t bytes = 0;
+        Clock::time_point start;
+    };
+
+    EndpointState &endpoint(const std::string &name);
+    /* acquire request slot, force allows to exceed the limit */
+    bool tryAcquire(const std::string &name, bool force);
+    /* wait for request slot */
+    void acquire(const std::string &name);
+    /* release slot of completed request */
+    void release(const std::string &name, double latency, size_t bytes, bool overloaded);
+    /* release slot of cancelled request */
+    void cancel(const std::string &name);
+    void decrease(EndpointState &state);
+
+    const ConcurrencyOptions m_options;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::map<std::string, EndpointState> m_endpoints;
+};
+
+/** @brief Options of transfer buffers autotuning */
+class BufferTunerOptions
+{
+public:
+    BufferTunerOptions();
+
+    /** @brief Set limits of socket buffers, bytes (default is 64 KiB and 32 MiB) */
+    BufferTunerOptions &setSocketBufferLimits(size_t minBytes, size_t maxBytes);
+
+    /** @brief Set limits of transfer buffers, bytes (default is 16 KiB and 512 KiB) */
+    BufferTunerOptions &setTransferBufferLimits(size_t minBytes, size_t maxBytes);
+
+    /** @brief Set min size of transfer whose throughput is measured (default is 256 KiB) */
+    BufferTunerOptions &setMinSampleSize(size_t bytes);
+
+private:
+    friend class BufferTuner;
+    size_t m_minSocketBuffer;
+    size_t m_maxSocketBuffer;
+    size_t m_minTransferBuffer;
+    size_t m_maxTransferBuffer;
+    size_t m_minSampleSize;
+};
+
+/** @brief Transfer buffers chosen for a host */
+struct BufferTuning
+{
+    double rtt = 0;            ///< round trip time, ms
+    double throughput = 0;     ///< throughput of a connection, bytes per second
+    size_t samples = 0;        ///< measured transfers
+    size_t socketBuffer = 0;   ///< SO_RCVBUF and SO_SNDBUF of new connections (0 - not tuned)
+    size_t transferBuffer = 0; ///< libcurl receive and upload buffers, server buffersize hint
+};
+
+/** @brief Autotuning of transfer buffers
+ *
+ *  Tuner measures round trip time (TCP handshakes) and throughput (transfers not smaller
+ *  than min sample size) of hosts and sizes buffers of next transfers to the host by
+ *  bandwidth-delay product. Socket buffers of new connections are set to twice the product:
+ *  connection limited by its buffers runs at about buffer size per RTT, so the margin lets
+ *  throughput grow until the link limits it. Transfer buffers (libcurl receive and upload
+ *  buffers and %WebHDFS @a buffersize hint of OPEN, CREATE and APPEND requests which don't
+ *  have it) follow socket buffers within their limits. Hosts are not tuned until measured,
+ *  so their connections keep kernel autotuning.
+ *
+ *  Socket buffers are chosen by the host a connection is made to, so datanode connections
+ *  of redirected requests (e.g. readFile) are tuned too. Transfer buffers are set before
+ *  the request is sent and are chosen by its url host: only requests made to datanodes
+ *  directly (e.g. readFileDirect, readRanges) get datanode transfer buffers.
+ *
+ *  Note that kernel caps socket buffers by net.core.rmem_max and net.core.wmem_max, which
+ *  have to be raised for long fat links. Tuner is thread safe and is intended to be shared
+ *  by all clients of the process, choices can be saved and restored with tuning() and
+ *  setTuning().
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  auto tuner = std::make_shared<WebHDFS::BufferTuner>();
+ *  WebHDFS::Client client("webhdfs.remote-dc.local",
+ *                         WebHDFS::ClientOptions().setBufferTuner(tuner));
+ *
+ *  @endcode
+ */
+class BufferTuner
+{
+public:
+    explicit BufferTuner(const BufferTunerOptions &opts = BufferTunerOptions());
+
+    BufferTuner(const BufferTuner &) = delete;
+    BufferTuner &operator=(const BufferTuner &) = delete;
+
+    /** @brief Get buffers of hosts */
+    std::map<std::string, BufferTuning> tuning() const;
+
+    /** @brief Set buffers of host (e.g. saved by previous run), measurements continue */
+    void setTuning(const std::string &host, const BufferTuning &tuning);
+
+private:
+    friend class Client;
+
+    /* get buffers of the host, false if it's not tuned */
+    bool find(const std::string &host, BufferTuning &tuning) const;
+    /* add measurement of transfer to the host, rtt is 0 if connection was reused */
+    void addSample(const std::string &host, double rtt, size_t bytes, double seconds);
+
+    const BufferTunerOptions m_options;
+    mutable std::mutex m_mutex;
+    std::map<std::string, BufferTuning> m_hosts;
+};
 
 /** @brief Client options
  *
@@ -128,11 +708,60 @@ public:
     /** @brief Set user name for authentication */
     ClientOptions &setUserName(const std::string &username);
 
+    /** @brief Set retry policy of idempotent requests */
+    ClientOptions &setRetryPolicy(const RetryPolicy &retryPolicy);
+
+    /** @brief Set recorder to trace operations and requests (default is none) */
+    ClientOptions &setTraceRecorder(const std::shared_ptr<TraceRecorder> &traceRecorder);
+
+    /** @brief Set memory budget of transfer buffers (default is none, not limited) */
+    ClientOptions &setMemoryBudget(const std::shared_ptr<MemoryBudget> &memoryBudget);
+
+    /** @brief Set cache of resolved hosts (default is none, libcurl resolves hosts) */
+    ClientOptions &setDnsCache(const std::shared_ptr<DnsCache> &dnsCache);
+
+    /**
+     * @brief Set transport of direct datanode reads (default is none, libcurl is used),
+     * see WebHdfsTransport.h
+     */
+    ClientOptions &setTransport(const std::shared_ptr<Transport> &transport);
+
+    /** @brief Set controller of concurrent requests (default is none, parallelism of
+     *  operations is fixed) */
+    ClientOptions &setConcurrencyController(
+        const std::shared_ptr<ConcurrencyController> &concurrencyController);
+
+    /**
+     * @brief Use HTTP/2 (default is false, HTTP/1.1 is used)
+     *
+     * For %WebHDFS gateways (e.g. HttpFS) which speak HTTP/2 over plain TCP (prior
+     * knowledge, no upgrade from HTTP/1.1). Concurrent requests to a host are multiplexed
+     * over one connection, up to @a maxStreams streams at once, others wait for free streams.
+     * Data reads by custom transport (see setTransport) are not affected.
+     *
+     * Requires libcurl 8.0.0 or newer with HTTP/2 support, Exception is thrown otherwise
+     * (h2c connection reuse is broken in 7.x).
+     */
+    ClientOptions &setHttp2(bool http2, size_t maxStreams = 100);
+
+    /** @brief Set autotuning of transfer buffers (default is none, libcurl and kernel
+     *  defaults are used) */
+    ClientOptions &setBufferTuner(const std::shared_ptr<BufferTuner> &bufferTuner);
+
 private:
     friend class Client;
     int m_connectionTimeout;
     int m_dataTransferTimeout;
     std::string m_userName;
+    RetryPolicy m_retryPolicy;
+    std::shared_ptr<TraceRecorder> m_traceRecorder;
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+    std::shared_ptr<DnsCache> m_dnsCache;
+    std::shared_ptr<Transport> m_transport;
+    std::shared_ptr<ConcurrencyController> m_concurrencyController;
+    bool m_http2;
+    size_t m_maxStreams;
+    std::shared_ptr<BufferTuner> m_bufferTuner;
 };
 
 /** @brief %WebHDFS client class
@@ -174,6 +803,20 @@ public:
      */
     explicit Client(const std::string &host, const ClientOptions &opts = ClientOptions());
 
+    /**
+     * @brief Create client for HA cluster
+     *
+     * Requests go to the active namenode. When it turns out to be standby or unreachable,
+     * all other endpoints are probed concurrently and the client switches to the active one.
+     * Active namenode is remembered process-wide, so other clients of the same cluster
+     * start with it.
+     *
+     * @param nameNodes %WebHDFS service endpoints of all cluster namenodes
+     * @param opts Client options
+     */
+    explicit Client(const std::vector<Endpoint> &nameNodes,
+                    const ClientOptions &opts = ClientOptions());
+
     ~Client();
 
     Client(const Client &) = delete;
@@ -184,6 +827,29 @@ public:
     
     Client& operator=(Client &&);
 
+    /** @brief Create independent client with the same endpoints and options
+     *  (e.g. to use in other thread) */
+    Client clone() const;
+
+    /** @brief Memory budget of client options (nullptr if it's not set), components reading
+     *  with the client charge their buffers to it */
+    std::shared_ptr<MemoryBudget> memoryBudget() const;
+
+    /**
+     * @brief Prepare client for low latency requests
+     *
+     * Namenode and datanodes of the files blocks are resolved (and pinned if client has DNS
+     * cache), keep-alive connections to them are opened. At most 16 datanodes are warmed up,
+     * 4 at once (as many as direct reads use by default). Datanodes warm-up is best effort,
+     * its errors are ignored.
+     */
+    void warmUp(const std::vector<std::string> &remoteFilePaths = std::vector<std::string>());
+
+    /** @brief Warm up clients (e.g. clones used by worker threads) concurrently */
+    static void warmUp(std::vector<Client> &clients,
+                       const std::vector<std::string> &remoteFilePaths =
+                           std::vector<std::string>());
+
 
     /** @name %WebHDFS operations */
     /** @{ */
@@ -192,6 +858,16 @@ public:
                    const std::string &remoteFilePath,
                    const WriteOptions &opts = WriteOptions());
 
+    /**
+     * @brief Upload many local files
+     *
+     * Namenode CREATE requests of next files are made concurrently while previous files
+     * are written to datanodes, so both phases of files writing overlap. Upload stops on the
+     * first error (after completion of started transfers), files written before it are kept.
+     */
+    void writeFiles(const std::vector<UploadFile> &files,
+                    const UploadOptions &opts = UploadOptions());
+
     void readFile(const std::string &remoteFilePath,
                   std::ostream &dataSink,
                   const ReadOptions &opts = ReadOptions());
@@ -200,13 +876,135 @@ public:
 
     std::vector<FileStatus> listDir(const std::string &remoteDirPath);
 
+    /**
+     * @brief List directory passing entries to handler as soon as they are received
+     *
+     * Listing reply is parsed incrementally, so memory use doesn't depend on directory size.
+     */
+    void listDir(const std::string &remoteDirPath, const FileStatusHandler &handler);
+
+    FileStatus getFileStatus(const std::string &remotePath);
+
+    ContentSummary getContentSummary(const std::string &remotePath);
+
     void remove(const std::string &remotePath, const RemoveOptions &opts = RemoveOptions());
 
-    void rename(const std::string &remotePath, const std::string &newRemotePath);
+    /**
+     * @brief Rename file or directory
+     *
+     * If @a overwrite is set, existing destination file (or empty directory) is replaced in
+     * the same namenode operation (RENAME with OVERWRITE rename option).
+     */
+    void rename(const std::string &remotePath, const std::string &newRemotePath,
+                bool overwrite = false);
+
+    /**
+     * @brief Move data of source files to the end of the file (sources are deleted)
+     *
+     * See CONCAT operation in %WebHDFS project docs for restrictions on the files (usually
+     * they must be in one directory and have the same block size, all files but the last
+     * one must end on a block boundary).
+     */
+    void concat(const std::string &remoteFilePath,
+                const std::vector<std::string> &remoteSourcePaths);
+
+    /** @brief Get locations of file blocks covering the range (length 0 means up to the end) */
+    std::vector<BlockLocation> getFileBlockLocations(const std::string &remoteFilePath,
+                                                     size_t offset = 0, size_t length = 0);
 
     /** @} */
 
+    /**
+     * @brief List many directories concurrently
+     *
+     * Entries are passed to handler as soon as they are received (see streaming listDir),
+     * entries of different directories are interleaved.
+     * @return flags of listed directories, false for the ones that don't exist
+     */
+    std::vector<bool> listDirs(const std::vector<std::string> &remoteDirPaths,
+                               const DirEntryHandler &handler, size_t parallelism = 8);
+
+    /**
+     * @brief Get statuses of many paths concurrently
+     * @return flags of existing paths, statuses of missing ones are default
+     */
+    std::vector<bool> getFileStatuses(const std::vector<std::string> &remotePaths,
+                                      std::vector<FileStatus> &statuses,
+                                      size_t parallelism = 8);
+
+    /**
+     * @brief Read file directly from datanodes
+     *
+     * Each block is read from a replica chosen by options preferences (replicas are spread
+     * over datanodes when there is no preference), different blocks are fetched concurrently.
+     * Namenode is used only to get block locations and datanodes address.
+     *
+     * Data of one block comes in order, but pieces of different blocks are interleaved.
+     * If block read fails, it's resumed from another replica. If namenode doesn't support
+     * GETFILEBLOCKLOCATIONS, file is read in usual way.
+     */
+    void readFileDirect(const std::string &remoteFilePath,
+                        const RangeDataHandler &dataHandler,
+                        const DirectReadOptions &opts = DirectReadOptions());
+
+    /**
+     * @brief Download file to local file system
+     *
+     * File blocks are read directly from datanodes (see readFileDirect) and written to
+     * preallocated temporary file at their offsets. The temporary file is moved to the
+     * target path when download completes.
+     */
+    void downloadToFile(const std::string &remoteFilePath,
+                        const std::string &localFilePath,
+                        const DownloadOptions &opts = DownloadOptions());
+
+    /**
+     * @brief Read many ranges of the file
+     *
+     * Ranges are sorted and the ones separated by gaps smaller than max gap are merged (gap
+     * bytes are read and dropped). Merged ranges are fetched directly from datanodes
+     * concurrently, so the whole read takes two namenode requests (block locations and
+     * datanode address). Every requested range is passed to handler once, as a whole, when
+     * its merged range is received; ranges come in no particular order. Ranges can overlap.
+     * Exception is thrown if a range is beyond the end of file. With memory budget of client
+     * options, merged ranges are read in batches of at most half of the budget limit; buffers
+     * of a batch are acquired from the budget before the batch is read (waiting for memory)
+     * and released when delivered.
+     */
+    void readRanges(const std::string &remoteFilePath, const std::vector<FileRange> &ranges,
+                    const FileRangeHandler &handler,
+                    const RangeReadOptions &opts = RangeReadOptions());
+
 private:
+    /* run namenode operation, switch to active namenode and rerun it on failover errors */
+    void withFailover(const std::function<void()> &operation);
+    void failover();
+    /* check if failed concurrent namenode request should be repeated, fail over if the
+     * request's namenode is still the active one */
+    bool repeatAfterFailover(const std::exception_ptr &requestError, size_t requestNameNode,
+                             size_t &failovers);
+
+    bool tryGetFileBlockLocations(const std::string &remoteFilePath, size_t offset,
+                                  size_t length, std::vector<BlockLocation> &blocks);
+    /* read file range via namenode redirect */
+    void readRange(const std::string &remoteFilePath, const RangeDataHandler &dataHandler,
+                   size_t offset, size_t length);
+    /* url of datanode read request, host and range are replaced to read other blocks */
+    std::string getDataNodeUrlTemplate(const std::string &remoteFilePath, size_t offset);
+    /* make datanode data requests with options transport or libcurl */
+    std::vector<std::exception_ptr> getData(const std::vector<TransportRequest> &requests,
+                                            size_t maxParallel);
+    /* read file segments (sorted, not overlapping) from datanodes of the blocks */
+    void readBlocksDirect(const std::string &remoteFilePath,
+                          const std::vector<BlockLocation> &blocks,
+                          const std::vector<FileRange> &segments,
+                          const RangeDataHandler &dataHandler, const DirectReadOptions &opts);
+
+    std::vector<Endpoint> m_nameNodes;
+    size_t m_activeNameNode;
+    int m_probeTimeout;
+    std::string m_userName;
+    ClientOptions m_options;
     class UrlBuilder;
     std::unique_ptr<UrlBuilder> m_urlBuilder;
     class HttpClient;
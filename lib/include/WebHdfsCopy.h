@@ -0,0 +1,101 @@
+/**
+ * @file
+ * @brief  Streaming copy of files between clusters
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_COPY_H
+#define WEBHDFS_COPY_H
+
+#include <string>
+#include <vector>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Source and destination paths of copied file */
+struct CopyFile
+{
+    std::string srcPath;
+    std::string dstPath;
+};
+
+/** @brief Options of copy between clusters (see copyBetween) */
+class CopyOptions
+{
+public:
+    CopyOptions();
+
+    /** @brief Set options of created files (block size is always the source one) */
+    CopyOptions &setWriteOptions(const WriteOptions &writeOptions);
+
+    /** @brief Set options of source reads (offset, length and parallelism are ignored) */
+    CopyOptions &setReadOptions(const DirectReadOptions &readOptions);
+
+    /** @brief Set max number of files and ranges copied at once (default is 4) */
+    CopyOptions &setParallelism(size_t pipes);
+
+    /**
+     * @brief Set size of ranges of large files copied in parallel (default is 256 MiB, 0
+     * disables ranges)
+     *
+     * Size is rounded up to the source file block size.
+     */
+    CopyOptions &setRangeSize(size_t bytes);
+
+    /** @brief Set size of in-memory buffer of every copied range (default is 4 MiB) */
+    CopyOptions &setBufferSize(size_t bytes);
+
+private:
+    friend class Copier;
+    WriteOptions m_writeOptions;
+    DirectReadOptions m_readOptions;
+    size_t m_parallelism;
+    size_t m_rangeSize;
+    size_t m_bufferSize;
+};
+
+/**
+ * @brief Copy file between clusters without local staging
+ *
+ * Data read from source datanodes is written to destination datanode as it comes, through
+ * bounded in-memory buffer: the read waits while the buffer is full, the write waits while
+ * it's empty. Buffers are charged to memory budget of the destination client (if it has
+ * one), copies wait for free memory. Files larger than range size are copied as ranges in
+ * parallel. Every range is written to part file next to the destination
+ * (`<dstPath>._COPYING_.<range index>`), when all ranges are copied the parts are
+ * concatenated to the first one, which is renamed to the destination path, so destination
+ * file never has partial content. Existing destination file is replaced only if write
+ * options allow overwrite (otherwise copy fails before any data is copied), by the same
+ * rename (RENAME with OVERWRITE option), so it keeps old content if the rename fails. Copy
+ * concatenated but not renamed is kept as the first part file. Copies use their own clones
+ * of the clients, so clients can be the same object (copy within cluster).
+ *
+ * Usage:
+ * @code{.cpp}
+ *
+ * WebHDFS::Client src("nn.old-cluster.local");
+ * WebHDFS::Client dst("nn.new-cluster.local");
+ * WebHDFS::copyBetween(src, "/data/big.bin", dst, "/data/big.bin",
+ *                      WebHDFS::CopyOptions().setParallelism(8));
+ *
+ * @endcode
+ */
+void copyBetween(const Client &srcClient, const std::string &srcPath,
+                 const Client &dstClient, const std::string &dstPath,
+                 const CopyOptions &opts = CopyOptions());
+
+/**
+ * @brief Copy many files between clusters
+ *
+ * Files (and ranges of the large ones) are copied concurrently, see copyBetween. Copy stops
+ * on the first error (after completion of started copies), files copied before it are
+ * kept, part files of the other ones are removed (except complete copies not renamed).
+ */
+void copyBetween(const Client &srcClient, const Client &dstClient,
+                 const std::vector<CopyFile> &files, const CopyOptions &opts = CopyOptions());
+
+} // namespace WebHDFS
+
+#endif
@@ -0,0 +1,166 @@
+/**
+ * @file
+ * @brief  Incremental tracker of HDFS directories changes
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_DIRECTORY_WATCHER_H
+#define WEBHDFS_DIRECTORY_WATCHER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <functional>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Change of watched directory entry */
+struct DirectoryEvent
+{
+    enum class Type
+    {
+        ADDED,
+        REMOVED,
+        MODIFIED
+    };
+    Type type = Type::ADDED;
+    std::string path; ///< full path of the entry
+    FileStatus::PathObjectType objectType = FileStatus::PathObjectType::FILE;
+    size_t length = 0;          ///< new length (last known one for removed entries)
+    long modificationTime = 0;  ///< new modification time (last known one for removed entries)
+};
+
+/** @brief Handler of directory events, returns false to stop polling */
+using DirectoryEventHandler = std::function<bool(const DirectoryEvent &event)>;
+
+/** @brief Options of directory watcher */
+class WatchOptions
+{
+public:
+    WatchOptions();
+
+    /** @brief Set poll interval of changing directories, ms (default is 1000) */
+    WatchOptions &setMinInterval(long ms);
+
+    /** @brief Set max poll interval of unchanged directories, ms (default is 30000) */
+    WatchOptions &setMaxInterval(long ms);
+
+    /**
+     * @brief Set number of polls after which directory is listed even if its modification
+     * time is unchanged (default is 0, never)
+     *
+     * Directory modification time changes when entries are created, removed or renamed,
+     * but not when a file is appended or its writing is completed.
+     */
+    WatchOptions &setFullListingPeriod(size_t polls);
+
+    /**
+     * @brief Set local file to persist snapshot of watched directories (default is none)
+     *
+     * Snapshot is loaded by watcher constructor (if the file exists) and saved after polls
+     * which found changes, so events are not lost (but can be repeated) after restart.
+     */
+    WatchOptions &setSnapshotPath(const std::string &localPath);
+
+private:
+    friend class DirectoryWatcher;
+    long m_minInterval;
+    long m_maxInterval;
+    size_t m_fullListingPeriod;
+    std::string m_snapshotPath;
+};
+
+/** @brief Watcher of HDFS directories changes
+ *
+ *  Watcher keeps compact snapshot of every watched directory (entries names, types, lengths
+ *  and modification times) and reports only added, removed and modified entries. Directory
+ *  is listed only when its modification time is changed (one GETFILESTATUS request per poll
+ *  otherwise). Poll interval of a directory is reset to min interval when changes are found
+ *  and is doubled up to max interval when they are not. Entries of the first listing are
+ *  reported as added (unless directory state is loaded from snapshot).
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  WebHDFS::DirectoryWatcher watcher(
+ *      client, WebHDFS::WatchOptions().setSnapshotPath("/var/lib/ingest/landing.snapshot"));
+ *  watcher.watch("/landing/clicks");
+ *  watcher.watch("/landing/views");
+ *  watcher.run([&](const WebHDFS::DirectoryEvent &event)
+ *              {
+ *                  if (event.type == WebHDFS::DirectoryEvent::Type::ADDED)
+ *                  {
+ *                      ingest(event.path);
+ *                  }
+ *                  return true;
+ *              });
+ *
+ *  @endcode
+ */
+class DirectoryWatcher
+{
+public:
+    DirectoryWatcher(Client &client, const WatchOptions &opts = WatchOptions());
+
+    DirectoryWatcher(const DirectoryWatcher &) = delete;
+    DirectoryWatcher &operator=(const DirectoryWatcher &) = delete;
+
+    /** @brief Start watching directory, it is polled on the next poll() */
+    void watch(const std::string &remoteDirPath);
+
+    /** @brief Stop watching directory */
+    void unwatch(const std::string &remoteDirPath);
+
+    /**
+     * @brief Poll directories whose poll interval has elapsed
+     * @return false if handler stopped polling (not handled changes are reported again)
+     */
+    bool poll(const DirectoryEventHandler &handler);
+
+    /** @brief Time till the next directory poll is due, ms */
+    long nextPollDelay() const;
+
+    /** @brief Poll directories when they are due until handler returns false */
+    void run(const DirectoryEventHandler &handler);
+
+    /** @brief Save snapshot of watched directories to the local file */
+    void save(const std::string &localPath) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+        std::string name;
+        FileStatus::PathObjectType type;
+        size_t length;
+        long modificationTime;
+    };
+
+    struct Directory
+    {
+        long modificationTime = -1; // -1 if directory wasn't listed
+        std::vector<Entry> entries; // sorted by name
+        bool settling = false;      // changes were found by the last listing
+        size_t pollsSinceListing = 0;
+        long interval = 0;
+        Clock::time_point nextPoll;
+    };
+
+    bool pollDirectory(const std::string &path, Directory &dir,
+                       const DirectoryEventHandler &handler, bool &changed);
+
+    void load(const std::string &localPath);
+
+    Client &m_client;
+    const WatchOptions m_options;
+    std::map<std::string, Directory> m_directories;
+    std::map<std::string, Directory> m_snapshot; // loaded but not yet watched directories
+};
+
+} // namespace WebHDFS
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * @file
+ * @brief  Local disk cache of HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_FILE_CACHE_H
+#define WEBHDFS_FILE_CACHE_H
+
+#include <string>
+#include <map>
+#include <chrono>
+#include <ostream>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Options of local file cache */
+class FileCacheOptions
+{
+public:
+    FileCacheOptions();
+
+    /** @brief Set max total size of cached files, bytes (default is 1 GiB) */
+    FileCacheOptions &setMaxSize(size_t bytes);
+
+    /**
+     * @brief Set time after validation during which cached file is used without validation,
+     * ms (default is 0, file status is requested on every access)
+     */
+    FileCacheOptions &setMaxStaleness(long ms);
+
+    /** @brief Set options of files downloading */
+    FileCacheOptions &setDownloadOptions(const DownloadOptions &downloadOptions);
+
+private:
+    friend class FileCache;
+    size_t m_maxSize;
+    long m_maxStaleness;
+    DownloadOptions m_downloadOptions;
+};
+
+/** @brief Content of cached file mapped to memory, it stays valid when file is evicted */
+class CachedFile
+{
+public:
+    CachedFile(CachedFile &&other);
+    CachedFile &operator=(CachedFile &&other);
+    ~CachedFile();
+
+    CachedFile(const CachedFile &) = delete;
+    CachedFile &operator=(const CachedFile &) = delete;
+
+    const char *data() const { return static_cast<const char *>(m_mapping); }
+    size_t size() const { return m_size; }
+
+private:
+    friend class FileCache;
+    CachedFile(void *mapping, size_t mappingSize, size_t size);
+
+    void *m_mapping;
+    size_t m_mappingSize;
+    size_t m_size;
+};
+
+/** @brief Local disk cache of HDFS files
+ *
+ *  Files are cached by remote path in the local directory and validated by length and
+ *  modification time from GETFILESTATUS request, so hits transfer no file data. Cached file
+ *  is mapped to memory. Least recently used files are evicted when total size of the cache
+ *  exceeds max size. Cache directory can be shared by several processes (downloads and
+ *  evictions are serialized with file locks, files are published by atomic renames), but
+ *  should be used for one HDFS cluster only.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  WebHDFS::FileCache cache(client, "/var/cache/webhdfs",
+ *                           WebHDFS::FileCacheOptions().setMaxSize(10ul << 30));
+ *  const auto dictionary = cache.get("/reference/dictionary.txt");
+ *  parse(dictionary.data(), dictionary.size());
+ *
+ *  @endcode
+ */
+class FileCache
+{
+public:
+    FileCache(Client &client, const std::string &cacheDirPath,
+              const FileCacheOptions &opts = FileCacheOptions());
+
+    FileCache(const FileCache &) = delete;
+    FileCache &operator=(const FileCache &) = delete;
+
+    /** @brief Get file content, file is downloaded if it isn't cached or is outdated */
+    CachedFile get(const std::string &remotePath);
+
+    /** @brief Write file content to the stream (cached replacement of Client::readFile) */
+    void readFile(const std::string &remotePath, std::ostream &dataSink);
+
+    /** @brief Remove file from the cache */
+    void invalidate(const std::string &remotePath);
+
+private:
+    bool tryGetCached(const std::string &remotePath, const FileStatus *status,
+                      CachedFile &file);
+    CachedFile download(const std::string &remotePath, const FileStatus &status);
+    void evict();
+    std::string makeEntryPath(const std::string &remotePath) const;
+
+    Client &m_client;
+    const std::string m_dirPath;
+    const FileCacheOptions m_options;
+    std::map<std::string, std::chrono::steady_clock::time_point> m_validated;
+};
+
+} // namespace WebHDFS
+
+#endif
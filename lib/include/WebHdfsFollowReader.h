@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief  Reader of growing HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_FOLLOW_READER_H
+#define WEBHDFS_FOLLOW_READER_H
+
+#include <string>
+#include <chrono>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Options of growing file reader */
+class FollowOptions
+{
+public:
+    FollowOptions();
+
+    /** @brief Set offset to start reading from (default is 0) */
+    FollowOptions &setOffset(size_t offset);
+
+    /** @brief Start reading from the current end of file, like tail -f (default is false) */
+    FollowOptions &setFromEnd(bool fromEnd);
+
+    /** @brief Set poll interval of growing file, ms (default is 100) */
+    FollowOptions &setMinInterval(long ms);
+
+    /** @brief Set max poll interval of idle file, ms (default is 10000) */
+    FollowOptions &setMaxInterval(long ms);
+
+    /** @brief Set options of appended data reading (offset, length and parallelism are
+     *  ignored, blocks are read in order) */
+    FollowOptions &setReadOptions(const DirectReadOptions &readOptions);
+
+private:
+    friend class FollowReader;
+    size_t m_offset;
+    bool m_fromEnd;
+    long m_minInterval;
+    long m_maxInterval;
+    DirectReadOptions m_readOptions;
+};
+
+/** @brief Reader of file which is still being appended to
+ *
+ *  Reader keeps offset of the data already read. Every poll makes one GETFILESTATUS request
+ *  and reads only the bytes appended since the previous poll (directly from datanodes, see
+ *  Client::readFileDirect). Poll interval is reset to min interval when the file grows, so
+ *  data of active file is delivered with low latency, and is doubled up to max interval
+ *  while the file doesn't change, so idle files don't load the namenode.
+ *
+ *  Reader throws Exception if the file becomes shorter than the read offset (it was
+ *  truncated or replaced) and RemoteException if it's removed.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  WebHDFS::FollowReader reader(client, "/jobs/stream/output.log",
+ *                               WebHDFS::FollowOptions().setFromEnd(true));
+ *  reader.run([&](size_t offset, const char *data, size_t size)
+ *             {
+ *                 std::cout.write(data, size);
+ *                 return !stopRequested;
+ *             });
+ *
+ *  @endcode
+ */
+class FollowReader
+{
+public:
+    FollowReader(Client &client, const std::string &remoteFilePath,
+                 const FollowOptions &opts = FollowOptions());
+
+    FollowReader(const FollowReader &) = delete;
+    FollowReader &operator=(const FollowReader &) = delete;
+
+    /**
+     * @brief Read data appended since the previous poll (if the poll is due)
+     *
+     * Data is passed to handler in order.
+     * @return false if handler stopped reading (next poll continues from the stop point)
+     */
+    bool poll(const RangeDataHandler &dataHandler);
+
+    /** @brief Time till the next poll is due, ms */
+    long nextPollDelay() const;
+
+    /** @brief Poll the file when it is due until handler returns false */
+    void run(const RangeDataHandler &dataHandler);
+
+    /** @brief Offset of the next byte to read */
+    size_t offset() const { return m_offset; }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    Client &m_client;
+    const std::string m_path;
+    const FollowOptions m_options;
+    size_t m_offset;
+    bool m_started;
+    long m_interval;
+    Clock::time_point m_nextPoll;
+};
+
+} // namespace WebHDFS
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file
+ * @brief  Glob patterns expansion
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_GLOB_H
+#define WEBHDFS_GLOB_H
+
+#include <string>
+#include <vector>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Path matched by glob pattern */
+struct GlobMatch
+{
+    std::string path; ///< full path
+    FileStatus status;
+};
+
+/** @brief Options of glob pattern expansion */
+class GlobOptions
+{
+public:
+    GlobOptions();
+
+    /** @brief Set max number of directories listed concurrently (default is 8) */
+    GlobOptions &setParallelism(size_t dirs);
+
+private:
+    friend class GlobPattern;
+    size_t m_parallelism;
+};
+
+/** @brief Glob pattern of HDFS paths
+ *
+ *  Pattern is an absolute path whose components can contain wildcards: `*` (any
+ *  characters), `?` (any character), `[abc]`, `[a-z]`, `[!a-z]` or `[^a-z]` (character of
+ *  the class) and `{a,b}` (any of the alternatives, they can contain wildcards and `/`).
+ *  Backslash escapes the next character. Wildcards never match `/`.
+ *
+ *  Expansion walks the pattern level by level. Only directories matched by previous levels
+ *  are listed and only for components with wildcards, literal components are appended
+ *  without requests. Directories of one level are listed concurrently and their entries are
+ *  filtered while listing replies are parsed, so large directories are never held in memory.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  const WebHDFS::GlobPattern pattern("/logs/2026-10-{0?,1?}/hour=1?/part-*");
+ *  for (const auto &match : pattern.expand(client))
+ *  {
+ *      process(match.path, match.status.length);
+ *  }
+ *
+ *  @endcode
+ */
+class GlobPattern
+{
+public:
+    /** @brief Parse pattern, throws Exception if it's not absolute or has unbalanced braces */
+    explicit GlobPattern(const std::string &pattern);
+
+    /** @brief Check if path has unescaped wildcards (literal paths need no expansion) */
+    static bool hasWildcards(const std::string &path);
+
+    /** @brief Check if the path matches the pattern */
+    bool matches(const std::string &path) const;
+
+    /** @brief Find existing paths matching the pattern, sorted by path */
+    std::vector<GlobMatch> expand(Client &client, const GlobOptions &opts = GlobOptions()) const;
+
+private:
+    // brace-free patterns split into path components
+    std::vector<std::vector<std::string>> m_alternatives;
+};
+
+} // namespace WebHDFS
+
+#endif
@@ -0,0 +1,111 @@
+/**
+ * @file
+ * @brief  Small files packing on top of WebHDFS client
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_PACKED_FILE_H
+#define WEBHDFS_PACKED_FILE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Packed file index item (blob location in the packed file) */
+struct PackedFileEntry
+{
+    std::string key;
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+/** @brief Writer of packed file
+ *
+ *  Packs many small blobs into one HDFS file (@a remotePath) and writes sorted index of
+ *  them to @a remotePath.index file. Blobs are spooled to a local temporary file, remote
+ *  files are written on close().
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  WebHDFS::PackedFileWriter writer(client, "/data/thumbnails.pack");
+ *  writer.add("img-0001", thumbnail1);
+ *  writer.add("img-0002", thumbnail2);
+ *  writer.close();
+ *
+ *  @endcode
+ */
+class PackedFileWriter
+{
+public:
+    PackedFileWriter(Client &client, const std::string &remotePath,
+                     const WriteOptions &opts = WriteOptions());
+
+    /** @brief Remove spooled data if writer wasn't closed */
+    ~PackedFileWriter();
+
+    PackedFileWriter(const PackedFileWriter &) = delete;
+    PackedFileWriter &operator=(const PackedFileWriter &) = delete;
+
+    /** @brief Add blob, keys must be unique */
+    void add(const std::string &key, const char *data, size_t size);
+
+    void add(const std::string &key, const std::string &data);
+
+    /** @brief Write packed file and its index to HDFS */
+    void close();
+
+private:
+    Client &m_client;
+    const std::string m_remotePath;
+    const WriteOptions m_opts;
+    class Spool;
+    std::unique_ptr<Spool> m_spool;
+    std::vector<PackedFileEntry> m_entries;
+    bool m_closed;
+};
+
+/** @brief Reader of packed file
+ *
+ *  Index is loaded on first lookup and cached, then each lookup fetches only the blobs
+ *  with ranged read. Blobs of one lookup lying close to each other in the packed file
+ *  are fetched with one read.
+ */
+class PackedFileReader
+{
+public:
+    /**
+     * @brief Create reader
+     * @param client Client to read with
+     * @param remotePath Packed file path
+     * @param maxGap Max gap between blobs to fetch them with one read
+     */
+    PackedFileReader(Client &client, const std::string &remotePath, size_t maxGap = 64 * 1024);
+
+    /** @brief Get blob, return false if there is no such key */
+    bool get(const std::string &key, std::string &data);
+
+    /** @brief Get several blobs (missing keys are not in result) */
+    std::map<std::string, std::string> get(const std::vector<std::string> &keys);
+
+    /** @brief Get packed file index */
+    const std::vector<PackedFileEntry> &index();
+
+private:
+    const PackedFileEntry *find(const std::string &key);
+
+    Client &m_client;
+    const std::string m_remotePath;
+    const size_t m_maxGap;
+    std::vector<PackedFileEntry> m_index;
+    bool m_indexLoaded;
+};
+
+} // namespace WebHDFS
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file
+ * @brief  Prefetching sequential reader of many HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_PREFETCHING_READER_H
+#define WEBHDFS_PREFETCHING_READER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Options of prefetching reader */
+class PrefetchOptions
+{
+public:
+    PrefetchOptions();
+
+    /** @brief Set number of files downloaded ahead of the current one (default is 2) */
+    PrefetchOptions &setPrefetchCount(size_t files);
+
+    /** @brief Set max size of downloaded but not consumed data (default is 64 MiB), the data
+     *  is also charged to memory budget of client options */
+    PrefetchOptions &setMemoryBudget(size_t bytes);
+
+    /** @brief Set options of files reading */
+    PrefetchOptions &setReadOptions(const ReadOptions &readOptions);
+
+private:
+    friend class PrefetchingReader;
+    size_t m_prefetchCount;
+    size_t m_memoryBudget;
+    ReadOptions m_readOptions;
+};
+
+/** @brief Sequential reader of many files with background prefetching
+ *
+ *  Files are handed to the consumer one by one in the given order, while the current file
+ *  and several next ones are downloaded in background threads (each thread uses its own
+ *  clone of the client). Download pauses when downloaded data exceeds memory budget.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  WebHDFS::PrefetchingReader reader(
+ *      client, WebHDFS::PrefetchingReader::listDirFiles(client, "/logs/2015-07-15"));
+ *  std::string path;
+ *  while (auto stream = reader.next(path))
+ *  {
+ *      process(path, *stream);
+ *  }
+ *
+ *  @endcode
+ *
+ *  Download errors are thrown by stream reading operations (stream has badbit exceptions
+ *  enabled).
+ */
+class PrefetchingReader
+{
+public:
+    PrefetchingReader(const Client &client,
+                      const std::vector<std::string> &remoteFilePaths,
+                      const PrefetchOptions &opts = PrefetchOptions());
+
+    /** @brief Stop background downloads */
+    ~PrefetchingReader();
+
+    PrefetchingReader(const PrefetchingReader &) = delete;
+    PrefetchingReader &operator=(const PrefetchingReader &) = delete;
+
+    /**
+     * @brief Get next file stream
+     *
+     * Previous stream is abandoned (its data is not available anymore).
+     * @param remoteFilePath path of the file
+     * @return stream or nullptr if there are no more files
+     */
+    std::unique_ptr<std::istream> next(std::string &remoteFilePath);
+
+    /** @brief Get sorted paths of files in the directory */
+    static std::vector<std::string> listDirFiles(Client &client, const std::string &remoteDirPath);
+
+private:
+    void stop();
+
+    class State;
+    std::shared_ptr<State> m_state;
+    std::vector<std::thread> m_workers;
+};
+
+} // namespace WebHDFS
+
+#endif
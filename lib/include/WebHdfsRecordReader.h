@@ -0,0 +1,106 @@
+/**
+ * @file
+ * @brief  Delimited records reader of HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_RECORD_READER_H
+#define WEBHDFS_RECORD_READER_H
+
+#include <string>
+#include <vector>
+#include <functional>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+/** @brief Record data (without delimiter), valid only during record handler call */
+struct RecordView
+{
+    const char *data;
+    size_t size;
+
+    std::string str() const
+    {
+        return std::string(data, size);
+    }
+};
+
+/** @brief Record handler, return false to stop reading */
+using RecordHandler = std::function<bool(const RecordView &record)>;
+
+/** @brief Record handler of parallel reading (split index is passed), must be thread safe */
+using SplitRecordHandler = std::function<bool(size_t split, const RecordView &record)>;
+
+/** @brief File byte range to read records from */
+struct InputSplit
+{
+    size_t offset = 0;
+    size_t length = 0;
+};
+
+/** @brief Reader of delimited records (e.g. lines)
+ *
+ *  Records are passed to handler without copying, except the ones crossing received data
+ *  chunks boundaries.
+ *
+ *  Records are read by splits like Hadoop does: split's records are the ones starting
+ *  in the split, so the last record is read beyond the split end. Thus a file can be
+ *  processed by splits in parallel.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  WebHDFS::RecordReader reader(client);
+ *  size_t errors = 0;
+ *  reader.read("/logs/app.log", [&](const WebHDFS::RecordView &line)
+ *  {
+ *      errors += isError(line) ? 1 : 0;
+ *      return true;
+ *  });
+ *
+ *  @endcode
+ */
+class RecordReader
+{
+public:
+    /**
+     * @brief Create reader
+     * @param client Client to read with
+     * @param delimiter Records delimiter
+     * @param lookahead Size of data read beyond split end to get split's last record
+     */
+    explicit RecordReader(Client &client, char delimiter = '\n', size_t lookahead = 64 * 1024);
+
+    /** @brief Read all file records */
+    void read(const std::string &remoteFilePath, const RecordHandler &handler);
+
+    /** @brief Read records starting in the split */
+    void read(const std::string &remoteFilePath, const InputSplit &split,
+              const RecordHandler &handler);
+
+    /**
+     * @brief Read all file records in parallel
+     *
+     * File is divided to splits which are read by several threads (with own clients).
+     * @param remoteFilePath file path
+     * @param threads number of threads
+     * @param splitSize split size (the last split can be smaller)
+     * @param handler thread safe record handler
+     */
+    void readParallel(const std::string &remoteFilePath, size_t threads, size_t splitSize,
+                      const SplitRecordHandler &handler);
+
+    /** @brief Divide file to splits */
+    static std::vector<InputSplit> makeSplits(size_t fileLength, size_t splitSize);
+
+private:
+    Client &m_client;
+    const char m_delimiter;
+    const size_t m_lookahead;
+};
+
+} // namespace WebHDFS
+
+#endif
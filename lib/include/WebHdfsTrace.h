@@ -0,0 +1,84 @@
+/**
+ * @file
+ * @brief  WebHDFS client tracing
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_TRACE_H
+#define WEBHDFS_TRACE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+namespace WebHDFS
+{
+
+/** @brief Recorder of client trace in Chrome trace event format
+ *
+ *  Set recorder to client options to trace operations (one span per client call, on
+ *  caller thread track) and HTTP requests (async spans with DNS, connect, redirect,
+ *  first byte and transfer phases). Trace file can be opened with chrome://tracing or
+ *  Perfetto UI. Recorder can be shared by many clients and threads.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  auto trace = std::make_shared<WebHDFS::TraceRecorder>("/tmp/webhdfs-trace.json");
+ *  WebHDFS::Client client("webhdfs.server.local",
+ *                         WebHDFS::ClientOptions().setTraceRecorder(trace));
+ *
+ *  @endcode
+ */
+class TraceRecorder
+{
+public:
+    /** @brief Create recorder writing trace to the file (on flush or destruction) */
+    explicit TraceRecorder(const std::string &filePath);
+
+    ~TraceRecorder();
+
+    TraceRecorder(const TraceRecorder &) = delete;
+    TraceRecorder &operator=(const TraceRecorder &) = delete;
+
+    /** @brief Write all recorded events to the file */
+    void flush();
+
+    /** @brief Current time in microseconds (steady clock) */
+    static long long now();
+
+    /** @brief Add span of current thread */
+    void addSpan(const std::string &name, const std::string &category, long long start,
+                 long long duration, const std::string &detail = std::string());
+
+    /** @brief Add async span, spans with the same id are shown on one track */
+    void addAsyncSpan(const std::string &name, const std::string &category, unsigned long id,
+                      long long start, long long duration,
+                      const std::string &detail = std::string());
+
+    /** @brief Make id for async spans */
+    unsigned long nextId();
+
+private:
+    struct Event
+    {
+        char phase;
+        std::string name;
+        std::string category;
+        long long timestamp;
+        long long duration;
+        unsigned long id;
+        int thread;
+        std::string detail;
+    };
+
+    const std::string m_filePath;
+    std::mutex m_mutex;
+    std::vector<Event> m_events;
+    std::atomic<unsigned long> m_nextId;
+};
+
+} // namespace WebHDFS
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * @file
+ * @brief  Pluggable transport of datanode data requests
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_TRANSPORT_H
+#define WEBHDFS_TRANSPORT_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <exception>
+
+namespace WebHDFS
+{
+
+/** @brief GET request of transport (datanode url of file range read) */
+struct TransportRequest
+{
+    std::string url;
+    /// handler of response body pieces of successful (200) reply, returns false to abort
+    std::function<bool(const char *data, size_t size)> dataHandler;
+};
+
+/** @brief Transport of datanode data requests
+ *
+ *  Client uses transport for reads directly from datanodes (Client::readFileDirect,
+ *  Client::downloadToFile, Client::readRanges and readers built on them). Namenode requests
+ *  and writes are always made by the built-in libcurl transport, which is also the default
+ *  data transport. Transport can be shared by clients used in different threads, so
+ *  implementations should be thread safe.
+ */
+class Transport
+{
+public:
+    virtual ~Transport() {}
+
+    /**
+     * @brief Make GET requests, at most maxParallel at once
+     * @return errors of requests (nullptr for successful ones), reply with code other than
+     * 200 is a RemoteException
+     */
+    virtual std::vector<std::exception_ptr> get(const std::vector<TransportRequest> &requests,
+                                                size_t maxParallel) = 0;
+};
+
+/** @brief Options of native epoll transport */
+class EpollTransportOptions
+{
+public:
+    EpollTransportOptions();
+
+    /** @brief Set connection timeout, ms (default is 10000) */
+    EpollTransportOptions &setConnectTimeout(long ms);
+
+    /** @brief Set max time without any data received or sent, ms (default is 60000) */
+    EpollTransportOptions &setIdleTimeout(long ms);
+
+    /** @brief Set receive buffer size of a connection, bytes (default is 256 KiB) */
+    EpollTransportOptions &setBufferSize(size_t bytes);
+
+    /** @brief Set max number of kept alive idle connections (default is 64) */
+    EpollTransportOptions &setMaxIdleConnections(size_t connections);
+
+private:
+    friend class EpollTransport;
+    long m_connectTimeout;
+    long m_idleTimeout;
+    size_t m_bufferSize;
+    size_t m_maxIdleConnections;
+};
+
+/** @brief Native HTTP/1.1 transport on epoll
+ *
+ *  Minimal plain HTTP client for the datanode data path: GET requests over keep-alive
+ *  connections multiplexed by one epoll loop per get() call, responses with Content-Length,
+ *  chunked or close-delimited bodies. Every connection owns a fixed receive buffer which is
+ *  allocated once and reused by all its requests; body bytes are passed to data handlers
+ *  right from that buffer. There is no per-transfer handle setup, header list or callback
+ *  machinery, so small range reads cost little more than their system calls. HTTPS,
+ *  proxies and redirects aren't supported (datanode reads need none of them). Requests
+ *  made by this transport are not traced.
+ *
+ *  Usage:
+ *  @code{.cpp}
+ *
+ *  WebHDFS::Client client("webhdfs.server.local",
+ *                         WebHDFS::ClientOptions().setTransport(
+ *                             std::make_shared<WebHDFS::EpollTransport>()));
+ *  client.downloadToFile("/data/big.bin", "/tmp/big.bin");
+ *
+ *  @endcode
+ */
+class EpollTransport : public Transport
+{
+public:
+    explicit EpollTransport(const EpollTransportOptions &opts = EpollTransportOptions());
+    ~EpollTransport();
+
+    EpollTransport(const EpollTransport &) = delete;
+    EpollTransport &operator=(const EpollTransport &) = delete;
+
+    std::vector<std::exception_ptr> get(const std::vector<TransportRequest> &requests,
+                                        size_t maxParallel) override;
+
+private:
+    class Connection;
+    class Transfer;
+
+    /* idle connection of the host (if address is 0) or new one connecting to the address
+     * with the index or a next one, index of connected address is returned in address;
+     * nullptr if there are no more addresses */
+    std::unique_ptr<Connection> acquireConnection(const std::string &host,
+                                                  const std::string &port, size_t &address,
+                                                  bool &reused);
+    void releaseConnection(std::unique_ptr<Connection> connection);
+
+    const EpollTransportOptions m_options;
+    std::mutex m_mutex;
+    std::multimap<std::string, std::unique_ptr<Connection>> m_idleConnections; // by host:port
+};
+
+} // namespace WebHDFS
+
+#endif
@@ -5,14 +5,34 @@
  * @date   2015-07-15
  */
 #include <vector>
+#include <deque>
+#include <fstream>
+#include <algorithm>
+#include <exception>
 #include <sstream>
 #include <cctype>
 #include <iomanip>
+#include <limits>
 #include <mutex>
 #include <memory>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cstdlib>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
 #include <curl/curl.h>
 #include <jsoncpp/json/json.h>
 #include "WebHdfsClient.h"
+#include "WebHdfsTrace.h"
+#include "WebHdfsTransport.h"
 
 
 namespace WebHDFS
@@ -23,6 +43,41 @@ Exception::Exception(const std::string &error)
 {
 }
 
+RemoteException::RemoteException(const std::string &type, const std::string &message,
+                                 long httpCode)
+    : Exception(type.empty() ? message : "remote error: " + message)
+    , m_type(type)
+    , m_message(message)
+    , m_httpCode(httpCode)
+{
+}
+
+const std::string &RemoteException::type() const
+{
+    return m_type;
+}
+
+const std::string &RemoteException::message() const
+{
+    return m_message;
+}
+
+long RemoteException::httpCode() const
+{
+    return m_httpCode;
+}
+
+TransportException::TransportException(int curlCode, const std::string &error)
+    : Exception(error)
+    , m_curlCode(curlCode)
+{
+}
+
+int TransportException::curlCode() const
+{
+    return m_curlCode;
+}
+
 
 std::string details::OptionsBase::toQueryString() const
 {
@@ -41,6 +96,12 @@ WriteOptions &WriteOptions::setOverwrite(bool overwrite)
     return *this;
 }
 
+bool WriteOptions::overwrite() const
+{
+    const auto it = m_options.find("&overwrite=");
+    return it != m_options.end() && it->second == "true";
+}
+
 WriteOptions &WriteOptions::setBlockSize(size_t blockSize)
 {
     m_options["&blocksize="] = std::to_string(blockSize);
@@ -101,520 +162,3844 @@ RemoveOptions &RemoveOptions::setRecursive(bool recursive)
     return *this;
 }
 
-ClientOptions::ClientOptions()
-    : m_connectionTimeout(0)
-    , m_dataTransferTimeout(0)
+DirectReadOptions::DirectReadOptions()
+    : m_offset(0)
+    , m_length(0)
+    , m_parallelism(4)
 {
 }
 
-ClientOptions &ClientOptions::setConnectTimeout(int seconds)
+DirectReadOptions &DirectReadOptions::setOffset(size_t offset)
 {
-    m_connectionTimeout = seconds;
+    m_offset = offset;
     return *this;
 }
 
-ClientOptions &ClientOptions::setDataTransferTimeout(int seconds)
+DirectReadOptions &DirectReadOptions::setLength(size_t length)
 {
-    m_dataTransferTimeout = seconds;
+    m_length = length;
     return *this;
 }
 
-ClientOptions &ClientOptions::setUserName(const std::string &username)
+DirectReadOptions &DirectReadOptions::addPreferredHost(const std::string &host)
 {
-    m_userName = username;
+    m_preferredHosts.push_back(host);
+    return *this;
+}
+
+DirectReadOptions &DirectReadOptions::addPreferredRack(const std::string &rack)
+{
+    m_preferredRacks.push_back(rack);
     return *this;
 }
 
+DirectReadOptions &DirectReadOptions::setParallelism(size_t blocks)
+{
+    m_parallelism = blocks;
+    return *this;
+}
 
-namespace
+DownloadOptions::DownloadOptions()
+    : m_readOptions()
+    , m_directIoThreshold(0)
+    , m_sync(true)
 {
+}
 
-/* check libcurl function call result */
-inline void checkCurl(CURLcode code)
+DownloadOptions &DownloadOptions::setReadOptions(const DirectReadOptions &readOptions)
 {
-    if (code != CURLE_OK)
+    m_readOptions = readOptions;
+    return *this;
+}
+
+DownloadOptions &DownloadOptions::setDirectIoThreshold(size_t bytes)
+{
+    m_directIoThreshold = bytes;
+    return *this;
+}
+
+DownloadOptions &DownloadOptions::setSync(bool sync)
+{
+    m_sync = sync;
+    return *this;
+}
+
+RangeReadOptions::RangeReadOptions()
+    : m_readOptions()
+    , m_maxGap(128 << 10)
+    , m_maxMergedSize(8 << 20)
+{
+}
+
+RangeReadOptions &RangeReadOptions::setReadOptions(const DirectReadOptions &readOptions)
+{
+    m_readOptions = readOptions;
+    return *this;
+}
+
+RangeReadOptions &RangeReadOptions::setMaxGap(size_t bytes)
+{
+    m_maxGap = bytes;
+    return *this;
+}
+
+RangeReadOptions &RangeReadOptions::setMaxMergedSize(size_t bytes)
+{
+    m_maxMergedSize = bytes;
+    return *this;
+}
+
+UploadOptions::UploadOptions()
+    : m_writeOptions()
+    , m_parallelism(4)
+    , m_createAhead(4)
+{
+}
+
+UploadOptions &UploadOptions::setWriteOptions(const WriteOptions &writeOptions)
+{
+    m_writeOptions = writeOptions;
+    return *this;
+}
+
+UploadOptions &UploadOptions::setParallelism(size_t files)
+{
+    m_parallelism = files;
+    return *this;
+}
+
+UploadOptions &UploadOptions::setCreateAhead(size_t files)
+{
+    m_createAhead = files;
+    return *this;
+}
+
+Endpoint::Endpoint(const std::string &host, int port)
+    : host(host)
+    , port(port)
+{
+}
+
+RetryPolicy::RetryPolicy()
+    : m_maxAttempts(3)
+    , m_initialBackoff(100)
+    , m_maxBackoff(5000)
+    , m_jitter(0.5)
+    , m_budgetRatio(0.1)
+    , m_budgetMaxTokens(10)
+{
+}
+
+RetryPolicy &RetryPolicy::setMaxAttempts(int attempts)
+{
+    m_maxAttempts = attempts;
+    return *this;
+}
+
+RetryPolicy &RetryPolicy::setBackoff(int initialMilliseconds, int maxMilliseconds)
+{
+    m_initialBackoff = initialMilliseconds;
+    m_maxBackoff = maxMilliseconds;
+    return *this;
+}
+
+RetryPolicy &RetryPolicy::setJitter(double jitter)
+{
+    m_jitter = std::min(std::max(jitter, 0.0), 1.0);
+    return *this;
+}
+
+RetryPolicy &RetryPolicy::setBudget(double ratio, double maxTokens)
+{
+    m_budgetRatio = ratio;
+    m_budgetMaxTokens = maxTokens;
+    return *this;
+}
+
+MemoryBudget::MemoryBudget(size_t limitBytes)
+    : m_stats()
+    , m_overdraftTaken(false)
+{
+    m_stats.limit = limitBytes;
+}
+
+MemoryBudgetStats MemoryBudget::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+bool MemoryBudget::tryAcquire(size_t bytes, bool allowOverdraft, bool &overdraft)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats.used + bytes > m_stats.limit && !overdraft)
     {
-        const char *errInfo = curl_easy_strerror(code);
-        throw Exception(errInfo ? errInfo : "Unknown");
+        if (!allowOverdraft || m_overdraftTaken)
+        {
+            ++m_stats.pauses;
+            return false;
+        }
+        m_overdraftTaken = overdraft = true;
+        ++m_stats.overdrafts;
     }
+    m_stats.used += bytes;
+    m_stats.peak = std::max(m_stats.peak, m_stats.used);
+    return true;
 }
 
-/* make CURL handle and throw Exception if can't */
-std::shared_ptr<CURL> createCurlEaseHandle()
+void MemoryBudget::release(size_t bytes, bool overdraft)
 {
-    // BTW, this doesn't guard against calling libcurl init from other curl-based libs.
-    static std::once_flag curlInitFlag;
-
-    std::call_once(curlInitFlag, []
-                   {
-                       if (curl_global_init(CURL_GLOBAL_ALL) != 0)
-                       {
-                           throw Exception("libcurl init failed");
-                       }
-                   });
-    auto curlHandle = std::shared_ptr<CURL>(curl_easy_init(), curl_easy_cleanup);
-    if (curlHandle.get() == nullptr)
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stats.used -= bytes;
+    if (overdraft)
     {
-        throw Exception("libcurl easy object creation failed");
+        m_overdraftTaken = false;
     }
-    return curlHandle;
+    m_released.notify_all();
 }
 
-/* try parse string to json object, return true if string was parsed, otherwise return false */
-bool tryParseJson(const std::string &s, Json::Value &v)
+bool MemoryBudget::tryAcquire(size_t bytes)
 {
-    Json::Reader reader;
-    constexpr auto collectComments = false;
-    return reader.parse(s, v, collectComments);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats.used + bytes > m_stats.limit)
+    {
+        return false;
+    }
+    m_stats.used += bytes;
+    m_stats.peak = std::max(m_stats.peak, m_stats.used);
+    return true;
 }
 
-/* type to keep fields of server error reply */
-struct RemoteError
+void MemoryBudget::acquire(size_t bytes)
 {
-    std::string type;
-    std::string message;
-};
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto fits = [&]
+    {
+        return m_stats.used + bytes <= m_stats.limit || m_stats.used == 0;
+    };
+    if (!fits())
+    {
+        ++m_stats.waits;
+        m_released.wait(lock, fits);
+    }
+    if (m_stats.used + bytes > m_stats.limit)
+    {
+        ++m_stats.overdrafts;
+    }
+    m_stats.used += bytes;
+    m_stats.peak = std::max(m_stats.peak, m_stats.used);
+}
 
-/* try to parse server error reply */
-bool tryParseRemoteError(const std::string &s, RemoteError &remoteError)
+void MemoryBudget::forceAcquire(size_t bytes)
 {
-    Json::Value remoteErrorValue;
-    if (tryParseJson(s, remoteErrorValue) && remoteErrorValue.isMember("RemoteException"))
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stats.used + bytes > m_stats.limit)
     {
-        const auto exceptionValue = remoteErrorValue["RemoteException"];
-        remoteError.type = exceptionValue.get("exception", "Unknown").asString();
-        remoteError.message = exceptionValue.get("message", "").asString();
-        return true;
+        ++m_stats.overdrafts;
     }
-    return false;
+    m_stats.used += bytes;
+    m_stats.peak = std::max(m_stats.peak, m_stats.used);
 }
 
-} // namesapce
+void MemoryBudget::release(size_t bytes)
+{
+    release(bytes, false);
+}
 
-/* class to build WebHDFS operations URLs */
-class Client::UrlBuilder
+DnsCache::DnsCache(int ttlSeconds)
+    : m_ttlSeconds(ttlSeconds)
+    , m_mutex()
+    , m_entries()
+    , m_generation(1)
 {
-public:
-    UrlBuilder(const std::string host, int port, const std::string &userName)
-        : m_prefix(std::string("http://") + host + ":" + std::to_string(port) + "/webhdfs/v1")
-        , m_userName(userName)
+}
+
+void DnsCache::resolve(const std::string &host, int port)
+{
+    if (!resolve(host, port, false))
     {
+        throw Exception("can't resolve " + host);
     }
+}
 
-    std::string makeUrl(const std::string &remotePath, const std::string &operation)
+void DnsCache::refresh()
+{
+    std::vector<std::pair<std::string, int>> hosts;
     {
-        std::stringstream oss;
-        oss << m_prefix << urlEncode(remotePath);
-        if (m_userName.empty())
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto &item : m_entries)
         {
-            oss << "?op=";
-        }
-        else
-        {
-            oss << "?user.name=" << m_userName << "&op=";
+            hosts.push_back(item.first);
         }
-        oss << operation;
-        return oss.str();
     }
+    for (const auto &host : hosts)
+    {
+        resolve(host.first, host.second, true);
+    }
+}
 
-    std::string makeUrl(const std::string &remotePath, const std::string &operation,
-                        const details::OptionsBase &opts)
+bool DnsCache::resolve(const std::string &host, int port, bool force)
+{
+    const auto key = std::make_pair(host, port);
+    const auto now = std::chrono::steady_clock::now();
     {
-        return makeUrl(remotePath, operation) + opts.toQueryString();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_entries.find(key);
+        if (!force && it != m_entries.end() && it->second.expiration > now)
+        {
+            return true;
+        }
     }
 
-private:
-    static std::string urlEncode(const std::string &value)
+    // resolution is made without lock, concurrent resolutions of a host are harmless
+    std::vector<std::string> addresses;
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    if (::getaddrinfo(host.c_str(), nullptr, &hints, &result) == 0)
     {
-        std::ostringstream escaped;
-        escaped.fill('0');
-        escaped << std::hex;
-        for (const auto &c : value)
+        for (auto info = result; info != nullptr; info = info->ai_next)
         {
-            // Keep alphanumeric and other accepted characters intact
-            if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || c == '/')
+            char buffer[INET6_ADDRSTRLEN];
+            const void *address =
+                info->ai_family == AF_INET
+                    ? static_cast<const void *>(
+                          &reinterpret_cast<const sockaddr_in *>(info->ai_addr)->sin_addr)
+                    : static_cast<const void *>(
+                          &reinterpret_cast<const sockaddr_in6 *>(info->ai_addr)->sin6_addr);
+            if ((info->ai_family != AF_INET && info->ai_family != AF_INET6) ||
+                ::inet_ntop(info->ai_family, address, buffer, sizeof(buffer)) == nullptr)
             {
-                escaped << c;
+                continue;
             }
-            else
+            const std::string text = info->ai_family == AF_INET6
+                                         ? std::string("[") + buffer + "]"
+                                         : std::string(buffer);
+            if (std::find(addresses.begin(), addresses.end(), text) == addresses.end())
             {
-                escaped << '%' << std::setw(2) << static_cast<int>(static_cast<unsigned char>(c));
+                addresses.push_back(text);
             }
         }
-        return escaped.str();
+        ::freeaddrinfo(result);
     }
 
-private:
-    std::shared_ptr<CURL> m_curl; // curl for remote path escaping
-    const std::string m_prefix;
-    const std::string m_userName;
-};
-
-/* class to implement http i/o */
-class Client::HttpClient
-{
-    std::shared_ptr<CURL> m_curlHanlde;
-    CURL *m_curl;                                    // just a raw ptr handled by m_curlHandle
-    std::shared_ptr<curl_slist> m_activeHttpHeaders; // we must handle allocated headers
-
-public:
-    HttpClient()
-        : m_curlHanlde(createCurlEaseHandle())
-        , m_curl(m_curlHanlde.get())
-        , m_activeHttpHeaders()
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (addresses.empty())
     {
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_NOSIGNAL, 1));
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_USERAGENT, "libcurl-agent/1.0"));
+        // old addresses are used till the next expiration
+        if (it == m_entries.end())
+        {
+            return false;
+        }
+        it->second.expiration = now + std::chrono::seconds(m_ttlSeconds);
+        return false;
     }
-
-    void setConnectTimeout(int seconds)
+    std::string joined;
+    for (const auto &address : addresses)
     {
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT, seconds));
+        joined += (joined.empty() ? "" : ",") + address;
     }
-
-    void setDataTranfserTimeout(int seconds)
+    auto &entry = m_entries[key];
+    if (entry.addresses != joined)
     {
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, seconds));
+        entry.addresses = joined;
+        ++m_generation;
     }
+    entry.expiration = now + std::chrono::seconds(m_ttlSeconds);
+    return true;
+}
 
-    struct Reply
+bool DnsCache::pinnedAddresses(unsigned long &generation,
+                               std::vector<std::string> &pinned) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (generation == m_generation)
     {
-        static const long RESPONSE_CODE_CLIENT_ERROR = -1L; // special code to indicate client error
-        long responseCode = 0L;
-        std::string unexpectedResponseContent; // for error or other unexpected reply
-        std::string clientError;               // to put an error occured in callback
-        std::string redirectUrl;
-    };
-
-    struct Request
+        return false;
+    }
+    pinned.clear();
+    for (const auto &item : m_entries)
     {
-        enum class Type
-        {
-            GET,
-            PUT,
-            POST,
-            DELETE
-        };
-        Type type = Type::GET;
-        std::string url;
-        bool followRedirect = false;
-        std::ostream *pDataSink = nullptr;
-        std::istream *pDataSource = nullptr;
-        long expectedResponseCode = 0L;
-    };
+        pinned.push_back(item.first.first + ":" + std::to_string(item.first.second) + ":" +
+                         item.second.addresses);
+    }
+    generation = m_generation;
+    return true;
+}
 
+ConcurrencyOptions::ConcurrencyOptions()
+    : m_initialLimit(4)
+    , m_minLimit(1)
+    , m_maxLimit(64)
+    , m_decreaseFactor(0.5)
+    , m_latencyTolerance(2.0)
+{
+}
+
+ConcurrencyOptions &ConcurrencyOptions::setInitialLimit(size_t requests)
+{
+    m_initialLimit = requests;
+    return *this;
+}
+
+ConcurrencyOptions &ConcurrencyOptions::setLimits(size_t minRequests, size_t maxRequests)
+{
+    m_minLimit = std::max<size_t>(minRequests, 1);
+    m_maxLimit = std::max(maxRequests, m_minLimit);
+    return *this;
+}
+
+ConcurrencyOptions &ConcurrencyOptions::setDecreaseFactor(double factor)
+{
+    m_decreaseFactor = std::min(std::max(factor, 0.0), 1.0);
+    return *this;
+}
+
+ConcurrencyOptions &ConcurrencyOptions::setLatencyTolerance(double ratio)
+{
+    m_latencyTolerance = ratio;
+    return *this;
+}
+
+ConcurrencyController::ConcurrencyController(const ConcurrencyOptions &opts)
+    : m_options(opts)
+{
+}
+
+std::map<std::string, ConcurrencyStats> ConcurrencyController::stats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::map<std::string, ConcurrencyStats> stats;
+    for (const auto &item : m_endpoints)
+    {
+        stats[item.first] = item.second.stats;
+    }
+    return stats;
+}
+
+ConcurrencyController::EndpointState &ConcurrencyController::endpoint(const std::string &name)
+{
+    auto it = m_endpoints.find(name);
+    if (it == m_endpoints.end())
+    {
+        it = m_endpoints.insert(std::make_pair(name, EndpointState())).first;
+        it->second.stats.limit = std::min(std::max(m_options.m_initialLimit, m_options.m_minLimit),
+                                          m_options.m_maxLimit);
+        it->second.start = Clock::now();
+    }
+    return it->second;
+}
+
+bool ConcurrencyController::tryAcquire(const std::string &name, bool force)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &state = endpoint(name);
+    if (state.stats.inFlight >= state.stats.limit)
+    {
+        state.limited = true;
+        if (!force)
+        {
+            return false;
+        }
+    }
+    ++state.stats.inFlight;
+    state.stats.peakInFlight = std::max(state.stats.peakInFlight, state.stats.inFlight);
+    return true;
+}
+
+void ConcurrencyController::acquire(const std::string &name)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto &state = endpoint(name);
+    if (state.stats.inFlight >= state.stats.limit)
+    {
+        state.limited = true;
+        m_released.wait(lock, [&state] { return state.stats.inFlight < state.stats.limit; });
+    }
+    ++state.stats.inFlight;
+    state.stats.peakInFlight = std::max(state.stats.peakInFlight, state.stats.inFlight);
+}
+
+void ConcurrencyController::release(const std::string &name, double latency, size_t bytes,
+                                    bool overloaded)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &state = endpoint(name);
+    --state.stats.inFlight;
+    ++state.stats.requests;
+    ++state.completed;
+    if (overloaded)
+    {
+        ++state.stats.overloadErrors;
+        // errors of requests started before the decrease report the same overload
+        if (!state.decreased)
+        {
+            decrease(state);
+        }
+    }
+    else
+    {
+        ++state.succeeded;
+        state.latencySum += latency;
+        state.bytes += bytes;
+    }
+
+    if (state.completed >= state.stats.limit)
+    {
+        auto &stats = state.stats;
+        const auto now = Clock::now();
+        const auto seconds =
+            std::max(std::chrono::duration<double>(now - state.start).count(), 1e-6);
+        if (state.succeeded > 0)
+        {
+            const auto requestRate = state.succeeded / seconds;
+            const auto throughput = state.bytes / seconds;
+            const auto grown = requestRate > stats.requestRate * 1.05 ||
+                               throughput > stats.throughput * 1.05;
+            stats.latency = state.latencySum / state.succeeded;
+            stats.requestRate = requestRate;
+            stats.throughput = throughput;
+            // base latency slowly follows latency growth not caused by this client
+            stats.baseLatency = stats.baseLatency > 0
+                                    ? std::min(stats.latency, stats.baseLatency * 1.01)
+                                    : stats.latency;
+            // latency and throughput depend on the limit only if it was reached
+            if (state.limited && !state.decreased)
+            {
+                if (stats.latency > stats.baseLatency * m_options.m_latencyTolerance && !grown)
+                {
+                    decrease(state);
+                }
+                else if (stats.limit < m_options.m_maxLimit)
+                {
+                    ++stats.limit;
+                    ++stats.increases;
+                }
+            }
+        }
+        state.limited = state.decreased = false;
+        state.completed = state.succeeded = state.bytes = 0;
+        state.latencySum = 0;
+        state.start = now;
+    }
+    m_released.notify_all();
+}
+
+void ConcurrencyController::cancel(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    --endpoint(name).stats.inFlight;
+    m_released.notify_all();
+}
+
+void ConcurrencyController::decrease(EndpointState &state)
+{
+    state.decreased = true;
+    if (state.stats.limit > m_options.m_minLimit)
+    {
+        state.stats.limit = std::max(
+            static_cast<size_t>(state.stats.limit * m_options.m_decreaseFactor),
+            m_options.m_minLimit);
+        ++state.stats.decreases;
+    }
+}
+
+BufferTunerOptions::BufferTunerOptions()
+    : m_minSocketBuffer(64 << 10)
+    , m_maxSocketBuffer(32 << 20)
+    , m_minTransferBuffer(16 << 10)
+    , m_maxTransferBuffer(512 << 10)
+    , m_minSampleSize(256 << 10)
+{
+}
+
+BufferTunerOptions &BufferTunerOptions::setSocketBufferLimits(size_t minBytes, size_t maxBytes)
+{
+    m_minSocketBuffer = minBytes;
+    m_maxSocketBuffer = std::max(maxBytes, minBytes);
+    return *this;
+}
+
+BufferTunerOptions &BufferTunerOptions::setTransferBufferLimits(size_t minBytes, size_t maxBytes)
+{
+    // libcurl limits
+    m_minTransferBuffer = std::max<size_t>(minBytes, 16 << 10);
+    m_maxTransferBuffer = std::min<size_t>(std::max(maxBytes, m_minTransferBuffer), 2 << 20);
+    return *this;
+}
+
+BufferTunerOptions &BufferTunerOptions::setMinSampleSize(size_t bytes)
+{
+    m_minSampleSize = bytes;
+    return *this;
+}
+
+BufferTuner::BufferTuner(const BufferTunerOptions &opts)
+    : m_options(opts)
+{
+}
+
+std::map<std::string, BufferTuning> BufferTuner::tuning() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_hosts;
+}
+
+void BufferTuner::setTuning(const std::string &host, const BufferTuning &tuning)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_hosts[host] = tuning;
+}
+
+bool BufferTuner::find(const std::string &host, BufferTuning &tuning) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const auto it = m_hosts.find(host);
+    if (it == m_hosts.end() || it->second.socketBuffer == 0)
+    {
+        return false;
+    }
+    tuning = it->second;
+    return true;
+}
+
+void BufferTuner::addSample(const std::string &host, double rtt, size_t bytes, double seconds)
+{
+    const auto measured = bytes >= m_options.m_minSampleSize && seconds > 0;
+    if (rtt <= 0 && !measured)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto &tuning = m_hosts[host];
+    // moving averages
+    const auto average = [](double value, double sample)
+    {
+        return value > 0 ? value * 0.75 + sample * 0.25 : sample;
+    };
+    if (rtt > 0)
+    {
+        tuning.rtt = average(tuning.rtt, rtt * 1e3);
+    }
+    if (measured)
+    {
+        tuning.throughput = average(tuning.throughput, bytes / seconds);
+        ++tuning.samples;
+    }
+    if (tuning.rtt <= 0 || tuning.throughput <= 0)
+    {
+        return;
+    }
+    const auto bdp = tuning.throughput * tuning.rtt / 1e3;
+    size_t socketBuffer = m_options.m_minSocketBuffer;
+    while (socketBuffer < 2 * bdp && socketBuffer < m_options.m_maxSocketBuffer)
+    {
+        socketBuffer *= 2;
+    }
+    socketBuffer = std::min(socketBuffer, m_options.m_maxSocketBuffer);
+    // buffers are shrunk only on much lower demand, so they don't flap with throughput
+    if (socketBuffer > tuning.socketBuffer || socketBuffer * 4 <= tuning.socketBuffer)
+    {
+        tuning.socketBuffer = socketBuffer;
+        tuning.transferBuffer = std::min(std::max(socketBuffer, m_options.m_minTransferBuffer),
+                                         m_options.m_maxTransferBuffer);
+    }
+}
+
+ClientOptions::ClientOptions()
+    : m_connectionTimeout(0)
+    , m_dataTransferTimeout(0)
+    , m_retryPolicy()
+    , m_http2(false)
+    , m_maxStreams(100)
+{
+}
+
+ClientOptions &ClientOptions::setConnectTimeout(int seconds)
+{
+    m_connectionTimeout = seconds;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setDataTransferTimeout(int seconds)
+{
+    m_dataTransferTimeout = seconds;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setUserName(const std::string &username)
+{
+    m_userName = username;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setRetryPolicy(const RetryPolicy &retryPolicy)
+{
+    m_retryPolicy = retryPolicy;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setTraceRecorder(const std::shared_ptr<TraceRecorder> &traceRecorder)
+{
+    m_traceRecorder = traceRecorder;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setMemoryBudget(const std::shared_ptr<MemoryBudget> &memoryBudget)
+{
+    m_memoryBudget = memoryBudget;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setDnsCache(const std::shared_ptr<DnsCache> &dnsCache)
+{
+    m_dnsCache = dnsCache;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setTransport(const std::shared_ptr<Transport> &transport)
+{
+    m_transport = transport;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setConcurrencyController(
+    const std::shared_ptr<ConcurrencyController> &concurrencyController)
+{
+    m_concurrencyController = concurrencyController;
+    return *this;
+}
+
+ClientOptions &ClientOptions::setHttp2(bool http2, size_t maxStreams)
+{
+    if (http2)
+    {
+        const auto version = curl_version_info(CURLVERSION_NOW);
+        if (!(version->features & CURL_VERSION_HTTP2))
+        {
+            throw Exception("libcurl " + std::string(version->version) +
+                            " is built without HTTP/2 support");
+        }
+        // libcurl 7.x fails requests reusing h2c connection ("Error in the HTTP2 framing
+        // layer"), it's fixed by HTTP/2 rework of 8.0
+        if (version->version_num < 0x080000)
+        {
+            throw Exception("HTTP/2 requires libcurl 8.0.0 or newer, found " +
+                            std::string(version->version));
+        }
+    }
+    m_http2 = http2;
+    m_maxStreams = std::max<size_t>(maxStreams, 1);
+    return *this;
+}
+
+ClientOptions &ClientOptions::setBufferTuner(const std::shared_ptr<BufferTuner> &bufferTuner)
+{
+    m_bufferTuner = bufferTuner;
+    return *this;
+}
+
+
+namespace
+{
+
+/* max number of datanodes connected by warm-up, idle connections cache is limited anyway */
+const size_t WARM_UP_MAX_DATANODES = 16;
+
+/* check libcurl function call result */
+inline void checkCurl(CURLcode code)
+{
+    if (code != CURLE_OK)
+    {
+        const char *errInfo = curl_easy_strerror(code);
+        throw Exception(errInfo ? errInfo : "Unknown");
+    }
+}
+
+/* span of client operation, nothing is recorded if tracing is disabled */
+class TraceSpan
+{
+public:
+    TraceSpan(TraceRecorder *recorder, const char *name, const std::string &detail)
+        : m_recorder(recorder)
+        , m_name(name)
+        , m_detail(recorder ? detail : std::string()) // copied only when tracing
+        , m_start(recorder ? TraceRecorder::now() : 0)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (m_recorder)
+        {
+            m_recorder->addSpan(m_name, "operation", m_start, TraceRecorder::now() - m_start,
+                                m_detail);
+        }
+    }
+
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+
+private:
+    TraceRecorder *m_recorder;
+    const char *m_name;
+    const std::string m_detail;
+    long long m_start;
+};
+
+/* transfer error of followed redirect target (e.g. datanode), it doesn't tell anything
+ * about namenode */
+class RedirectTargetException : public TransportException
+{
+public:
+    RedirectTargetException(int curlCode, const std::string &error)
+        : TransportException(curlCode, error)
+    {
+    }
+};
+
+/* check libcurl transfer result, redirected tells that error is of followed redirect target */
+inline void checkCurlTransfer(CURLcode code, bool redirected = false)
+{
+    if (code != CURLE_OK)
+    {
+        const std::string errInfo = curl_easy_strerror(code) ? curl_easy_strerror(code)
+                                                             : "Unknown";
+        if (redirected)
+        {
+            throw RedirectTargetException(code, errInfo);
+        }
+        throw TransportException(code, errInfo);
+    }
+}
+
+/* check if namenode (not redirect target) can't be connected */
+bool isConnectError(const Exception &error)
+{
+    if (dynamic_cast<const RedirectTargetException *>(&error))
+    {
+        return false;
+    }
+    const auto transportError = dynamic_cast<const TransportException *>(&error);
+    return transportError && (transportError->curlCode() == CURLE_COULDNT_CONNECT ||
+                              transportError->curlCode() == CURLE_COULDNT_RESOLVE_HOST);
+}
+
+/* check if error means that current namenode can't serve requests and another one should be
+ * tried */
+bool isFailoverError(const Exception &error)
+{
+    const auto remoteError = dynamic_cast<const RemoteException *>(&error);
+    return (remoteError && remoteError->type() == "StandbyException") || isConnectError(error);
+}
+
+/* same for error of concurrent request */
+bool isFailoverError(const std::exception_ptr &error)
+{
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (const Exception &e)
+    {
+        return isFailoverError(e);
+    }
+    catch (...)
+    {
+    }
+    return false;
+}
+
+/* check if error of concurrent request means that path doesn't exist */
+bool isNotFoundError(const std::exception_ptr &error)
+{
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (const RemoteException &e)
+    {
+        return e.type() == "FileNotFoundException";
+    }
+    catch (...)
+    {
+    }
+    return false;
+}
+
+/* check if request failed because the server is overloaded (see ConcurrencyController) */
+bool isOverloadError(const std::exception_ptr &error)
+{
+    try
+    {
+        std::rethrow_exception(error);
+    }
+    catch (const RemoteException &e)
+    {
+        return e.type() == "RetriableException" || e.httpCode() == 429L ||
+               (e.type().empty() && e.httpCode() == 503L);
+    }
+    catch (const TransportException &e)
+    {
+        return e.curlCode() == CURLE_OPERATION_TIMEDOUT;
+    }
+    catch (...)
+    {
+    }
+    return false;
+}
+
+/* check if request failed with the error can be retried */
+bool isRetriableError(const Exception &error, bool retryConnectErrors)
+{
+    if (const auto remoteError = dynamic_cast<const RemoteException *>(&error))
+    {
+        const auto httpCode = remoteError->httpCode();
+        return remoteError->type() == "RetriableException" ||
+               (remoteError->type().empty() &&
+                (httpCode == 502L || httpCode == 503L || httpCode == 504L));
+    }
+    if (const auto transportError = dynamic_cast<const TransportException *>(&error))
+    {
+        switch (transportError->curlCode())
+        {
+        case CURLE_COULDNT_CONNECT:
+        case CURLE_COULDNT_RESOLVE_HOST:
+            return retryConnectErrors;
+        case CURLE_OPERATION_TIMEDOUT:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+            return true;
+        default:
+            return false;
+        }
+    }
+    return false;
+}
+
+void initCurl()
+{
+    // BTW, this doesn't guard against calling libcurl init from other curl-based libs.
+    static std::once_flag curlInitFlag;
+
+    std::call_once(curlInitFlag, []
+                   {
+                       if (curl_global_init(CURL_GLOBAL_ALL) != 0)
+                       {
+                           throw Exception("libcurl init failed");
+                       }
+                   });
+}
+
+/* make CURL handle and throw Exception if can't */
+std::shared_ptr<CURL> createCurlEaseHandle()
+{
+    initCurl();
+    auto curlHandle = std::shared_ptr<CURL>(curl_easy_init(), curl_easy_cleanup);
+    if (curlHandle.get() == nullptr)
+    {
+        throw Exception("libcurl easy object creation failed");
+    }
+    return curlHandle;
+}
+
+/* create share of DNS cache and (optionally) connections cache */
+std::shared_ptr<CURLSH> createCurlShare(bool shareConnections = true)
+{
+    initCurl();
+    auto share = std::shared_ptr<CURLSH>(curl_share_init(), curl_share_cleanup);
+    if (share.get() == nullptr ||
+        (shareConnections &&
+         curl_share_setopt(share.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT) != CURLSHE_OK) ||
+        curl_share_setopt(share.get(), CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS) != CURLSHE_OK)
+    {
+        throw Exception("libcurl share object creation failed");
+    }
+    return share;
+}
+
+/* try parse string to json object, return true if string was parsed, otherwise return false */
+bool tryParseJson(const std::string &s, Json::Value &v)
+{
+    Json::Reader reader;
+    constexpr auto collectComments = false;
+    return reader.parse(s, v, collectComments);
+}
+
+/* type to keep fields of server error reply */
+struct RemoteError
+{
+    std::string type;
+    std::string message;
+};
+
+/* try to parse server error reply */
+bool tryParseRemoteError(const std::string &s, RemoteError &remoteError)
+{
+    Json::Value remoteErrorValue;
+    if (tryParseJson(s, remoteErrorValue) && remoteErrorValue.isMember("RemoteException"))
+    {
+        const auto exceptionValue = remoteErrorValue["RemoteException"];
+        remoteError.type = exceptionValue.get("exception", "Unknown").asString();
+        remoteError.message = exceptionValue.get("message", "").asString();
+        return true;
+    }
+    return false;
+}
+
+FileStatus parseFileStatus(const Json::Value &statusValue)
+{
+    FileStatus status;
+    status.accessTime = statusValue["accessTime"].asInt64();
+    status.blockSize = statusValue["blockSize"].asUInt64();
+    status.group = statusValue["group"].asString();
+    status.length = statusValue["length"].asUInt64();
+    status.modificationTime = statusValue["modificationTime"].asInt64();
+    status.owner = statusValue["owner"].asString();
+    status.pathSuffix = statusValue["pathSuffix"].asString();
+    status.permission = statusValue["permission"].asString();
+    status.replication = statusValue["replication"].asInt();
+    auto typeStr = statusValue["type"].asString();
+    status.type = typeStr.compare("FILE") == 0 ? FileStatus::PathObjectType::FILE
+                                               : FileStatus::PathObjectType::DIRECTORY;
+    return status;
+}
+
+/* Incremental parser of LISTSTATUS reply. Entries of FileStatus array are parsed and passed
+ * to handler as soon as they are received, so the whole listing is never kept in memory. */
+class FileStatusListParser
+{
+public:
+    explicit FileStatusListParser(const std::function<bool(const FileStatus &)> &handler)
+        : m_handler(handler)
+    {
+    }
+
+    void reset()
+    {
+        m_depth = 0;
+        m_inString = false;
+        m_escape = false;
+        m_started = false;
+        m_stopped = false;
+        m_error = nullptr;
+        m_entry.clear();
+    }
+
+    /* returns false if handler stopped listing or failed (it's called from libcurl callback,
+     * so errors are kept to be rethrown by finish) */
+    bool feed(const char *data, size_t size)
+    {
+        try
+        {
+            return parse(data, size);
+        }
+        catch (...)
+        {
+            m_error = std::current_exception();
+            return false;
+        }
+    }
+
+    /* check that the whole listing was received (or handler stopped it) */
+    void finish() const
+    {
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+        if (m_stopped)
+        {
+            return;
+        }
+        if (!m_started || m_depth != 0 || m_inString)
+        {
+            throw Exception("Can't parse dir listing");
+        }
+    }
+
+    /* handler stopped listing or failed, transfer was aborted */
+    bool aborted() const { return m_stopped || m_error; }
+
+private:
+    static const int ENTRY_DEPTH = 4;
+
+    bool parse(const char *data, size_t size)
+    {
+        // reply is {"FileStatuses":{"FileStatus":[{...},...]}}, entries are objects at depth 4
+        for (size_t i = 0; i < size; ++i)
+        {
+            const char c = data[i];
+            if (m_depth >= ENTRY_DEPTH)
+            {
+                m_entry.push_back(c);
+            }
+            if (m_inString)
+            {
+                if (m_escape)
+                {
+                    m_escape = false;
+                }
+                else if (c == '\\')
+                {
+                    m_escape = true;
+                }
+                else if (c == '"')
+                {
+                    m_inString = false;
+                }
+                continue;
+            }
+            switch (c)
+            {
+            case '"':
+                m_inString = true;
+                break;
+            case '{':
+            case '[':
+                m_started = true;
+                if (++m_depth == ENTRY_DEPTH)
+                {
+                    m_entry.assign(1, c);
+                }
+                break;
+            case '}':
+            case ']':
+                if (m_depth-- == ENTRY_DEPTH && !handleEntry())
+                {
+                    m_stopped = true;
+                    return false;
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        return true;
+    }
+
+    bool handleEntry()
+    {
+        Json::Value entryValue;
+        if (!tryParseJson(m_entry, entryValue) || !entryValue.isObject())
+        {
+            throw Exception("Can't parse dir listing");
+        }
+        return m_handler(parseFileStatus(entryValue));
+    }
+
+    std::function<bool(const FileStatus &)> m_handler;
+    int m_depth = 0;
+    bool m_inString = false;
+    bool m_escape = false;
+    bool m_started = false;
+    bool m_stopped = false;
+    std::exception_ptr m_error;
+    std::string m_entry;
+};
+
+/* parse array of strings */
+std::vector<std::string> parseStrings(const Json::Value &value)
+{
+    std::vector<std::string> strings;
+    for (auto it = value.begin(); it != value.end(); ++it)
+    {
+        strings.push_back(it->asString());
+    }
+    return strings;
+}
+
+/* Make url to read file range from a datanode. Url is built from datanode url template
+ * (the one namenode redirects OPEN operation to) by replacing host, offset and length. */
+std::string makeDataNodeReadUrl(const std::string &templateUrl, const std::string &host,
+                                size_t offset, size_t length)
+{
+    const auto authorityPos = templateUrl.find("://");
+    const auto pathPos = templateUrl.find('/', authorityPos + 3);
+    const auto queryPos = templateUrl.find('?', pathPos);
+    if (authorityPos == std::string::npos || pathPos == std::string::npos ||
+        queryPos == std::string::npos)
+    {
+        throw Exception("protocol error: bad data node url " + templateUrl);
+    }
+    const auto authority = templateUrl.substr(authorityPos + 3, pathPos - authorityPos - 3);
+    const auto portPos = authority.rfind(':');
+
+    std::string url = templateUrl.substr(0, authorityPos + 3) + host;
+    if (portPos != std::string::npos)
+    {
+        url += authority.substr(portPos);
+    }
+    url += templateUrl.substr(pathPos, queryPos - pathPos + 1);
+
+    std::istringstream query(templateUrl.substr(queryPos + 1));
+    std::string param;
+    while (std::getline(query, param, '&'))
+    {
+        if (param.compare(0, 7, "offset=") != 0 && param.compare(0, 7, "length=") != 0)
+        {
+            url += param + "&";
+        }
+    }
+    url += "offset=" + std::to_string(offset) + "&length=" + std::to_string(length);
+    return url;
+}
+
+/* get rack of replica from its topology path (/rack/ip:port) */
+std::string getRack(const std::string &topologyPath)
+{
+    const auto pos = topologyPath.rfind('/');
+    return pos == std::string::npos ? std::string() : topologyPath.substr(0, pos);
+}
+
+/* mode of created local files (0666 masked by process umask), umask is read once as reading
+ * it means setting it */
+mode_t createdFileMode()
+{
+    static const mode_t mode = []
+    {
+        const auto mask = ::umask(0);
+        ::umask(mask);
+        return static_cast<mode_t>(0666 & ~mask);
+    }();
+    return mode;
+}
+
+/* Local file written at arbitrary offsets. Data goes to a temporary file which is moved
+ * to the target path on commit (and removed if not committed). With direct i/o, data
+ * ranges must start at DIRECT_IO_ALIGNMENT aligned offsets, they're staged to aligned
+ * buffers and written with O_DIRECT. */
+class LocalFileWriter
+{
+public:
+    static const size_t DIRECT_IO_ALIGNMENT = 4096;
+    static const size_t DIRECT_IO_BUFFER_SIZE = 4 << 20;
+
+    LocalFileWriter(const std::string &path, size_t length, bool directIo)
+        : m_path(path)
+        , m_tmpPath(makeTmpPathTemplate(path))
+        , m_length(length)
+        , m_fd(-1)
+        , m_directFd(-1)
+        , m_committed(false)
+    {
+        // unique temporary file, so concurrent downloads to the same path don't clash
+        std::vector<char> tmpPath(m_tmpPath.begin(), m_tmpPath.end());
+        tmpPath.push_back('\0');
+        m_fd = ::mkstemp(tmpPath.data());
+        if (m_fd < 0)
+        {
+            throw Exception("can't create " + m_tmpPath + ": " + std::strerror(errno));
+        }
+        m_tmpPath = tmpPath.data();
+        if (::fcntl(m_fd, F_SETFD, FD_CLOEXEC) != 0 || ::fchmod(m_fd, createdFileMode()) != 0)
+        {
+            const std::string error = std::strerror(errno);
+            close();
+            ::unlink(m_tmpPath.c_str());
+            throw Exception("can't open " + m_tmpPath + ": " + error);
+        }
+#ifdef __linux__
+        if (length > 0 && ::fallocate(m_fd, 0, 0, length) != 0 && errno != EOPNOTSUPP)
+        {
+            const std::string error = std::strerror(errno);
+            close();
+            ::unlink(m_tmpPath.c_str());
+            throw Exception("can't allocate " + m_tmpPath + ": " + error);
+        }
+#endif
+#ifdef O_DIRECT
+        if (directIo)
+        {
+            // fallback to usual writes if file system doesn't support direct i/o
+            m_directFd = ::open(m_tmpPath.c_str(), O_WRONLY | O_DIRECT | O_CLOEXEC);
+        }
+#else
+        (void)directIo;
+#endif
+    }
+
+    ~LocalFileWriter()
+    {
+        close();
+        if (!m_committed)
+        {
+            ::unlink(m_tmpPath.c_str());
+        }
+    }
+
+    LocalFileWriter(const LocalFileWriter &) = delete;
+    LocalFileWriter &operator=(const LocalFileWriter &) = delete;
+
+    /* write data at offset, return false on error (see error()) */
+    bool write(size_t offset, const char *data, size_t size)
+    {
+        if (m_directFd < 0)
+        {
+            return writeAll(m_fd, offset, data, size);
+        }
+        // find buffer of the range this data continues or start new range buffer
+        auto it = m_staging.find(offset);
+        if (it == m_staging.end())
+        {
+            if (offset % DIRECT_IO_ALIGNMENT != 0)
+            {
+                return writeAll(m_fd, offset, data, size);
+            }
+            void *buffer = nullptr;
+            if (posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, DIRECT_IO_BUFFER_SIZE) != 0)
+            {
+                m_error = "can't allocate direct i/o buffer";
+                return false;
+            }
+            it = m_staging.insert(std::make_pair(offset, Staging(offset, buffer))).first;
+        }
+        auto staging = std::move(it->second);
+        m_staging.erase(it);
+        while (size > 0)
+        {
+            const auto chunk = std::min(size, DIRECT_IO_BUFFER_SIZE - staging.filled);
+            std::memcpy(staging.buffer.get() + staging.filled, data, chunk);
+            staging.filled += chunk;
+            data += chunk;
+            size -= chunk;
+            if (staging.filled == DIRECT_IO_BUFFER_SIZE)
+            {
+                if (!writeAll(m_directFd, staging.start, staging.buffer.get(), staging.filled))
+                {
+                    return false;
+                }
+                staging.start += staging.filled;
+                staging.filled = 0;
+            }
+        }
+        const auto next = staging.start + staging.filled;
+        m_staging.insert(std::make_pair(next, std::move(staging)));
+        return true;
+    }
+
+    const std::string &error() const
+    {
+        return m_error;
+    }
+
+    /* flush data and move file to target path */
+    void commit(bool sync)
+    {
+        for (auto &item : m_staging)
+        {
+            auto &staging = item.second;
+            if (staging.filled == 0)
+            {
+                continue;
+            }
+            // file tail: write padded block, then truncate file to its size
+            const auto padded = (staging.filled + DIRECT_IO_ALIGNMENT - 1) /
+                                DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+            std::memset(staging.buffer.get() + staging.filled, 0, padded - staging.filled);
+            if (!writeAll(m_directFd, staging.start, staging.buffer.get(), padded))
+            {
+                throw Exception(m_error);
+            }
+        }
+        m_staging.clear();
+        if (m_length > 0 && ::ftruncate(m_fd, m_length) != 0)
+        {
+            throw Exception("can't truncate " + m_tmpPath + ": " + std::strerror(errno));
+        }
+        if (sync && ::fsync(m_fd) != 0)
+        {
+            throw Exception("can't sync " + m_tmpPath + ": " + std::strerror(errno));
+        }
+        close();
+        if (std::rename(m_tmpPath.c_str(), m_path.c_str()) != 0)
+        {
+            throw Exception("can't rename " + m_tmpPath + ": " + std::strerror(errno));
+        }
+        m_committed = true;
+        if (sync)
+        {
+            // make rename durable
+            const auto sepPos = m_path.rfind('/');
+            const auto dir = sepPos == std::string::npos ? std::string(".")
+                                                         : m_path.substr(0, sepPos + 1);
+            const auto dirFd = ::open(dir.c_str(), O_RDONLY | O_CLOEXEC);
+            if (dirFd >= 0)
+            {
+                ::fsync(dirFd);
+                ::close(dirFd);
+            }
+        }
+    }
+
+private:
+    /* mkstemp template of hidden temporary file next to the target (<dir>/.<name>.XXXXXX) */
+    static std::string makeTmpPathTemplate(const std::string &path)
+    {
+        const auto namePos = path.rfind('/') == std::string::npos ? 0 : path.rfind('/') + 1;
+        return path.substr(0, namePos) + "." + path.substr(namePos) + ".XXXXXX";
+    }
+
+    struct Staging
+    {
+        Staging(size_t start, void *buffer)
+            : start(start)
+            , filled(0)
+            , buffer(static_cast<char *>(buffer), std::free)
+        {
+        }
+        size_t start;
+        size_t filled;
+        std::unique_ptr<char, void (*)(void *)> buffer;
+    };
+
+    bool writeAll(int fd, size_t offset, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            const auto written = ::pwrite(fd, data, size, offset);
+            if (written < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                m_error = "can't write " + m_tmpPath + ": " + std::strerror(errno);
+                return false;
+            }
+            data += written;
+            offset += written;
+            size -= written;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (m_directFd >= 0)
+        {
+            ::close(m_directFd);
+            m_directFd = -1;
+        }
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    const std::string m_path;
+    std::string m_tmpPath;
+    const size_t m_length;
+    int m_fd;
+    int m_directFd;
+    bool m_committed;
+    std::map<size_t, Staging> m_staging; // direct i/o buffers by offset of next data
+    std::string m_error;
+};
+
+std::string makeUrlPrefix(const Endpoint &endpoint)
+{
+    return std::string("http://") + endpoint.host + ":" + std::to_string(endpoint.port) +
+           "/webhdfs/v1";
+}
+
+/* get host and port of http url, IPv6 literals are not supported */
+bool parseUrlHost(const std::string &url, std::string &host, int &port)
+{
+    const auto authorityPos = url.find("://");
+    if (authorityPos == std::string::npos)
+    {
+        return false;
+    }
+    const auto hostPos = authorityPos + 3;
+    const auto authority = url.substr(hostPos, url.find_first_of("/?", hostPos) - hostPos);
+    if (authority.empty() || authority[0] == '[')
+    {
+        return false;
+    }
+    const auto portPos = authority.rfind(':');
+    host = authority.substr(0, portPos);
+    port = portPos == std::string::npos ? 80 : std::atoi(authority.c_str() + portPos + 1);
+    return !host.empty() && port > 0;
+}
+
+/* add server buffer size hint to OPEN, CREATE and APPEND urls which don't have it */
+std::string addBufferSizeHint(const std::string &url, size_t bufferSize)
+{
+    const auto queryPos = url.find('?');
+    if (queryPos == std::string::npos || url.find("buffersize=", queryPos) != std::string::npos)
+    {
+        return url;
+    }
+    for (const std::string op : {"op=OPEN", "op=CREATE", "op=APPEND"})
+    {
+        const auto pos = url.find(op, queryPos);
+        const auto end = pos + op.size();
+        if (pos != std::string::npos && (url[pos - 1] == '?' || url[pos - 1] == '&') &&
+            (end == url.size() || url[end] == '&'))
+        {
+            return url + "&buffersize=" + std::to_string(bufferSize);
+        }
+    }
+    return url;
+}
+
+/* get "host:port" of http url (concurrency control endpoint) */
+std::string urlEndpoint(const std::string &url)
+{
+    std::string host;
+    int port = 0;
+    return parseUrlHost(url, host, port) ? host + ":" + std::to_string(port) : url;
+}
+
+/* process-wide storage of active namenodes of HA clusters */
+class ActiveNameNodeCache
+{
+public:
+    static size_t get(const std::vector<Endpoint> &nameNodes)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        const auto it = storage().find(makeKey(nameNodes));
+        return it == storage().end() ? 0 : it->second;
+    }
+
+    static void set(const std::vector<Endpoint> &nameNodes, size_t active)
+    {
+        std::lock_guard<std::mutex> lock(mutex());
+        storage()[makeKey(nameNodes)] = active;
+    }
+
+private:
+    static std::string makeKey(const std::vector<Endpoint> &nameNodes)
+    {
+        std::string key;
+        for (const auto &endpoint : nameNodes)
+        {
+            key.append(endpoint.host).append(":").append(std::to_string(endpoint.port)).append(",");
+        }
+        return key;
+    }
+
+    static std::mutex &mutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    static std::map<std::string, size_t> &storage()
+    {
+        static std::map<std::string, size_t> s;
+        return s;
+    }
+};
+
+/* Probe all namenodes concurrently, return index of the first one which replied to
+ * GETFILESTATUS with success (standby namenodes reply with StandbyException).
+ * Return nameNodes.size() if there is no active namenode. */
+size_t probeActiveNameNode(const std::vector<Endpoint> &nameNodes, const std::string &userName,
+                           int timeoutSeconds, bool http2)
+{
+    std::shared_ptr<CURLM> multi(curl_multi_init(), curl_multi_cleanup);
+    if (multi.get() == nullptr)
+    {
+        throw Exception("libcurl multi object creation failed");
+    }
+
+    struct Probe
+    {
+        std::shared_ptr<CURL> curl;
+        std::string url;
+    };
+    std::vector<Probe> probes;
+    probes.reserve(nameNodes.size());
+    for (const auto &endpoint : nameNodes)
+    {
+        Probe probe{createCurlEaseHandle(), makeUrlPrefix(endpoint) + "/?op=GETFILESTATUS"};
+        if (!userName.empty())
+        {
+            probe.url += "&user.name=" + userName;
+        }
+        auto curl = probe.curl.get();
+        checkCurl(curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_URL, probe.url.c_str()));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_TIMEOUT, timeoutSeconds));
+        if (http2)
+        {
+            checkCurl(curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
+                                       CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE));
+        }
+        checkCurl(curl_easy_setopt(
+            curl, CURLOPT_WRITEFUNCTION,
+            static_cast<size_t (*)(char *, size_t, size_t, void *)>(
+                [](char *, size_t size, size_t nitems, void *) { return size * nitems; })));
+        probes.push_back(probe);
+        if (curl_multi_add_handle(multi.get(), curl) != CURLM_OK)
+        {
+            throw Exception("libcurl multi setup failed");
+        }
+    }
+
+    size_t active = nameNodes.size();
+    int running = 1;
+    while (running > 0 && active == nameNodes.size())
+    {
+        if (curl_multi_perform(multi.get(), &running) != CURLM_OK ||
+            curl_multi_wait(multi.get(), nullptr, 0, 100, nullptr) != CURLM_OK)
+        {
+            throw Exception("libcurl multi transfer failed");
+        }
+        int msgsLeft = 0;
+        while (auto msg = curl_multi_info_read(multi.get(), &msgsLeft))
+        {
+            long responseCode = 0;
+            if (msg->msg != CURLMSG_DONE || msg->data.result != CURLE_OK ||
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &responseCode) !=
+                    CURLE_OK ||
+                responseCode != 200L)
+            {
+                continue;
+            }
+            for (size_t i = 0; i < probes.size(); ++i)
+            {
+                if (probes[i].curl.get() == msg->easy_handle)
+                {
+                    active = i;
+                }
+            }
+        }
+    }
+
+    for (const auto &probe : probes)
+    {
+        curl_multi_remove_handle(multi.get(), probe.curl.get());
+    }
+    return active;
+}
+
+} // namesapce
+
+/* class to build WebHDFS operations URLs */
+class Client::UrlBuilder
+{
+public:
+    UrlBuilder(const Endpoint &endpoint, const std::string &userName)
+        : m_prefix(makeUrlPrefix(endpoint))
+        , m_userName(userName)
+    {
+    }
+
+    void setEndpoint(const Endpoint &endpoint)
+    {
+        m_prefix = makeUrlPrefix(endpoint);
+    }
+
+    std::string makeUrl(const std::string &remotePath, const std::string &operation)
+    {
+        std::stringstream oss;
+        oss << m_prefix << urlEncode(remotePath);
+        if (m_userName.empty())
+        {
+            oss << "?op=";
+        }
+        else
+        {
+            oss << "?user.name=" << m_userName << "&op=";
+        }
+        oss << operation;
+        return oss.str();
+    }
+
+    std::string makeUrl(const std::string &remotePath, const std::string &operation,
+                        const details::OptionsBase &opts)
+    {
+        return makeUrl(remotePath, operation) + opts.toQueryString();
+    }
+
+    static std::string urlEncode(const std::string &value)
+    {
+        std::ostringstream escaped;
+        escaped.fill('0');
+        escaped << std::hex;
+        for (const auto &c : value)
+        {
+            // Keep alphanumeric and other accepted characters intact
+            if (isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~' || c == '/')
+            {
+                escaped << c;
+            }
+            else
+            {
+                escaped << '%' << std::setw(2) << static_cast<int>(static_cast<unsigned char>(c));
+            }
+        }
+        return escaped.str();
+    }
+
+private:
+    std::shared_ptr<CURL> m_curl; // curl for remote path escaping
+    std::string m_prefix;
+    const std::string m_userName;
+};
+
+/* class to implement http i/o */
+class Client::HttpClient
+{
+    std::shared_ptr<CURLSH> m_share; // connections cache of all handles, destroyed last
+    std::shared_ptr<CURL> m_curlHanlde;
+    CURL *m_curl;                                    // just a raw ptr handled by m_curlHandle
+    std::shared_ptr<curl_slist> m_activeHttpHeaders; // we must handle allocated headers
+    std::shared_ptr<CURLM> m_multi;                  // for concurrent transfers, lazily created
+    std::vector<std::shared_ptr<CURL>> m_idleHandles; // handles for concurrent transfers
+    int m_connectTimeout;
+    int m_dataTransferTimeout;
+    RetryPolicy m_retryPolicy;
+    bool m_retryConnectErrors;
+    double m_retryTokens; // retry budget
+    std::minstd_rand m_random;
+    std::shared_ptr<TraceRecorder> m_trace;
+    std::shared_ptr<MemoryBudget> m_memoryBudget;
+    std::shared_ptr<DnsCache> m_dnsCache;
+    std::shared_ptr<ConcurrencyController> m_concurrency;
+    bool m_http2;
+    size_t m_maxStreams; // of HTTP/2 connection
+    std::shared_ptr<BufferTuner> m_bufferTuner;
+    unsigned long m_pinnedGeneration; // generation of DNS cache addresses in m_pinnedList
+    std::shared_ptr<curl_slist> m_pinnedList;
+    std::vector<std::shared_ptr<curl_slist>> m_oldPinnedLists; // could be used by transfers
+
+public:
+    HttpClient()
+        : m_share(createCurlShare())
+        , m_curlHanlde(createCurlEaseHandle())
+        , m_curl(m_curlHanlde.get())
+        , m_activeHttpHeaders()
+        , m_multi()
+        , m_idleHandles()
+        , m_connectTimeout(0)
+        , m_dataTransferTimeout(0)
+        , m_retryPolicy()
+        , m_retryConnectErrors(true)
+        , m_retryTokens(m_retryPolicy.m_budgetMaxTokens)
+        , m_random(std::random_device()())
+        , m_trace()
+        , m_memoryBudget()
+        , m_dnsCache()
+        , m_concurrency()
+        , m_http2(false)
+        , m_maxStreams(0)
+        , m_bufferTuner()
+        , m_pinnedGeneration(0)
+        , m_pinnedList()
+        , m_oldPinnedLists()
+    {
+        initHandle(m_curl);
+    }
+
+    void setDnsCache(const std::shared_ptr<DnsCache> &dnsCache)
+    {
+        m_dnsCache = dnsCache;
+    }
+
+    void setMemoryBudget(const std::shared_ptr<MemoryBudget> &memoryBudget)
+    {
+        m_memoryBudget = memoryBudget;
+    }
+
+    void setConcurrencyController(const std::shared_ptr<ConcurrencyController> &concurrency)
+    {
+        m_concurrency = concurrency;
+    }
+
+    void setBufferTuner(const std::shared_ptr<BufferTuner> &bufferTuner)
+    {
+        m_bufferTuner = bufferTuner;
+    }
+
+    /* use HTTP/2 with prior knowledge, should be set before any request */
+    void setHttp2(size_t maxStreams)
+    {
+        m_http2 = true;
+        m_maxStreams = maxStreams;
+        // libcurl doesn't limit connections per host of shared connections cache, so all
+        // requests are made by multi handle which keeps its own cache
+        auto share = createCurlShare(false);
+        checkCurl(curl_easy_setopt(m_curl, CURLOPT_SHARE, share.get()));
+        m_share = share;
+        initHttpVersion(m_curl);
+    }
+
+    void setTraceRecorder(const std::shared_ptr<TraceRecorder> &traceRecorder)
+    {
+        m_trace = traceRecorder;
+    }
+
+    /* set retry policy, connection errors may be not retried to fail over quickly */
+    void setRetryPolicy(const RetryPolicy &retryPolicy, bool retryConnectErrors)
+    {
+        m_retryPolicy = retryPolicy;
+        m_retryConnectErrors = retryConnectErrors;
+        m_retryTokens = retryPolicy.m_budgetMaxTokens;
+    }
+
+    void setConnectTimeout(int seconds)
+    {
+        m_connectTimeout = seconds;
+        checkCurl(curl_easy_setopt(m_curl, CURLOPT_CONNECTTIMEOUT, seconds));
+    }
+
+    void setDataTranfserTimeout(int seconds)
+    {
+        m_dataTransferTimeout = seconds;
+        checkCurl(curl_easy_setopt(m_curl, CURLOPT_TIMEOUT, seconds));
+    }
+
+    /* handler of received data, returns false to abort transfer */
+    using DataHandler = std::function<bool(const char *, size_t)>;
+
+    struct Reply
+    {
+        static const long RESPONSE_CODE_CLIENT_ERROR = -1L; // special code to indicate client error
+        long responseCode = 0L;
+        std::string unexpectedResponseContent; // for error or other unexpected reply
+        std::string clientError;               // to put an error occured in callback
+        std::string redirectUrl;
+        size_t receivedDataSize = 0; // data passed to sink
+        std::exception_ptr error;    // error of concurrent request (see makeMany)
+    };
+
+    struct Request
+    {
+        enum class Type
+        {
+            GET,
+            PUT,
+            POST,
+            DELETE
+        };
+        Type type = Type::GET;
+        std::string url;
+        bool followRedirect = false;
+        std::ostream *pDataSink = nullptr;
+        DataHandler dataHandler; // alternative to pDataSink
+        std::istream *pDataSource = nullptr;
+        long expectedResponseCode = 0L;
+        bool idempotent = false; // request can be retried
+        bool buffered = false;   // data sink is a memory buffer (counted in memory budget)
+    };
+
+    /* make request, retry idempotent ones according to retry policy */
     Reply make(const Request &req)
     {
-        Reply reply;
-        ReplyHandler replyHandler{reply, req.expectedResponseCode, req.pDataSink, m_curl};
-        //curl_easy_setopt(m_curl, CURLOPT_VERBOSE, 1L);
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_URL, req.url.c_str()));
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_FOLLOWLOCATION, req.followRedirect ? 1L : 0L));
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, NULL));
-        switch (req.type)
+        for (int attempt = 1;; ++attempt)
+        {
+            Reply reply;
+            try
+            {
+                perform(req, reply);
+                m_retryTokens = std::min(m_retryTokens + m_retryPolicy.m_budgetRatio,
+                                         m_retryPolicy.m_budgetMaxTokens);
+                return reply;
+            }
+            catch (const Exception &error)
+            {
+                if (!req.idempotent || reply.receivedDataSize > 0 ||
+                    attempt >= m_retryPolicy.m_maxAttempts ||
+                    !isRetriableError(error, m_retryConnectErrors) || m_retryTokens < 1.0)
+                {
+                    throw;
+                }
+                m_retryTokens -= 1.0;
+            }
+            std::this_thread::sleep_for(backoff(attempt));
+        }
+    }
+
+    /* Make requests concurrently (not more than maxParallel at once). Replies are in
+     * requests order, errors are not thrown but stored in Reply::error. */
+    std::vector<Reply> makeMany(const std::vector<Request> &reqs, size_t maxParallel)
+    {
+        std::vector<Reply> replies(reqs.size());
+        size_t next = 0;
+        makeConcurrently(
+            [&](Request &req, size_t &tag)
+            {
+                if (next == reqs.size())
+                {
+                    return false;
+                }
+                req = reqs[next];
+                tag = next++;
+                return true;
+            },
+            [&](size_t tag, Reply &reply) { replies[tag] = std::move(reply); }, maxParallel);
+        return replies;
+    }
+
+    /* source of concurrent requests, returns false if there is no request to start now */
+    using NextRequest = std::function<bool(Request &req, size_t &tag)>;
+    /* handler of completed request (request error is stored in Reply::error) */
+    using RequestDone = std::function<void(size_t tag, Reply &reply)>;
+
+    /* Make requests concurrently (not more than maxParallel at once) while the source gives
+     * them. Completion handler can make next requests available. */
+    void makeConcurrently(const NextRequest &nextRequest, const RequestDone &requestDone,
+                          size_t maxParallel)
+    {
+        struct Transfer
+        {
+            Transfer(const Request &request, MemoryBudget *memoryBudget)
+                : req(request)
+                , handler(reply, req, nullptr, memoryBudget)
+            {
+            }
+            size_t tag = 0;
+            Request req;
+            Reply reply;
+            std::shared_ptr<CURL> curl;
+            ReplyHandler handler;
+            std::shared_ptr<curl_slist> headers;
+            std::string endpoint; // for concurrency control
+            std::chrono::steady_clock::time_point started;
+        };
+
+        if (!m_multi)
+        {
+            m_multi.reset(curl_multi_init(), curl_multi_cleanup);
+            if (m_multi.get() == nullptr)
+            {
+                throw Exception("libcurl multi object creation failed");
+            }
+            // one multiplexed connection per host, requests over streams limit are queued
+            if (m_http2 &&
+                (curl_multi_setopt(m_multi.get(), CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX) !=
+                     CURLM_OK ||
+                 curl_multi_setopt(m_multi.get(), CURLMOPT_MAX_HOST_CONNECTIONS, 1L) !=
+                     CURLM_OK ||
+                 curl_multi_setopt(m_multi.get(), CURLMOPT_MAX_CONCURRENT_STREAMS,
+                                   static_cast<long>(m_maxStreams)) != CURLM_OK))
+            {
+                throw Exception("libcurl multi setup failed");
+            }
+        }
+
+        std::map<CURL *, std::unique_ptr<Transfer>> active;
+        // requests deferred by concurrency controller, up to maxParallel
+        std::deque<std::unique_ptr<Transfer>> deferred;
+        maxParallel = std::max<size_t>(maxParallel, 1);
+
+        // returns false if the source has no request to start
+        auto start = [&]()
+        {
+            std::unique_ptr<Transfer> transfer;
+            for (auto it = deferred.begin(); it != deferred.end(); ++it)
+            {
+                // one request is started anyway to guarantee progress
+                if (m_concurrency->tryAcquire((*it)->endpoint, active.empty()))
+                {
+                    transfer = std::move(*it);
+                    deferred.erase(it);
+                    break;
+                }
+            }
+            if (!transfer)
+            {
+                Request req;
+                size_t tag = 0;
+                if (deferred.size() >= maxParallel || !nextRequest(req, tag))
+                {
+                    return false;
+                }
+                transfer.reset(new Transfer(req, m_memoryBudget.get()));
+                transfer->tag = tag;
+                if (m_concurrency)
+                {
+                    transfer->endpoint = urlEndpoint(req.url);
+                    if (!m_concurrency->tryAcquire(transfer->endpoint, active.empty()))
+                    {
+                        deferred.push_back(std::move(transfer));
+                        return true;
+                    }
+                }
+            }
+            transfer->started = std::chrono::steady_clock::now();
+            try
+            {
+                transfer->curl = acquireHandle();
+                transfer->handler.curl = transfer->curl.get();
+                setup(transfer->curl.get(), transfer->req, transfer->handler, transfer->headers);
+                if (curl_multi_add_handle(m_multi.get(), transfer->curl.get()) != CURLM_OK)
+                {
+                    throw Exception("libcurl multi setup failed");
+                }
+            }
+            catch (...)
+            {
+                transfer->reply.error = std::current_exception();
+                concurrencyDone(transfer->endpoint, transfer->started,
+                                transfer->reply.receivedDataSize, transfer->reply.error);
+                requestDone(transfer->tag, transfer->reply);
+                return true;
+            }
+            auto curl = transfer->curl.get();
+            active[curl] = std::move(transfer);
+            return true;
+        };
+
+        try
+        {
+            while (true)
+            {
+                while (active.size() < maxParallel && start())
+                {
+                }
+                if (active.empty())
+                {
+                    // no transfer can read replaced pinned addresses anymore
+                    m_oldPinnedLists.clear();
+                    break;
+                }
+                int running = 0;
+                if (curl_multi_perform(m_multi.get(), &running) != CURLM_OK)
+                {
+                    throw Exception("libcurl multi transfer failed");
+                }
+                int msgsLeft = 0;
+                bool completed = false;
+                while (auto msg = curl_multi_info_read(m_multi.get(), &msgsLeft))
+                {
+                    if (msg->msg != CURLMSG_DONE)
+                    {
+                        continue;
+                    }
+                    completed = true;
+                    const auto curlCode = msg->data.result;
+                    auto it = active.find(msg->easy_handle);
+                    std::unique_ptr<Transfer> transfer(std::move(it->second));
+                    active.erase(it);
+                    curl_multi_remove_handle(m_multi.get(), transfer->curl.get());
+                    m_idleHandles.push_back(transfer->curl);
+                    try
+                    {
+                        complete(transfer->curl.get(), transfer->req, transfer->reply, curlCode);
+                    }
+                    catch (...)
+                    {
+                        transfer->reply.error = std::current_exception();
+                    }
+                    concurrencyDone(transfer->endpoint, transfer->started,
+                                    transfer->reply.receivedDataSize, transfer->reply.error);
+                    requestDone(transfer->tag, transfer->reply);
+                }
+                // completed requests could make next ones available, they are started at once
+                if (!completed && !active.empty() &&
+                    curl_multi_wait(m_multi.get(), nullptr, 0, 100, nullptr) != CURLM_OK)
+                {
+                    throw Exception("libcurl multi transfer failed");
+                }
+            }
+        }
+        catch (...)
+        {
+            for (const auto &item : active)
+            {
+                curl_multi_remove_handle(m_multi.get(), item.first);
+                if (m_concurrency)
+                {
+                    m_concurrency->cancel(item.second->endpoint);
+                }
+            }
+            m_oldPinnedLists.clear();
+            throw;
+        }
+    }
+
+
+private:
+    void perform(const Request &req, Reply &reply)
+    {
+        if (m_http2)
+        {
+            // request goes over multiplexed connection of concurrent requests
+            bool started = false;
+            makeConcurrently(
+                [&](Request &next, size_t &)
+                {
+                    next = req;
+                    return !started && (started = true);
+                },
+                [&](size_t, Reply &done) { reply = std::move(done); }, 1);
+            if (reply.error)
+            {
+                std::exception_ptr error;
+                std::swap(error, reply.error);
+                std::rethrow_exception(error);
+            }
+            return;
+        }
+        m_oldPinnedLists.clear();
+        ReplyHandler replyHandler(reply, req, m_curl, m_memoryBudget.get());
+        //curl_easy_setopt(m_curl, CURLOPT_VERBOSE, 1L);
+        setup(m_curl, req, replyHandler, m_activeHttpHeaders);
+        std::string endpoint;
+        if (m_concurrency)
+        {
+            endpoint = urlEndpoint(req.url);
+            m_concurrency->acquire(endpoint);
+        }
+        const auto started = std::chrono::steady_clock::now();
+        try
+        {
+            auto curlCode = curl_easy_perform(m_curl);
+            complete(m_curl, req, reply, curlCode);
+        }
+        catch (...)
+        {
+            concurrencyDone(endpoint, started, reply.receivedDataSize, std::current_exception());
+            throw;
+        }
+        concurrencyDone(endpoint, started, reply.receivedDataSize, nullptr);
+    }
+
+    /* report completed request to concurrency controller */
+    void concurrencyDone(const std::string &endpoint,
+                         const std::chrono::steady_clock::time_point &started, size_t bytes,
+                         const std::exception_ptr &error)
+    {
+        if (m_concurrency)
+        {
+            const std::chrono::duration<double, std::milli> latency =
+                std::chrono::steady_clock::now() - started;
+            m_concurrency->release(endpoint, latency.count(), bytes,
+                                   error && isOverloadError(error));
+        }
+    }
+
+    /* exponential backoff with jitter */
+    std::chrono::milliseconds backoff(int attempt)
+    {
+        double delay = m_retryPolicy.m_initialBackoff;
+        for (int i = 1; i < attempt && delay < m_retryPolicy.m_maxBackoff; ++i)
+        {
+            delay *= 2;
+        }
+        delay = std::min<double>(delay, m_retryPolicy.m_maxBackoff);
+        std::uniform_real_distribution<double> distribution(0.0, m_retryPolicy.m_jitter);
+        delay *= 1.0 - distribution(m_random);
+        return std::chrono::milliseconds(static_cast<long>(delay));
+    }
+
+    void initHandle(CURL *curl)
+    {
+        checkCurl(curl_easy_setopt(curl, CURLOPT_SHARE, m_share.get()));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0"));
+        initHttpVersion(curl);
+    }
+
+    void initHttpVersion(CURL *curl)
+    {
+        if (m_http2)
+        {
+            checkCurl(curl_easy_setopt(curl, CURLOPT_HTTP_VERSION,
+                                       CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE));
+            // wait for multiplexed connection instead of opening new ones
+            checkCurl(curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L));
+        }
+    }
+
+    std::shared_ptr<CURL> acquireHandle()
+    {
+        if (!m_idleHandles.empty())
+        {
+            auto curl = m_idleHandles.back();
+            m_idleHandles.pop_back();
+            return curl;
+        }
+        auto curl = createCurlEaseHandle();
+        initHandle(curl.get());
+        if (m_connectTimeout > 0)
+        {
+            checkCurl(curl_easy_setopt(curl.get(), CURLOPT_CONNECTTIMEOUT, m_connectTimeout));
+        }
+        if (m_dataTransferTimeout > 0)
+        {
+            checkCurl(curl_easy_setopt(curl.get(), CURLOPT_TIMEOUT, m_dataTransferTimeout));
+        }
+        return curl;
+    }
+
+    struct ReplyHandler;
+
+    /* set curl handle options for the request */
+    void setup(CURL *curl, const Request &req, ReplyHandler &replyHandler,
+               std::shared_ptr<curl_slist> &activeHttpHeaders)
+    {
+        if (m_bufferTuner)
+        {
+            tuneBuffers(curl, req, replyHandler);
+        }
+        else
+        {
+            checkCurl(curl_easy_setopt(curl, CURLOPT_URL, req.url.c_str()));
+        }
+        if (m_dnsCache)
+        {
+            pinAddresses(curl, req.url);
+        }
+        checkCurl(curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, req.followRedirect ? 1L : 0L));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, NULL));
+        switch (req.type)
+        {
+        case Request::Type::GET:
+            checkCurl(curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L));
+            setHttpHeaders(curl, activeHttpHeaders, {"Expect:"});
+            break;
+        case Request::Type::PUT:
+            checkCurl(curl_easy_setopt(curl, CURLOPT_UPLOAD, 1L));
+            if (req.pDataSource == nullptr)
+            {
+                checkCurl(curl_easy_setopt(curl, CURLOPT_INFILESIZE, 0));
+                setHttpHeaders(curl, activeHttpHeaders, {"Expect:", "Transfer-Encoding:"});
+            }
+            else
+            {
+                checkCurl(curl_easy_setopt(curl, CURLOPT_INFILESIZE, -1));
+                setHttpHeaders(curl, activeHttpHeaders,
+                               {"Expect:", "Transfer-Encoding: chunked"});
+            }
+            break;
+        case Request::Type::POST:
+            // HTTPGET resets upload flag left by previous PUT of the handle
+            checkCurl(curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L));
+            checkCurl(curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, 0L));
+            checkCurl(curl_easy_setopt(curl, CURLOPT_POSTFIELDS, ""));
+            setHttpHeaders(curl, activeHttpHeaders, {"Expect:", "Transfer-Encoding:"});
+            break;
+        case Request::Type::DELETE:
+            checkCurl(curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L));
+            checkCurl(curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "DELETE"));
+            setHttpHeaders(curl, activeHttpHeaders,
+                           {"Expect:", "Transfer-Encoding:", "Content-Length:"});
+            break;
+        }
+        checkCurl(curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, ReplyHandler::writeCallback));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_WRITEDATA, &replyHandler));
+        // progress callback resumes transfers paused by memory budget
+        checkCurl(curl_easy_setopt(curl, CURLOPT_NOPROGRESS, replyHandler.budget ? 0L : 1L));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION,
+                                   ReplyHandler::progressCallback));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &replyHandler));
+        if (req.pDataSource != nullptr)
+        {
+            checkCurl(curl_easy_setopt(curl, CURLOPT_READFUNCTION, streamReadCallback));
+            checkCurl(curl_easy_setopt(curl, CURLOPT_READDATA, req.pDataSource));
+        }
+    }
+
+    /* set url and transfer buffers of the request to tuned ones of its host (buffers are set
+     * before redirect is followed, so redirected requests get ones of the request host),
+     * socket buffers are chosen by host of every new connection */
+    void tuneBuffers(CURL *curl, const Request &req, ReplyHandler &replyHandler)
+    {
+        std::string host;
+        int port = 0;
+        BufferTuning tuning;
+        if (!parseUrlHost(req.url, host, port) || !m_bufferTuner->find(host, tuning))
+        {
+            tuning.transferBuffer = 0;
+        }
+        const auto url = tuning.transferBuffer > 0
+                             ? addBufferSizeHint(req.url, tuning.transferBuffer)
+                             : req.url;
+        checkCurl(curl_easy_setopt(curl, CURLOPT_URL, url.c_str()));
+        // handles are reused, not tuned requests get libcurl defaults
+        checkCurl(curl_easy_setopt(curl, CURLOPT_BUFFERSIZE,
+                                   tuning.transferBuffer > 0
+                                       ? static_cast<long>(tuning.transferBuffer)
+                                       : static_cast<long>(CURL_MAX_WRITE_SIZE)));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_UPLOAD_BUFFERSIZE,
+                                   tuning.transferBuffer > 0
+                                       ? static_cast<long>(tuning.transferBuffer)
+                                       : 64L << 10));
+        replyHandler.tuner = m_bufferTuner.get();
+        checkCurl(curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, ReplyHandler::sockoptCallback));
+        checkCurl(curl_easy_setopt(curl, CURLOPT_SOCKOPTDATA, &replyHandler));
+    }
+
+    /* pass throughput and round trip time of completed transfer to buffer tuner */
+    void measureTransfer(CURL *curl)
+    {
+        const char *url = nullptr;
+        long connects = 0;
+        double total = 0, redirect = 0, nameLookup = 0, connect = 0, preTransfer = 0,
+               startTransfer = 0;
+        curl_off_t downloaded = 0, uploaded = 0;
+        curl_easy_getinfo(curl, CURLINFO_EFFECTIVE_URL, &url);
+        curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+        curl_easy_getinfo(curl, CURLINFO_REDIRECT_TIME, &redirect);
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &nameLookup);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connect);
+        curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME, &preTransfer);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &startTransfer);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_UPLOAD_T, &uploaded);
+        std::string host;
+        int port = 0;
+        if (url == nullptr || !parseUrlHost(url, host, port))
+        {
+            return;
+        }
+        // TCP handshake of new connection takes one round trip
+        const auto rtt = connects > 0 && connect > nameLookup ? connect - nameLookup : 0.0;
+        // data phase of the last request (times are counted after redirects)
+        if (downloaded >= uploaded)
+        {
+            m_bufferTuner->addSample(host, rtt, static_cast<size_t>(downloaded),
+                                     total - redirect - startTransfer);
+        }
+        else
+        {
+            m_bufferTuner->addSample(host, rtt, static_cast<size_t>(uploaded),
+                                     total - redirect - preTransfer);
+        }
+    }
+
+    /* pin DNS cache addresses (request host is resolved if it isn't cached or expired) */
+    void pinAddresses(CURL *curl, const std::string &url)
+    {
+        std::string host;
+        int port = 0;
+        if (parseUrlHost(url, host, port))
+        {
+            m_dnsCache->resolve(host, port, false);
+        }
+        std::vector<std::string> pinned;
+        if (m_dnsCache->pinnedAddresses(m_pinnedGeneration, pinned))
+        {
+            curl_slist *list = nullptr;
+            for (const auto &item : pinned)
+            {
+                auto newList = curl_slist_append(list, item.c_str());
+                if (newList == nullptr)
+                {
+                    curl_slist_free_all(list);
+                    throw Exception("libcurl slist append failed");
+                }
+                list = newList;
+            }
+            // list is read when transfer starts, it is kept till there are no transfers
+            if (m_pinnedList)
+            {
+                m_oldPinnedLists.push_back(m_pinnedList);
+            }
+            m_pinnedList.reset(list, curl_slist_free_all);
+        }
+        checkCurl(curl_easy_setopt(curl, CURLOPT_RESOLVE, m_pinnedList.get()));
+    }
+
+    /* record request and its phases as trace async spans */
+    void traceTransfer(CURL *curl, const Request &req)
+    {
+        const auto end = TraceRecorder::now();
+        double total = 0, redirect = 0, nameLookup = 0, connect = 0, startTransfer = 0;
+        curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME, &total);
+        curl_easy_getinfo(curl, CURLINFO_REDIRECT_TIME, &redirect);
+        curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME, &nameLookup);
+        curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME, &connect);
+        curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME, &startTransfer);
+        const auto us = [](double seconds)
+        {
+            return static_cast<long long>(seconds * 1e6);
+        };
+        // phases times of the last request are counted from its start (after redirects)
+        const auto start = end - us(total);
+        const auto base = start + us(redirect);
+        const auto id = m_trace->nextId();
+        static const char *typeNames[] = {"GET", "PUT", "POST", "DELETE"};
+        m_trace->addAsyncSpan(std::string("http ") + typeNames[static_cast<int>(req.type)],
+                              "http", id, start, us(total), req.url);
+        // reused connections report zero times of skipped phases
+        auto from = start;
+        const auto phase = [&](const char *name, long long to)
+        {
+            if (to > from)
+            {
+                m_trace->addAsyncSpan(name, "http", id, from, to - from);
+                from = to;
+            }
+        };
+        phase("redirect", base);
+        phase("dns", base + us(nameLookup));
+        phase("connect", base + us(connect));
+        phase("first byte", base + us(startTransfer));
+        phase("transfer", end);
+    }
+
+    /* check transfer result and throw on errors */
+    void complete(CURL *curl, const Request &req, Reply &reply, CURLcode curlCode)
+    {
+        if (m_trace)
+        {
+            traceTransfer(curl, req);
+        }
+        if (m_bufferTuner && curlCode == CURLE_OK)
+        {
+            measureTransfer(curl);
+        }
+        if (curlCode != CURLE_OK)
+        {
+            // special errors handling to catch errors in client callbacks, indicated by
+            // RESPONSE_CODE_CLIENT_ERROR response code.
+            if (reply.responseCode == Reply::RESPONSE_CODE_CLIENT_ERROR)
+            {
+                throw Exception(reply.clientError);
+            }
+            // main error handling
+            else
+            {
+                long redirects = 0;
+                curl_easy_getinfo(curl, CURLINFO_REDIRECT_COUNT, &redirects);
+                checkCurlTransfer(curlCode, redirects > 0);
+            }
+        }
+
+        checkCurl(curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &reply.responseCode));
+        if (!req.followRedirect)
+        {
+            const char *redirectUrl;
+            checkCurl(curl_easy_getinfo(curl, CURLINFO_REDIRECT_URL, &redirectUrl));
+            if (redirectUrl)
+            {
+                reply.redirectUrl = redirectUrl;
+            }
+        }
+
+        // check remote error
+        if (reply.responseCode != req.expectedResponseCode)
+        {
+            RemoteError remoteError;
+            if (tryParseRemoteError(reply.unexpectedResponseContent, remoteError))
+            {
+                throw RemoteException(remoteError.type, remoteError.message, reply.responseCode);
+            }
+            else
+            {
+                std::stringstream err;
+                err << "unexpected server response code: " << reply.responseCode;
+                if (!reply.unexpectedResponseContent.empty())
+                {
+                    err << " (" << reply.unexpectedResponseContent << ")";
+                }
+                throw RemoteException("", err.str(), reply.responseCode);
+            }
+        }
+    }
+
+    void setHttpHeaders(CURL *curl, std::shared_ptr<curl_slist> &activeHttpHeaders,
+                        const std::vector<std::string> &headers = std::vector<std::string>())
+    {
+        // reset headers to default ones
+        checkCurl(curl_easy_setopt(curl, CURLOPT_HTTPHEADER, nullptr));
+
+        curl_slist *headersRaw = NULL;
+        for (const auto &header : headers)
+        {
+            headersRaw = curl_slist_append(headersRaw, header.c_str());
+            if (headersRaw == nullptr)
+            {
+                throw Exception("libcurl request headers setup failed");
+            }
+        }
+        activeHttpHeaders.reset(headersRaw, curl_slist_free_all);
+        checkCurl(curl_easy_setopt(curl, CURLOPT_HTTPHEADER, activeHttpHeaders.get()));
+    }
+
+    static size_t streamReadCallback(char *buffer, size_t size, size_t nitems, void *userdata)
+    {
+        auto pIStream = static_cast<std::istream *>(userdata);
+        const auto dataSize = size * nitems;
+        pIStream->read(buffer, dataSize);
+        // failed source must not end the upload as complete file
+        if (pIStream->bad())
+        {
+            return CURL_READFUNC_ABORT;
+        }
+        return pIStream->gcount();
+    }
+
+    struct ReplyHandler
+    {
+        ReplyHandler(Reply &reply, const Request &req, CURL *curl, MemoryBudget *budget)
+            : reply(reply)
+            , expectedResponseCodes(req.expectedResponseCode)
+            , pDataSink(req.pDataSink)
+            , dataHandler(req.dataHandler)
+            , curl(curl)
+            , buffered(req.buffered)
+            , budget(budget)
+            , charged(0)
+            , reserved(0)
+            , pausedSize(0)
+            , overdraft(false)
+        {
+        }
+
+        /* buffered data is released when transfer is completed */
+        ~ReplyHandler()
+        {
+            if (charged > 0 || overdraft)
+            {
+                budget->release(charged, overdraft);
+            }
+        }
+
+        ReplyHandler(const ReplyHandler &) = delete;
+        ReplyHandler &operator=(const ReplyHandler &) = delete;
+
+        Reply &reply;
+        const long expectedResponseCodes;
+        std::ostream *pDataSink;
+        const DataHandler &dataHandler;
+        CURL *curl;
+        const bool buffered;
+        MemoryBudget *budget;
+        size_t charged;    // memory acquired from budget
+        size_t reserved;   // memory acquired for data delivered after pause
+        size_t pausedSize; // memory to acquire to resume paused transfer
+        bool overdraft;
+        BufferTuner *tuner = nullptr; // sizes socket buffers of new connections
+
+        /* set socket buffers of new connection to tuned ones of the host it's made to */
+        static int sockoptCallback(void *userData, curl_socket_t fd, curlsocktype purpose)
+        {
+            const auto self = static_cast<ReplyHandler *>(userData);
+            if (purpose != CURLSOCKTYPE_IPCXN || self->tuner == nullptr)
+            {
+                return CURL_SOCKOPT_OK;
+            }
+            // effective url is the redirect target when redirect is followed, so connection
+            // to datanode gets datanode buffers
+            const char *url = nullptr;
+            std::string host;
+            int port = 0;
+            BufferTuning tuning;
+            if (curl_easy_getinfo(self->curl, CURLINFO_EFFECTIVE_URL, &url) == CURLE_OK &&
+                url != nullptr && parseUrlHost(url, host, port) &&
+                self->tuner->find(host, tuning))
+            {
+                // best effort, kernel caps sizes by its limits
+                const int size = static_cast<int>(tuning.socketBuffer);
+                setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+                setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+            }
+            return CURL_SOCKOPT_OK;
+        }
+
+        /* count data to be buffered in memory budget, false if transfer has to pause */
+        bool charge(size_t dataSize)
+        {
+            if (dataSize <= reserved)
+            {
+                reserved -= dataSize;
+                return true;
+            }
+            const auto size = dataSize - reserved;
+            if (!budget->tryAcquire(size, false, overdraft))
+            {
+                pausedSize = size;
+                return false;
+            }
+            charged += size;
+            reserved = 0;
+            return true;
+        }
+
+        static int progressCallback(void *userData, curl_off_t, curl_off_t, curl_off_t,
+                                    curl_off_t)
+        {
+            auto self = static_cast<ReplyHandler *>(userData);
+            if (self->pausedSize > 0 && self->budget->tryAcquire(self->pausedSize, true,
+                                                                 self->overdraft))
+            {
+                self->charged += self->pausedSize;
+                self->reserved += self->pausedSize;
+                self->pausedSize = 0;
+                curl_easy_pause(self->curl, CURLPAUSE_CONT);
+            }
+            return 0;
+        }
+
+        static size_t writeCallback(char *buffer, size_t size, size_t nitems, void *userData)
+        {
+            auto self = static_cast<ReplyHandler *>(userData);
+            auto &reply = self->reply;
+            auto pDataSink = self->pDataSink;
+            const auto dataSize = size * nitems;
+
+            if (reply.responseCode == 0 &&
+                curl_easy_getinfo(self->curl, CURLINFO_RESPONSE_CODE, &reply.responseCode) !=
+                    CURLE_OK)
+            {
+                reply.responseCode = Reply::RESPONSE_CODE_CLIENT_ERROR;
+                reply.clientError = "libcurl getinfo failed";
+                return 0;
+            }
+
+            const bool unexpected = self->expectedResponseCodes != reply.responseCode;
+            if (self->budget && (unexpected || self->buffered) && !self->charge(dataSize))
+            {
+                return CURL_WRITEFUNC_PAUSE;
+            }
+            if (unexpected)
+            {
+                reply.unexpectedResponseContent.append(buffer, dataSize);
+                return dataSize;
+            }
+            reply.receivedDataSize += dataSize;
+            if (pDataSink != nullptr)
+            {
+                pDataSink->write(buffer, dataSize);
+                if (!pDataSink->good())
+                {
+                    return 0;
+                }
+            }
+            else if (self->dataHandler)
+            {
+                if (!self->dataHandler(buffer, dataSize))
+                {
+                    return 0;
+                }
+            }
+            return dataSize;
+        }
+    };
+};
+
+Client::Client(const std::string &host, int port, const ClientOptions &opts)
+    : Client(std::vector<Endpoint>{Endpoint(host, port)}, opts)
+{
+}
+
+Client::Client(const std::string &host, const ClientOptions &opts)
+    : Client(host, 50070, opts)
+{
+}
+
+Client::Client(const std::vector<Endpoint> &nameNodes, const ClientOptions &opts)
+    : m_nameNodes(nameNodes)
+    , m_activeNameNode(ActiveNameNodeCache::get(nameNodes))
+    , m_probeTimeout(opts.m_connectionTimeout > 0 ? opts.m_connectionTimeout : 10)
+    , m_userName(opts.m_userName)
+    , m_options(opts)
+    , m_urlBuilder()
+    , m_httpClient(new HttpClient)
+{
+    if (m_nameNodes.empty())
+    {
+        throw Exception("no namenode endpoints");
+    }
+    if (m_activeNameNode >= m_nameNodes.size())
+    {
+        m_activeNameNode = 0;
+    }
+    m_urlBuilder.reset(new UrlBuilder(m_nameNodes[m_activeNameNode], opts.m_userName));
+    // with several namenodes connection errors are handled by failover
+    m_httpClient->setRetryPolicy(opts.m_retryPolicy, m_nameNodes.size() == 1);
+    m_httpClient->setTraceRecorder(opts.m_traceRecorder);
+    m_httpClient->setMemoryBudget(opts.m_memoryBudget);
+    m_httpClient->setDnsCache(opts.m_dnsCache);
+    m_httpClient->setConcurrencyController(opts.m_concurrencyController);
+    m_httpClient->setBufferTuner(opts.m_bufferTuner);
+    if (opts.m_http2)
+    {
+        m_httpClient->setHttp2(opts.m_maxStreams);
+    }
+
+    if (opts.m_connectionTimeout > 0)
+    {
+        m_httpClient->setConnectTimeout(opts.m_connectionTimeout);
+    }
+
+    if (opts.m_dataTransferTimeout > 0)
+    {
+        m_httpClient->setDataTranfserTimeout(opts.m_dataTransferTimeout);
+    }
+}
+
+Client::~Client() = default;
+
+Client::Client(Client &&) = default;
+
+Client& Client::operator=(Client &&)=default;
+
+Client Client::clone() const
+{
+    return Client(m_nameNodes, m_options);
+}
+
+std::shared_ptr<MemoryBudget> Client::memoryBudget() const
+{
+    return m_options.m_memoryBudget;
+}
+
+void Client::warmUp(const std::vector<std::string> &remotePaths)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "warmUp",
+                   m_nameNodes[m_activeNameNode].host);
+    if (m_options.m_dnsCache)
+    {
+        for (const auto &nameNode : m_nameNodes)
+        {
+            m_options.m_dnsCache->resolve(nameNode.host, nameNode.port);
+        }
+    }
+    // keep-alive connection to the active namenode
+    getFileStatus("/");
+
+    // small reads open connections to datanodes of the files blocks
+    std::map<std::string, std::string> dataNodeUrls; // by datanode host
+    for (const auto &remotePath : remotePaths)
+    {
+        if (dataNodeUrls.size() >= WARM_UP_MAX_DATANODES)
+        {
+            break;
+        }
+        try
+        {
+            const auto blocks = getFileBlockLocations(remotePath);
+            if (blocks.empty())
+            {
+                continue;
+            }
+            const auto urlTemplate = getDataNodeUrlTemplate(remotePath, 0);
+            for (const auto &block : blocks)
+            {
+                for (const auto &host : block.hosts)
+                {
+                    if (block.length > 0 && !dataNodeUrls.count(host) &&
+                        dataNodeUrls.size() < WARM_UP_MAX_DATANODES)
+                    {
+                        dataNodeUrls[host] =
+                            makeDataNodeReadUrl(urlTemplate, host, block.offset, 1);
+                    }
+                }
+            }
+        }
+        catch (const Exception &)
+        {
+        }
+    }
+    std::vector<HttpClient::Request> reqs;
+    for (const auto &item : dataNodeUrls)
+    {
+        HttpClient::Request req;
+        req.type = HttpClient::Request::Type::GET;
+        req.url = item.second;
+        req.dataHandler = [](const char *, size_t) { return true; };
+        req.expectedResponseCode = 200L;
+        reqs.push_back(req);
+    }
+    // connections are opened as many at once as direct reads make
+    m_httpClient->makeMany(reqs, DirectReadOptions().m_parallelism);
+}
+
+void Client::warmUp(std::vector<Client> &clients, const std::vector<std::string> &remotePaths)
+{
+    std::vector<std::exception_ptr> errors(clients.size());
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < clients.size(); ++i)
+    {
+        threads.emplace_back([&, i]
+                             {
+                                 try
+                                 {
+                                     clients[i].warmUp(remotePaths);
+                                 }
+                                 catch (...)
+                                 {
+                                     errors[i] = std::current_exception();
+                                 }
+                             });
+    }
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    for (const auto &error : errors)
+    {
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+void Client::withFailover(const std::function<void()> &operation)
+{
+    for (size_t attempt = 1;; ++attempt)
+    {
+        try
+        {
+            operation();
+            return;
+        }
+        catch (const Exception &error)
+        {
+            if (attempt >= m_nameNodes.size() || !isFailoverError(error))
+            {
+                throw;
+            }
+            failover();
+        }
+    }
+}
+
+bool Client::repeatAfterFailover(const std::exception_ptr &requestError, size_t requestNameNode,
+                                 size_t &failovers)
+{
+    if (!isFailoverError(requestError))
+    {
+        return false;
+    }
+    // concurrent requests to the failed namenode don't cause another failover
+    if (requestNameNode != m_activeNameNode)
+    {
+        return true;
+    }
+    if (failovers + 1 >= m_nameNodes.size())
+    {
+        return false;
+    }
+    ++failovers;
+    failover();
+    return true;
+}
+
+void Client::failover()
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "failover", m_nameNodes[m_activeNameNode].host);
+    // another client could have already found the active namenode
+    auto active = ActiveNameNodeCache::get(m_nameNodes);
+    if (active == m_activeNameNode)
+    {
+        active = probeActiveNameNode(m_nameNodes, m_userName, m_probeTimeout,
+                                     m_options.m_http2);
+        if (active == m_nameNodes.size())
+        {
+            throw Exception("no active namenode found");
+        }
+        ActiveNameNodeCache::set(m_nameNodes, active);
+    }
+    m_activeNameNode = active;
+    m_urlBuilder->setEndpoint(m_nameNodes[active]);
+}
+
+void Client::writeFile(std::istream &dataSource, const std::string &remotePath,
+                       const WriteOptions &opts)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "writeFile", remotePath);
+    using Request = HttpClient::Request;
+    // Step 1. Get dataNodeUrl.
+    HttpClient::Reply reply;
+    withFailover([&]
+                 {
+                     Request req1;
+                     req1.type = Request::Type::PUT;
+                     req1.url = m_urlBuilder->makeUrl(remotePath, "CREATE", opts);
+                     req1.expectedResponseCode = 307L;
+                     reply = m_httpClient->make(req1);
+                 });
+    if (reply.redirectUrl.empty())
+    {
+        throw Exception("protocol error: no redirection to data node");
+    }
+
+    // Step 2. Put data
+    Request req2;
+    req2.type = Request::Type::PUT;
+    req2.url = reply.redirectUrl;
+    req2.pDataSource = &dataSource;
+    req2.expectedResponseCode = 201L;
+    m_httpClient->make(req2);
+}
+
+void Client::writeFiles(const std::vector<UploadFile> &files, const UploadOptions &opts)
+{
+    const auto detail = std::to_string(files.size()) + " files";
+    TraceSpan span(m_options.m_traceRecorder.get(), "writeFiles", detail);
+    using Request = HttpClient::Request;
+    using Reply = HttpClient::Reply;
+    const auto parallelism = std::max<size_t>(opts.m_parallelism, 1);
+    const auto createAhead = std::max<size_t>(opts.m_createAhead, 1);
+
+    // Request tag is file index and phase: even tags are namenode CREATE requests, odd ones
+    // are datanode data writes.
+    std::deque<size_t> toCreate;
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        toCreate.push_back(i);
+    }
+    std::deque<size_t> toWrite; // files redirected to datanodes
+    std::vector<std::string> dataNodeUrls(files.size());
+    std::vector<std::unique_ptr<std::ifstream>> dataSources(files.size());
+    std::vector<size_t> createNameNodes(files.size()); // namenode of CREATE request
+    size_t creating = 0;
+    size_t writing = 0;
+    size_t failovers = 0;
+    std::exception_ptr error;
+
+    auto nextRequest = [&](Request &req, size_t &tag)
+    {
+        if (error)
+        {
+            return false;
+        }
+        if (!toWrite.empty() && writing < parallelism)
+        {
+            const auto i = toWrite.front();
+            toWrite.pop_front();
+            dataSources[i].reset(new std::ifstream(files[i].localFilePath, std::ios::binary));
+            if (!dataSources[i]->is_open())
+            {
+                error = std::make_exception_ptr(
+                    Exception("can't open " + files[i].localFilePath));
+                return false;
+            }
+            req.type = Request::Type::PUT;
+            req.url = dataNodeUrls[i];
+            req.pDataSource = dataSources[i].get();
+            req.expectedResponseCode = 201L;
+            tag = 2 * i + 1;
+            ++writing;
+            return true;
+        }
+        // redirects are requested ahead of data writing
+        if (!toCreate.empty() && creating + toWrite.size() < createAhead)
+        {
+            const auto i = toCreate.front();
+            toCreate.pop_front();
+            req.type = Request::Type::PUT;
+            req.url = m_urlBuilder->makeUrl(files[i].remoteFilePath, "CREATE",
+                                            opts.m_writeOptions);
+            req.expectedResponseCode = 307L;
+            tag = 2 * i;
+            createNameNodes[i] = m_activeNameNode;
+            ++creating;
+            return true;
+        }
+        return false;
+    };
+
+    auto requestDone = [&](size_t tag, Reply &reply)
+    {
+        const auto i = tag / 2;
+        if (tag % 2 == 0)
+        {
+            --creating;
+            if (!reply.error && reply.redirectUrl.empty())
+            {
+                reply.error = std::make_exception_ptr(
+                    Exception("protocol error: no redirection to data node"));
+            }
+            if (!reply.error)
+            {
+                dataNodeUrls[i] = reply.redirectUrl;
+                toWrite.push_back(i);
+                return;
+            }
+            if (!error && repeatAfterFailover(reply.error, createNameNodes[i], failovers))
+            {
+                toCreate.push_front(i);
+                return;
+            }
+        }
+        else
+        {
+            --writing;
+            dataSources[i].reset();
+        }
+        if (reply.error && !error)
+        {
+            error = reply.error;
+        }
+    };
+
+    m_httpClient->makeConcurrently(nextRequest, requestDone, parallelism + createAhead);
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+void Client::readFile(const std::string &remotePath, std::ostream &dataSink,
+                      const ReadOptions &opts)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "readFile", remotePath);
+    withFailover([&]
+                 {
+                     HttpClient::Request req;
+                     req.type = HttpClient::Request::Type::GET;
+                     req.url = m_urlBuilder->makeUrl(remotePath, "OPEN", opts);
+                     req.followRedirect = true;
+                     req.pDataSink = &dataSink;
+                     req.expectedResponseCode = 200L;
+                     req.idempotent = true;
+                     m_httpClient->make(req);
+                 });
+}
+
+void Client::makeDir(const std::string &remoteDirPath, const MakeDirOptions &opts)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "makeDir", remoteDirPath);
+    HttpClient::Request req;
+    req.type = HttpClient::Request::Type::PUT;
+    req.expectedResponseCode = 200L;
+    req.idempotent = true;
+    std::ostringstream oss;
+    req.pDataSink = &oss;
+    req.buffered = true;
+    HttpClient::Reply reply;
+    withFailover([&]
+                 {
+                     req.url = m_urlBuilder->makeUrl(remoteDirPath, "MKDIRS", opts);
+                     oss.str("");
+                     reply = m_httpClient->make(req);
+                 });
+    if (reply.responseCode != req.expectedResponseCode || oss.str() != "{\"boolean\":true}")
+    {
+        std::stringstream err;
+        err << "can't create dir " << remoteDirPath << ", reply:" << oss.str();
+        throw Exception(err.str());
+    }
+}
+
+std::vector<FileStatus> Client::listDir(const std::string &remoteDirPath)
+{
+    std::vector<FileStatus> files;
+    listDir(remoteDirPath, [&files](const FileStatus &status)
+            {
+                files.push_back(status);
+                return true;
+            });
+    return files;
+}
+
+void Client::listDir(const std::string &remoteDirPath, const FileStatusHandler &handler)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "listDir", remoteDirPath);
+    FileStatusListParser parser(handler);
+    HttpClient::Request req;
+    req.type = HttpClient::Request::Type::GET;
+    req.expectedResponseCode = 200L;
+    req.idempotent = true;
+    req.followRedirect = true;
+    req.dataHandler = [&parser](const char *data, size_t size) { return parser.feed(data, size); };
+    try
+    {
+        withFailover([&]
+                     {
+                         req.url = m_urlBuilder->makeUrl(remoteDirPath, "LISTSTATUS");
+                         parser.reset();
+                         m_httpClient->make(req);
+                     });
+    }
+    catch (const Exception &)
+    {
+        // transfer is aborted when handler stops listing
+        if (!parser.aborted())
+        {
+            throw;
+        }
+    }
+    parser.finish();
+}
+
+std::vector<bool> Client::listDirs(const std::vector<std::string> &remoteDirPaths,
+                                   const DirEntryHandler &handler, size_t parallelism)
+{
+    const auto detail = std::to_string(remoteDirPaths.size()) + " dirs";
+    TraceSpan span(m_options.m_traceRecorder.get(), "listDirs", detail);
+    using Request = HttpClient::Request;
+    using Reply = HttpClient::Reply;
+
+    std::deque<size_t> toList;
+    for (size_t i = 0; i < remoteDirPaths.size(); ++i)
+    {
+        toList.push_back(i);
+    }
+    std::vector<bool> found(remoteDirPaths.size(), false);
+    std::vector<std::unique_ptr<FileStatusListParser>> parsers(remoteDirPaths.size());
+    std::vector<size_t> nameNodes(remoteDirPaths.size()); // namenode of LISTSTATUS request
+    size_t failovers = 0;
+    bool stopped = false;
+    std::exception_ptr error;
+
+    auto nextRequest = [&](Request &req, size_t &tag)
+    {
+        if (stopped || error || toList.empty())
+        {
+            return false;
+        }
+        const auto i = toList.front();
+        toList.pop_front();
+        parsers[i].reset(new FileStatusListParser([&handler, &stopped, i](const FileStatus &status)
+                                                  {
+                                                      stopped = stopped || !handler(i, status);
+                                                      return !stopped;
+                                                  }));
+        auto &parser = *parsers[i];
+        req.type = Request::Type::GET;
+        req.url = m_urlBuilder->makeUrl(remoteDirPaths[i], "LISTSTATUS");
+        req.expectedResponseCode = 200L;
+        req.followRedirect = true;
+        req.dataHandler = [&parser](const char *data, size_t size)
+        {
+            return parser.feed(data, size);
+        };
+        tag = i;
+        nameNodes[i] = m_activeNameNode;
+        return true;
+    };
+
+    auto requestDone = [&](size_t i, Reply &reply)
+    {
+        const auto &parser = *parsers[i];
+        if (reply.error && !parser.aborted())
+        {
+            if (!error && !stopped && repeatAfterFailover(reply.error, nameNodes[i], failovers))
+            {
+                toList.push_front(i);
+            }
+            else if (!error && !isNotFoundError(reply.error))
+            {
+                error = reply.error;
+            }
+            return;
+        }
+        try
+        {
+            parser.finish();
+            found[i] = true;
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    };
+
+    m_httpClient->makeConcurrently(nextRequest, requestDone, parallelism);
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    return found;
+}
+
+void Client::remove(const std::string &remotePath, const RemoveOptions &opts)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "remove", remotePath);
+    HttpClient::Request req;
+    req.type = HttpClient::Request::Type::DELETE;
+    req.expectedResponseCode = 200L;
+    std::ostringstream oss;
+    req.pDataSink = &oss;
+    req.buffered = true;
+    withFailover([&]
+                 {
+                     req.url = m_urlBuilder->makeUrl(remotePath, "DELETE", opts);
+                     oss.str("");
+                     m_httpClient->make(req);
+                 });
+    if (oss.str() != "{\"boolean\":true}")
+    {
+        throw Exception("Can't delete " + remotePath);
+    }
+}
+
+void Client::rename(const std::string &remotePath, const std::string &newRemotePath,
+                    bool overwrite)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "rename", remotePath);
+    HttpClient::Request req;
+    req.type = HttpClient::Request::Type::PUT;
+    req.expectedResponseCode = 200L;
+    std::ostringstream oss;
+    req.pDataSink = &oss;
+    req.buffered = true;
+    withFailover([&]
+                 {
+                     req.url = m_urlBuilder->makeUrl(remotePath, "RENAME") + "&destination=" +
+                               newRemotePath;
+                     if (overwrite)
+                     {
+                         req.url += "&renameoptions=OVERWRITE";
+                     }
+                     oss.str("");
+                     m_httpClient->make(req);
+                 });
+    // rename with options reports failures by exceptions only, its reply has no result
+    if (!overwrite && oss.str() != "{\"boolean\":true}")
+    {
+        throw Exception("Can't rename " + remotePath + " (invalid path)");
+    }
+}
+
+void Client::concat(const std::string &remoteFilePath,
+                    const std::vector<std::string> &remoteSourcePaths)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "concat", remoteFilePath);
+    if (remoteSourcePaths.empty())
+    {
+        return;
+    }
+    std::string sources;
+    for (const auto &path : remoteSourcePaths)
+    {
+        sources += (sources.empty() ? "" : ",") + UrlBuilder::urlEncode(path);
+    }
+    HttpClient::Request req;
+    req.type = HttpClient::Request::Type::POST;
+    req.expectedResponseCode = 200L;
+    withFailover([&]
+                 {
+                     req.url = m_urlBuilder->makeUrl(remoteFilePath, "CONCAT") + "&sources=" +
+                               sources;
+                     m_httpClient->make(req);
+                 });
+}
+
+std::vector<BlockLocation> Client::getFileBlockLocations(const std::string &remotePath,
+                                                         size_t offset, size_t length)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "getFileBlockLocations", remotePath);
+    HttpClient::Request req;
+    req.type = HttpClient::Request::Type::GET;
+    req.expectedResponseCode = 200L;
+    req.idempotent = true;
+    std::ostringstream oss;
+    req.pDataSink = &oss;
+    req.buffered = true;
+    withFailover([&]
+                 {
+                     req.url = m_urlBuilder->makeUrl(remotePath, "GETFILEBLOCKLOCATIONS") +
+                               "&offset=" + std::to_string(offset);
+                     if (length > 0)
+                     {
+                         req.url += "&length=" + std::to_string(length);
+                     }
+                     oss.str("");
+                     m_httpClient->make(req);
+                 });
+    std::vector<BlockLocation> blocks;
+    Json::Value locationsValue;
+    if (!tryParseJson(oss.str(), locationsValue))
+    {
+        throw Exception("Can't parse block locations");
+    }
+    auto items = locationsValue["BlockLocations"]["BlockLocation"];
+    for (auto it = items.begin(); it != items.end(); ++it)
+    {
+        BlockLocation block;
+        const auto &blockValue = *it;
+        block.offset = blockValue["offset"].asUInt64();
+        block.length = blockValue["length"].asUInt64();
+        block.corrupt = blockValue["corrupt"].asBool();
+        block.hosts = parseStrings(blockValue["hosts"]);
+        block.names = parseStrings(blockValue["names"]);
+        block.topologyPaths = parseStrings(blockValue["topologyPaths"]);
+        blocks.push_back(block);
+    }
+    return blocks;
+}
+
+void Client::readFileDirect(const std::string &remotePath, const RangeDataHandler &dataHandler,
+                            const DirectReadOptions &opts)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "readFileDirect", remotePath);
+    std::vector<BlockLocation> blocks;
+    if (tryGetFileBlockLocations(remotePath, opts.m_offset, opts.m_length, blocks))
+    {
+        const auto length = opts.m_length > 0 ? opts.m_length
+                                              : std::numeric_limits<size_t>::max() - opts.m_offset;
+        readBlocksDirect(remotePath, blocks, {FileRange{opts.m_offset, length}}, dataHandler,
+                         opts);
+    }
+    else
+    {
+        readRange(remotePath, dataHandler, opts.m_offset, opts.m_length);
+    }
+}
+
+bool Client::tryGetFileBlockLocations(const std::string &remotePath, size_t offset,
+                                      size_t length, std::vector<BlockLocation> &blocks)
+{
+    try
+    {
+        blocks = getFileBlockLocations(remotePath, offset, length);
+        return true;
+    }
+    catch (const RemoteException &error)
+    {
+        // no GETFILEBLOCKLOCATIONS support
+        if (error.type() == "IllegalArgumentException" ||
+            error.type() == "UnsupportedOperationException")
+        {
+            return false;
+        }
+        throw;
+    }
+}
+
+void Client::readRange(const std::string &remotePath, const RangeDataHandler &dataHandler,
+                       size_t offset, size_t length)
+{
+    ReadOptions readOpts;
+    readOpts.setOffset(offset);
+    if (length > 0)
+    {
+        readOpts.setLength(length);
+    }
+    withFailover([&]
+                 {
+                     auto position = offset;
+                     HttpClient::Request req;
+                     req.type = HttpClient::Request::Type::GET;
+                     req.url = m_urlBuilder->makeUrl(remotePath, "OPEN", readOpts);
+                     req.followRedirect = true;
+                     req.dataHandler = [&](const char *data, size_t size)
+                     {
+                         const auto pieceOffset = position;
+                         position += size;
+                         return dataHandler(pieceOffset, data, size);
+                     };
+                     req.expectedResponseCode = 200L;
+                     req.idempotent = true;
+                     m_httpClient->make(req);
+                 });
+}
+
+std::string Client::getDataNodeUrlTemplate(const std::string &remotePath, size_t offset)
+{
+    HttpClient::Reply reply;
+    withFailover([&]
+                 {
+                     HttpClient::Request req;
+                     req.type = HttpClient::Request::Type::GET;
+                     req.url = m_urlBuilder->makeUrl(remotePath, "OPEN") + "&offset=" +
+                               std::to_string(offset);
+                     req.expectedResponseCode = 307L;
+                     req.idempotent = true;
+                     reply = m_httpClient->make(req);
+                 });
+    if (reply.redirectUrl.empty())
+    {
+        throw Exception("protocol error: no redirection to data node");
+    }
+    return reply.redirectUrl;
+}
+
+std::vector<std::exception_ptr> Client::getData(const std::vector<TransportRequest> &requests,
+                                               size_t maxParallel)
+{
+    if (m_options.m_transport)
+    {
+        return m_options.m_transport->get(requests, maxParallel);
+    }
+    std::vector<HttpClient::Request> reqs;
+    for (const auto &request : requests)
+    {
+        HttpClient::Request req;
+        req.type = HttpClient::Request::Type::GET;
+        req.url = request.url;
+        req.dataHandler = request.dataHandler;
+        req.expectedResponseCode = 200L;
+        reqs.push_back(req);
+    }
+    const auto replies = m_httpClient->makeMany(reqs, maxParallel);
+    std::vector<std::exception_ptr> errors;
+    for (const auto &reply : replies)
+    {
+        errors.push_back(reply.error);
+    }
+    return errors;
+}
+
+void Client::readBlocksDirect(const std::string &remotePath,
+                              const std::vector<BlockLocation> &blocks,
+                              const std::vector<FileRange> &segments,
+                              const RangeDataHandler &dataHandler, const DirectReadOptions &opts)
+{
+    // file ranges to read (blocks clipped to requested segments) and their replicas
+    struct Range
+    {
+        size_t position; // next byte to read
+        size_t end;
+        std::vector<std::string> replicas; // in order of preference
+        size_t replica;
+    };
+    std::vector<Range> ranges;
+    std::map<std::string, size_t> hostLoad; // ranges assigned to hosts
+    for (const auto &block : blocks)
+    {
+        if (block.hosts.empty())
         {
-        case Request::Type::GET:
-            checkCurl(curl_easy_setopt(m_curl, CURLOPT_HTTPGET, 1L));
-            setHttpHeaders({"Expect:"});
-            break;
-        case Request::Type::PUT:
-            checkCurl(curl_easy_setopt(m_curl, CURLOPT_UPLOAD, 1L));
-            if (req.pDataSource == nullptr)
+            continue;
+        }
+        // preference rank: 0 - preferred host, 1 - preferred rack, 2 - others
+        std::vector<std::pair<size_t, std::string>> replicas;
+        for (size_t i = 0; i < block.hosts.size(); ++i)
+        {
+            const auto &host = block.hosts[i];
+            const auto rack = i < block.topologyPaths.size() ? getRack(block.topologyPaths[i])
+                                                             : std::string();
+            size_t rank = 2;
+            if (std::find(opts.m_preferredHosts.begin(), opts.m_preferredHosts.end(), host) !=
+                opts.m_preferredHosts.end())
             {
-                checkCurl(curl_easy_setopt(m_curl, CURLOPT_INFILESIZE, 0));
-                setHttpHeaders({"Expect:", "Transfer-Encoding:"});
+                rank = 0;
             }
-            else
+            else if (std::find(opts.m_preferredRacks.begin(), opts.m_preferredRacks.end(),
+                               rack) != opts.m_preferredRacks.end())
             {
-                checkCurl(curl_easy_setopt(m_curl, CURLOPT_INFILESIZE, -1));
-                setHttpHeaders({"Expect:", "Transfer-Encoding: chunked"});
+                rank = 1;
             }
-            break;
-        case Request::Type::POST:
-            throw Exception("Post requests not implemented");
-            break;
-        case Request::Type::DELETE:
-            checkCurl(curl_easy_setopt(m_curl, CURLOPT_HTTPGET, 1L));
-            checkCurl(curl_easy_setopt(m_curl, CURLOPT_CUSTOMREQUEST, "DELETE"));
-            setHttpHeaders({"Expect:", "Transfer-Encoding:", "Content-Length:"});
-            break;
-        }
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_WRITEFUNCTION, ReplyHandler::writeCallback));
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_WRITEDATA, &replyHandler));
-        if (req.pDataSource != nullptr)
-        {
-            checkCurl(curl_easy_setopt(m_curl, CURLOPT_READFUNCTION, streamReadCallback));
-            checkCurl(curl_easy_setopt(m_curl, CURLOPT_READDATA, req.pDataSource));
+            replicas.push_back(std::make_pair(rank, host));
         }
-
-        auto curlCode = curl_easy_perform(m_curl);
-
-        if (curlCode != CURLE_OK)
+        for (const auto &segment : segments)
         {
-            // special errors handling to catch errors in client callbacks, indicated by
-            // RESPONSE_CODE_CLIENT_ERROR response code.
-            if (reply.responseCode == Reply::RESPONSE_CODE_CLIENT_ERROR)
+            Range range{std::max(block.offset, segment.offset),
+                        std::min(block.offset + block.length, segment.offset + segment.length),
+                        {}, 0};
+            if (range.position >= range.end)
             {
-                throw Exception(reply.clientError);
+                continue;
             }
-            // main error handling
-            else
+            // spread ranges over datanodes with the same rank
+            std::stable_sort(replicas.begin(), replicas.end(),
+                             [&](const std::pair<size_t, std::string> &a,
+                                 const std::pair<size_t, std::string> &b)
+                             {
+                                 return a.first != b.first
+                                            ? a.first < b.first
+                                            : hostLoad[a.second] < hostLoad[b.second];
+                             });
+            ++hostLoad[replicas.front().second];
+            for (const auto &replica : replicas)
             {
-                checkCurl(curlCode);
+                range.replicas.push_back(replica.second);
             }
+            ranges.push_back(range);
         }
+    }
+    if (ranges.empty())
+    {
+        return;
+    }
 
-        checkCurl(curl_easy_getinfo(m_curl, CURLINFO_RESPONSE_CODE, &reply.responseCode));
-        if (!req.followRedirect)
+    const auto urlTemplate = getDataNodeUrlTemplate(remotePath, ranges.front().position);
+
+    bool aborted = false;
+    std::vector<size_t> pending(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        pending[i] = i;
+    }
+    while (!pending.empty())
+    {
+        std::vector<TransportRequest> reqs;
+        for (auto i : pending)
         {
-            const char *redirectUrl;
-            checkCurl(curl_easy_getinfo(m_curl, CURLINFO_REDIRECT_URL, &redirectUrl));
-            if (redirectUrl)
+            auto &range = ranges[i];
+            TransportRequest req;
+            req.url = makeDataNodeReadUrl(urlTemplate, range.replicas[range.replica],
+                                          range.position, range.end - range.position);
+            req.dataHandler = [&range, &aborted, &dataHandler](const char *data, size_t size)
             {
-                reply.redirectUrl = redirectUrl;
-            }
+                const auto pieceOffset = range.position;
+                range.position += size;
+                aborted = !dataHandler(pieceOffset, data, size);
+                return !aborted;
+            };
+            reqs.push_back(req);
         }
+        const auto errors = getData(reqs, opts.m_parallelism);
 
-        // check remote error
-        if (reply.responseCode != req.expectedResponseCode)
+        // resume failed ranges from other replicas
+        std::vector<size_t> failed;
+        for (size_t j = 0; j < errors.size(); ++j)
         {
-            RemoteError remoteError;
-            if (tryParseRemoteError(reply.unexpectedResponseContent, remoteError))
+            if (!errors[j])
             {
-                throw Exception("remote error: " + remoteError.message);
+                continue;
             }
-            else
+            auto &range = ranges[pending[j]];
+            if (aborted || ++range.replica == range.replicas.size())
             {
-                std::stringstream err;
-                err << "unexpected server response code: " << reply.responseCode;
-                if (!reply.unexpectedResponseContent.empty())
-                {
-                    err << " (" << reply.unexpectedResponseContent << ")";
-                }
-                throw Exception(err.str());
+                std::rethrow_exception(errors[j]);
             }
+            failed.push_back(pending[j]);
         }
-        return reply;
+        pending.swap(failed);
     }
+}
 
+void Client::downloadToFile(const std::string &remotePath, const std::string &localPath,
+                            const DownloadOptions &opts)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "downloadToFile", remotePath);
+    std::vector<BlockLocation> blocks;
+    const auto direct = tryGetFileBlockLocations(remotePath, 0, 0, blocks);
+    size_t length = 0;
+    auto aligned = true;
+    for (const auto &block : blocks)
+    {
+        length = std::max(length, block.offset + block.length);
+        aligned = aligned && block.offset % LocalFileWriter::DIRECT_IO_ALIGNMENT == 0;
+    }
+    const auto directIo = direct && aligned && opts.m_directIoThreshold > 0 &&
+                          length >= opts.m_directIoThreshold;
 
-private:
-    void setHttpHeaders(const std::vector<std::string> &headers = std::vector<std::string>())
+    LocalFileWriter file(localPath, length, directIo);
+    const auto dataHandler = [&file](size_t offset, const char *data, size_t size)
     {
-        // reset headers to default ones
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, nullptr));
+        return file.write(offset, data, size);
+    };
+    try
+    {
+        if (direct)
+        {
+            readBlocksDirect(remotePath, blocks, {FileRange{0, length}}, dataHandler,
+                             opts.m_readOptions);
+        }
+        else
+        {
+            readRange(remotePath, dataHandler, 0, 0);
+        }
+    }
+    catch (const Exception &)
+    {
+        if (!file.error().empty())
+        {
+            throw Exception(file.error());
+        }
+        throw;
+    }
+    file.commit(opts.m_sync);
+}
 
-        curl_slist *headersRaw = NULL;
-        for (const auto &header : headers)
+void Client::readRanges(const std::string &remotePath, const std::vector<FileRange> &ranges,
+                        const FileRangeHandler &handler, const RangeReadOptions &opts)
+{
+    TraceSpan span(m_options.m_traceRecorder.get(), "readRanges", remotePath);
+
+    // requested ranges covered by one read, buffered until all their bytes are received
+    struct MergedRange
+    {
+        size_t offset;
+        size_t end;
+        std::vector<size_t> ranges; // indices of requested ranges
+        std::string buffer;
+        size_t received;
+    };
+    std::vector<size_t> order(ranges.size());
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&ranges](size_t a, size_t b)
+              {
+                  return ranges[a].offset < ranges[b].offset;
+              });
+    std::vector<MergedRange> merged;
+    for (const auto i : order)
+    {
+        const auto &range = ranges[i];
+        if (range.length == 0)
         {
-            headersRaw = curl_slist_append(headersRaw, header.c_str());
-            if (headersRaw == nullptr)
+            if (!handler(i, "", 0))
             {
-                throw Exception("libcurl request headers setup failed");
+                return;
             }
+            continue;
+        }
+        const auto end = range.offset + range.length;
+        // overlapping ranges are always merged, so merged ranges don't overlap
+        if (!merged.empty() &&
+            (range.offset < merged.back().end ||
+             (range.offset - merged.back().end <= opts.m_maxGap &&
+              end - merged.back().offset <= opts.m_maxMergedSize)))
+        {
+            merged.back().end = std::max(merged.back().end, end);
+            merged.back().ranges.push_back(i);
+        }
+        else
+        {
+            merged.push_back(MergedRange{range.offset, end, {i}, std::string(), 0});
         }
-        m_activeHttpHeaders.reset(headersRaw, curl_slist_free_all);
-        checkCurl(curl_easy_setopt(m_curl, CURLOPT_HTTPHEADER, m_activeHttpHeaders.get()));
     }
-
-    static size_t streamReadCallback(char *buffer, size_t size, size_t nitems, void *userdata)
+    if (merged.empty())
     {
-        auto pIStream = static_cast<std::istream *>(userdata);
-        const auto dataSize = size * nitems;
-        pIStream->read(buffer, dataSize);
-        return pIStream->gcount();
+        return;
     }
 
-    struct ReplyHandler
+    // merged ranges are read in batches whose buffers are acquired from memory budget
+    // beforehand, a buffer is released when its ranges are delivered
+    const auto budget = m_options.m_memoryBudget.get();
+    size_t charged = 0;
+    auto releaseCharged = [&](size_t bytes)
     {
-        Reply &reply;
-        const long expectedResponseCodes;
-        std::ostream *pDataSink;
-        CURL *curl;
-
-        static size_t writeCallback(char *buffer, size_t size, size_t nitems, void *userData)
+        if (budget && bytes > 0)
         {
-            auto self = static_cast<ReplyHandler *>(userData);
-            auto &reply = self->reply;
-            auto pDataSink = self->pDataSink;
-            const auto dataSize = size * nitems;
+            budget->release(bytes);
+            charged -= bytes;
+        }
+    };
 
-            if (reply.responseCode == 0 &&
-                curl_easy_getinfo(self->curl, CURLINFO_RESPONSE_CODE, &reply.responseCode) !=
-                    CURLE_OK)
+    bool stopped = false;
+    const auto dataHandler = [&](size_t offset, const char *data, size_t size)
+    {
+        // pieces don't cross merged ranges bounds (they are read as separate segments)
+        auto &range = *(std::upper_bound(merged.begin(), merged.end(), offset,
+                                         [](size_t pieceOffset, const MergedRange &item)
+                                         {
+                                             return pieceOffset < item.offset;
+                                         }) -
+                        1);
+        if (range.buffer.empty())
+        {
+            range.buffer.resize(range.end - range.offset);
+        }
+        std::copy(data, data + size, &range.buffer[offset - range.offset]);
+        range.received += size;
+        if (range.received < range.buffer.size())
+        {
+            return true;
+        }
+        for (const auto i : range.ranges)
+        {
+            if (!handler(i, range.buffer.data() + (ranges[i].offset - range.offset),
+                         ranges[i].length))
             {
-                reply.responseCode = Reply::RESPONSE_CODE_CLIENT_ERROR;
-                reply.clientError = "libcurl getinfo failed";
-                return 0;
+                stopped = true;
+                return false;
             }
+        }
+        std::string().swap(range.buffer);
+        releaseCharged(range.end - range.offset);
+        return true;
+    };
 
-            if (self->expectedResponseCodes != reply.responseCode)
+    const auto offset = merged.front().offset;
+    const auto length = merged.back().end - offset;
+    std::vector<BlockLocation> blocks;
+    const bool direct = tryGetFileBlockLocations(remotePath, offset, length, blocks);
+    // batch takes at most half of the budget, so concurrent reads can proceed
+    const auto batchLimit = budget ? std::max<size_t>(budget->stats().limit / 2, 1)
+                                   : std::numeric_limits<size_t>::max();
+    for (size_t first = 0; first < merged.size() && !stopped;)
+    {
+        std::vector<FileRange> segments;
+        size_t batchSize = 0;
+        for (; first < merged.size(); ++first)
+        {
+            const auto size = merged[first].end - merged[first].offset;
+            if (!segments.empty() && batchSize + size > batchLimit)
             {
-                reply.unexpectedResponseContent.append(buffer, dataSize);
+                break;
+            }
+            segments.push_back(FileRange{merged[first].offset, size});
+            batchSize += size;
+        }
+        if (budget)
+        {
+            budget->acquire(batchSize);
+            charged = batchSize;
+        }
+        try
+        {
+            if (direct)
+            {
+                readBlocksDirect(remotePath, blocks, segments, dataHandler, opts.m_readOptions);
             }
-            else if (pDataSink != nullptr)
+            else
             {
-                pDataSink->write(buffer, dataSize);
-                if (!pDataSink->good())
+                for (const auto &segment : segments)
                 {
-                    return 0;
+                    readRange(remotePath, dataHandler, segment.offset, segment.length);
                 }
             }
-            return dataSize;
         }
-    };
-};
-
-Client::Client(const std::string &host, int port, const ClientOptions &opts)
-    : m_urlBuilder(new UrlBuilder(host, port, opts.m_userName))
-    , m_httpClient(new HttpClient)
-
-{
-    if (opts.m_connectionTimeout > 0)
-    {
-        m_httpClient->setConnectTimeout(opts.m_connectionTimeout);
+        catch (const Exception &)
+        {
+            releaseCharged(charged);
+            // transfer is aborted when handler stops reading
+            if (!stopped)
+            {
+                throw;
+            }
+        }
+        catch (...)
+        {
+            releaseCharged(charged);
+            throw;
+        }
+        // buffers of ranges not received completely (beyond the end of file)
+        releaseCharged(charged);
     }
-
-    if (opts.m_dataTransferTimeout > 0)
+    if (stopped)
     {
-        m_httpClient->setDataTranfserTimeout(opts.m_dataTransferTimeout);
+        return;
     }
-}
-
-Client::Client(const std::string &host, const ClientOptions &opts)
-    : Client(host, 50070, opts)
-{
-}
-
-
-Client::~Client() = default;
-
-Client::Client(Client &&) = default;
-
-Client& Client::operator=(Client &&)=default;
-
-void Client::writeFile(std::istream &dataSource, const std::string &remotePath,
-                       const WriteOptions &opts)
-{
-    using Request = HttpClient::Request;
-    // Step 1. Get dataNodeUrl.
-    Request req1;
-    req1.type = Request::Type::PUT;
-    req1.url = m_urlBuilder->makeUrl(remotePath, "CREATE", opts);
-    req1.expectedResponseCode = 307L;
-    auto reply = m_httpClient->make(req1);
-    if (reply.redirectUrl.empty())
+    for (const auto &range : merged)
     {
-        throw Exception("protocol error: no redirection to data node");
+        if (range.received < range.end - range.offset)
+        {
+            throw Exception("range up to " + std::to_string(range.end) +
+                            " is beyond the end of file " + remotePath);
+        }
     }
-
-    // Step 2. Put data
-    Request req2;
-    req2.type = Request::Type::PUT;
-    req2.url = reply.redirectUrl;
-    req2.pDataSource = &dataSource;
-    req2.expectedResponseCode = 201L;
-    m_httpClient->make(req2);
 }
 
-void Client::readFile(const std::string &remotePath, std::ostream &dataSink,
-                      const ReadOptions &opts)
+FileStatus Client::getFileStatus(const std::string &remotePath)
 {
+    TraceSpan span(m_options.m_traceRecorder.get(), "getFileStatus", remotePath);
     HttpClient::Request req;
     req.type = HttpClient::Request::Type::GET;
-    req.url = m_urlBuilder->makeUrl(remotePath, "OPEN", opts);
-    req.followRedirect = true;
-    req.pDataSink = &dataSink;
-    req.expectedResponseCode = 200L;
-    m_httpClient->make(req);
-}
-
-void Client::makeDir(const std::string &remoteDirPath, const MakeDirOptions &opts)
-{
-    HttpClient::Request req;
-    req.type = HttpClient::Request::Type::PUT;
-    req.url = m_urlBuilder->makeUrl(remoteDirPath, "MKDIRS", opts);
     req.expectedResponseCode = 200L;
+    req.idempotent = true;
     std::ostringstream oss;
     req.pDataSink = &oss;
-    auto reply = m_httpClient->make(req);
-    if (reply.responseCode != req.expectedResponseCode || oss.str() != "{\"boolean\":true}")
+    req.buffered = true;
+    withFailover([&]
+                 {
+                     req.url = m_urlBuilder->makeUrl(remotePath, "GETFILESTATUS");
+                     oss.str("");
+                     m_httpClient->make(req);
+                 });
+    Json::Value statusValue;
+    if (!tryParseJson(oss.str(), statusValue) || !statusValue.isMember("FileStatus"))
     {
-        std::stringstream err;
-        err << "can't create dir " << remoteDirPath << ", reply:" << oss.str();
-        throw Exception(err.str());
+        throw Exception("Can't parse file status");
     }
+    return parseFileStatus(statusValue["FileStatus"]);
 }
 
-std::vector<FileStatus> Client::listDir(const std::string &remoteDirPath)
+std::vector<bool> Client::getFileStatuses(const std::vector<std::string> &remotePaths,
+                                          std::vector<FileStatus> &statuses, size_t parallelism)
 {
-    HttpClient::Request req;
-    req.type = HttpClient::Request::Type::GET;
-    req.url = m_urlBuilder->makeUrl(remoteDirPath, "LISTSTATUS");
-    req.expectedResponseCode = 200L;
-    req.followRedirect = true;
-    std::ostringstream oss;
-    req.pDataSink = &oss;
-    m_httpClient->make(req);
-    std::vector<FileStatus> files;
-    Json::Value listingValue;
-    if (tryParseJson(oss.str(), listingValue))
-    {
-        auto items = listingValue["FileStatuses"]["FileStatus"];
-        for (auto it = items.begin(); it != items.end(); ++it)
-        {
-            FileStatus status;
-            const auto &statusValue = *it;
-            status.accessTime = statusValue["accessTime"].asInt64();
-            status.blockSize = statusValue["blockSize"].asUInt64();
-            status.group = statusValue["group"].asString();
-            status.length = statusValue["length"].asUInt64();
-            status.modificationTime = statusValue["modificationTime"].asInt64();
-            status.owner = statusValue["owner"].asString();
-            status.pathSuffix = statusValue["pathSuffix"].asString();
-            status.permission = statusValue["permission"].asString();
-            status.replication = statusValue["replication"].asInt();
-            auto typeStr = statusValue["type"].asString();
-            status.type = typeStr.compare("FILE") == 0 ? FileStatus::PathObjectType::FILE
-                                                       : FileStatus::PathObjectType::DIRECTORY;
-            files.push_back(status);
-        }
-    }
-    else
+    const auto detail = std::to_string(remotePaths.size()) + " paths";
+    TraceSpan span(m_options.m_traceRecorder.get(), "getFileStatuses", detail);
+    using Request = HttpClient::Request;
+    using Reply = HttpClient::Reply;
+
+    std::deque<size_t> toGet;
+    for (size_t i = 0; i < remotePaths.size(); ++i)
     {
-        throw Exception("Can't parse dir listing");
+        toGet.push_back(i);
     }
-    return files;
-}
+    std::vector<bool> found(remotePaths.size(), false);
+    statuses.assign(remotePaths.size(), FileStatus());
+    std::vector<std::unique_ptr<std::ostringstream>> sinks(remotePaths.size());
+    std::vector<size_t> nameNodes(remotePaths.size()); // namenode of GETFILESTATUS request
+    size_t failovers = 0;
+    std::exception_ptr error;
+
+    auto nextRequest = [&](Request &req, size_t &tag)
+    {
+        if (error || toGet.empty())
+        {
+            return false;
+        }
+        const auto i = toGet.front();
+        toGet.pop_front();
+        sinks[i].reset(new std::ostringstream);
+        req.type = Request::Type::GET;
+        req.url = m_urlBuilder->makeUrl(remotePaths[i], "GETFILESTATUS");
+        req.expectedResponseCode = 200L;
+        req.pDataSink = sinks[i].get();
+        req.buffered = true;
+        tag = i;
+        nameNodes[i] = m_activeNameNode;
+        return true;
+    };
 
-void Client::remove(const std::string &remotePath, const RemoveOptions &opts)
-{
-    HttpClient::Request req;
-    req.type = HttpClient::Request::Type::DELETE;
-    req.url = m_urlBuilder->makeUrl(remotePath, "DELETE", opts);
-    req.expectedResponseCode = 200L;
-    std::ostringstream oss;
-    req.pDataSink = &oss;
-    m_httpClient->make(req);
-    if (oss.str() != "{\"boolean\":true}")
+    auto requestDone = [&](size_t i, Reply &reply)
     {
-        throw Exception("Can't delete " + remotePath);
+        if (reply.error)
+        {
+            if (!error && repeatAfterFailover(reply.error, nameNodes[i], failovers))
+            {
+                toGet.push_front(i);
+            }
+            else if (!error && !isNotFoundError(reply.error))
+            {
+                error = reply.error;
+            }
+            return;
+        }
+        Json::Value statusValue;
+        if (!tryParseJson(sinks[i]->str(), statusValue) || !statusValue.isMember("FileStatus"))
+        {
+            if (!error)
+            {
+                error = std::make_exception_ptr(Exception("Can't parse file status"));
+            }
+            return;
+        }
+        statuses[i] = parseFileStatus(statusValue["FileStatus"]);
+        found[i] = true;
+        sinks[i].reset();
+    };
+
+    m_httpClient->makeConcurrently(nextRequest, requestDone, parallelism);
+    if (error)
+    {
+        std::rethrow_exception(error);
     }
+    return found;
 }
 
-void Client::rename(const std::string &remotePath, const std::string &newRemotePath)
+ContentSummary Client::getContentSummary(const std::string &remotePath)
 {
+    TraceSpan span(m_options.m_traceRecorder.get(), "getContentSummary", remotePath);
     HttpClient::Request req;
-    req.type = HttpClient::Request::Type::PUT;
-    req.url = m_urlBuilder->makeUrl(remotePath, "RENAME") + "&destination=" + newRemotePath;
+    req.type = HttpClient::Request::Type::GET;
     req.expectedResponseCode = 200L;
+    req.idempotent = true;
     std::ostringstream oss;
     req.pDataSink = &oss;
-    m_httpClient->make(req);
-    if (oss.str() != "{\"boolean\":true}")
+    req.buffered = true;
+    withFailover([&]
+                 {
+                     req.url = m_urlBuilder->makeUrl(remotePath, "GETCONTENTSUMMARY");
+                     oss.str("");
+                     m_httpClient->make(req);
+                 });
+    Json::Value summaryValue;
+    if (!tryParseJson(oss.str(), summaryValue) || !summaryValue.isMember("ContentSummary"))
     {
-        throw Exception("Can't rename " + remotePath + " (invalid path)");
+        throw Exception("Can't parse content summary");
     }
+    const auto &value = summaryValue["ContentSummary"];
+    ContentSummary summary;
+    summary.directoryCount = value["directoryCount"].asUInt64();
+    summary.fileCount = value["fileCount"].asUInt64();
+    summary.length = value["length"].asUInt64();
+    summary.quota = value["quota"].asInt64();
+    summary.spaceConsumed = value["spaceConsumed"].asUInt64();
+    summary.spaceQuota = value["spaceQuota"].asInt64();
+    return summary;
 }
 
 
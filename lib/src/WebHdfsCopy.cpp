@@ -0,0 +1,542 @@
+/**
+ * @file
+ * @brief  Streaming copy of files between clusters
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#include "WebHdfsCopy.h"
+
+
+namespace WebHDFS
+{
+
+CopyOptions::CopyOptions()
+    : m_writeOptions()
+    , m_readOptions()
+    , m_parallelism(4)
+    , m_rangeSize(256 << 20)
+    , m_bufferSize(4 << 20)
+{
+}
+
+CopyOptions &CopyOptions::setWriteOptions(const WriteOptions &writeOptions)
+{
+    m_writeOptions = writeOptions;
+    return *this;
+}
+
+CopyOptions &CopyOptions::setReadOptions(const DirectReadOptions &readOptions)
+{
+    m_readOptions = readOptions;
+    return *this;
+}
+
+CopyOptions &CopyOptions::setParallelism(size_t pipes)
+{
+    m_parallelism = pipes;
+    return *this;
+}
+
+CopyOptions &CopyOptions::setRangeSize(size_t bytes)
+{
+    m_rangeSize = bytes;
+    return *this;
+}
+
+CopyOptions &CopyOptions::setBufferSize(size_t bytes)
+{
+    m_bufferSize = bytes;
+    return *this;
+}
+
+
+namespace
+{
+
+/* bounded ring of bytes between source read (producer) and destination write (consumer),
+ * consumer reads it as stream buffer right from the ring */
+class Pipe : public std::streambuf
+{
+public:
+    explicit Pipe(size_t capacity)
+        : m_ring(std::max<size_t>(capacity, 1))
+        , m_head(0)
+        , m_size(0)
+        , m_finished(false)
+        , m_abandoned(false)
+    {
+    }
+
+    /* put data, waits for free space, returns false if consumer stopped reading */
+    bool put(const char *data, size_t size)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (size > 0)
+        {
+            m_changed.wait(lock, [&]
+                           {
+                               return m_abandoned || m_size < m_ring.size();
+                           });
+            if (m_abandoned)
+            {
+                return false;
+            }
+            const auto tail = (m_head + m_size) % m_ring.size();
+            const auto n = std::min(size, std::min(m_ring.size() - m_size,
+                                                   m_ring.size() - tail));
+            // consumer never touches free space, so it's filled without lock
+            lock.unlock();
+            std::memcpy(&m_ring[tail], data, n);
+            lock.lock();
+            m_size += n;
+            data += n;
+            size -= n;
+            m_changed.notify_all();
+        }
+        return true;
+    }
+
+    /* end of data, consumer fails with the error (if it still reads) */
+    void finish(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_finished = true;
+        if (!m_abandoned)
+        {
+            m_error = error;
+        }
+        m_changed.notify_all();
+    }
+
+    /* stop reading, waiting producer is released */
+    void abandon()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_abandoned = true;
+        m_changed.notify_all();
+    }
+
+    /* producer error that made consumer fail */
+    std::exception_ptr error()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_error;
+    }
+
+protected:
+    int_type underflow() override
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const auto consumed = static_cast<size_t>(gptr() - eback());
+        m_head = (m_head + consumed) % m_ring.size();
+        m_size -= consumed;
+        setg(nullptr, nullptr, nullptr);
+        m_changed.notify_all();
+        m_changed.wait(lock, [&]
+                       {
+                           return m_size > 0 || m_finished;
+                       });
+        // error is thrown to istream, which sets badbit and so aborts the upload
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+        if (m_size == 0)
+        {
+            return traits_type::eof();
+        }
+        const auto begin = &m_ring[m_head];
+        setg(begin, begin, begin + std::min(m_size, m_ring.size() - m_head));
+        return traits_type::to_int_type(*begin);
+    }
+
+private:
+    std::vector<char> m_ring;
+    size_t m_head; // offset of the first byte of data
+    size_t m_size; // data size (including consumer get area)
+    bool m_finished;
+    bool m_abandoned;
+    std::exception_ptr m_error;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+};
+
+std::string partPath(const std::string &dstPath, size_t range)
+{
+    return dstPath + "._COPYING_." + std::to_string(range);
+}
+
+/* memory acquired from budget (if any) for lifetime of the object */
+class BudgetCharge
+{
+public:
+    BudgetCharge(const std::shared_ptr<MemoryBudget> &budget, size_t bytes)
+        : m_budget(budget)
+        , m_bytes(bytes)
+    {
+        if (m_budget)
+        {
+            m_budget->acquire(m_bytes);
+        }
+    }
+
+    ~BudgetCharge()
+    {
+        if (m_budget)
+        {
+            m_budget->release(m_bytes);
+        }
+    }
+
+    BudgetCharge(const BudgetCharge &) = delete;
+    BudgetCharge &operator=(const BudgetCharge &) = delete;
+
+private:
+    const std::shared_ptr<MemoryBudget> m_budget;
+    const size_t m_bytes;
+};
+
+} // namespace
+
+
+/* copy of files by pool of workers, every worker pipes one range at a time */
+class Copier
+{
+public:
+    Copier(const Client &srcClient, const Client &dstClient, const CopyOptions &opts)
+        : m_srcClient(srcClient)
+        , m_dstClient(dstClient)
+        , m_opts(opts)
+    {
+    }
+
+    void copy(const std::vector<CopyFile> &paths)
+    {
+        plan(paths);
+        std::vector<std::thread> workers;
+        const auto workersCount =
+            std::min(std::max<size_t>(m_opts.m_parallelism, 1), m_ranges.size());
+        try
+        {
+            for (size_t i = 0; i < workersCount; ++i)
+            {
+                workers.push_back(std::thread(&Copier::work, this, m_srcClient.clone(),
+                                              m_dstClient.clone()));
+            }
+        }
+        catch (...)
+        {
+            fail(std::current_exception());
+        }
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+        if (m_error)
+        {
+            removeParts();
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    struct File
+    {
+        CopyFile paths;
+        size_t length = 0;
+        size_t blockSize = 0;
+        size_t rangeSize = 0;
+        size_t ranges = 0;
+        size_t rangesLeft = 0;
+        std::vector<bool> started; // ranges whose part files could be created
+        bool replace = false;      // destination file exists and is overwritten
+        bool concatenated = false; // first part file keeps all data
+        bool failed = false;
+        bool done = false;
+    };
+
+    struct Range
+    {
+        size_t file;
+        size_t index;
+    };
+
+    /* get source files sizes and split large ones to ranges, check destination files */
+    void plan(const std::vector<CopyFile> &paths)
+    {
+        std::vector<std::string> srcPaths;
+        std::vector<std::string> dstPaths;
+        for (const auto &item : paths)
+        {
+            srcPaths.push_back(item.srcPath);
+            dstPaths.push_back(item.dstPath);
+        }
+        std::vector<FileStatus> statuses;
+        auto srcClient = m_srcClient.clone();
+        const auto found = srcClient.getFileStatuses(srcPaths, statuses);
+        std::vector<FileStatus> dstStatuses;
+        auto dstClient = m_dstClient.clone();
+        const auto dstFound = dstClient.getFileStatuses(dstPaths, dstStatuses);
+        const auto overwrite = m_opts.m_writeOptions.overwrite();
+        for (size_t i = 0; i < paths.size(); ++i)
+        {
+            if (!found[i])
+            {
+                throw Exception("can't copy " + paths[i].srcPath + ": file does not exist");
+            }
+            if (statuses[i].type != FileStatus::PathObjectType::FILE)
+            {
+                throw Exception("can't copy " + paths[i].srcPath + ": not a file");
+            }
+            if (dstFound[i] && (!overwrite ||
+                                dstStatuses[i].type != FileStatus::PathObjectType::FILE))
+            {
+                throw Exception("can't copy to " + paths[i].dstPath + ": path already exists");
+            }
+            File file;
+            file.paths = paths[i];
+            file.replace = dstFound[i];
+            file.length = statuses[i].length;
+            file.blockSize = statuses[i].blockSize;
+            const auto blockSize = std::max<size_t>(file.blockSize, 1);
+            file.rangeSize = m_opts.m_rangeSize == 0
+                                 ? file.length
+                                 : (m_opts.m_rangeSize + blockSize - 1) / blockSize * blockSize;
+            file.ranges = file.length <= file.rangeSize
+                              ? 1
+                              : (file.length + file.rangeSize - 1) / file.rangeSize;
+            file.rangesLeft = file.ranges;
+            file.started.resize(file.ranges);
+            for (size_t range = 0; range < file.ranges; ++range)
+            {
+                m_ranges.push_back(Range{m_files.size(), range});
+            }
+            m_files.push_back(file);
+        }
+    }
+
+    /* worker thread routine */
+    void work(Client srcClient, Client dstClient)
+    {
+        for (;;)
+        {
+            Range range;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_error || m_ranges.empty())
+                {
+                    return;
+                }
+                range = m_ranges.front();
+                m_ranges.pop_front();
+                m_files[range.file].started[range.index] = true;
+            }
+            auto &file = m_files[range.file];
+
+            std::exception_ptr error;
+            try
+            {
+                copyRange(srcClient, dstClient, file, range.index);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            bool copied = false;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                file.failed = file.failed || error;
+                copied = --file.rangesLeft == 0 && !file.failed;
+            }
+            if (error)
+            {
+                fail(error);
+                continue;
+            }
+            if (!copied)
+            {
+                continue;
+            }
+            try
+            {
+                complete(dstClient, file);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                file.done = true;
+            }
+            catch (...)
+            {
+                fail(std::current_exception());
+            }
+        }
+    }
+
+    /* join part files of copied file into the first one and move it to destination path */
+    void complete(Client &dstClient, File &file)
+    {
+        std::vector<std::string> parts;
+        for (size_t i = 1; i < file.ranges; ++i)
+        {
+            parts.push_back(partPath(file.paths.dstPath, i));
+        }
+        const auto firstPart = partPath(file.paths.dstPath, 0);
+        dstClient.concat(firstPart, parts);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            file.concatenated = true;
+        }
+        try
+        {
+            // existing destination is replaced atomically, it's kept if rename fails
+            dstClient.rename(firstPart, file.paths.dstPath, file.replace);
+        }
+        catch (const std::exception &e)
+        {
+            throw Exception("can't move copy " + firstPart + " to " + file.paths.dstPath +
+                            " (copy is kept): " + e.what());
+        }
+    }
+
+    /* pipe source range read into part file write */
+    void copyRange(Client &srcClient, Client &dstClient, const File &file, size_t range)
+    {
+        const auto offset = range * file.rangeSize;
+        const auto length = std::min(file.rangeSize, file.length - offset);
+        auto writeOptions = m_opts.m_writeOptions;
+        if (file.blockSize > 0)
+        {
+            // concatenated files must have the same block size
+            writeOptions.setBlockSize(file.blockSize);
+        }
+        // part files left by interrupted copy are replaced
+        writeOptions.setOverwrite(true);
+        auto readOptions = m_opts.m_readOptions;
+        readOptions.setOffset(offset).setLength(length).setParallelism(1);
+
+        const auto bufferSize = std::min(m_opts.m_bufferSize, std::max<size_t>(length, 1));
+        // buffer is charged before it's allocated, copy waits while budget is exhausted
+        BudgetCharge charge(dstClient.memoryBudget(), bufferSize);
+        Pipe pipe(bufferSize);
+        std::thread reader([&]
+                           {
+                               std::exception_ptr error;
+                               try
+                               {
+                                   auto position = offset;
+                                   if (length > 0)
+                                   {
+                                       // single block read at once delivers data in order
+                                       srcClient.readFileDirect(
+                                           file.paths.srcPath,
+                                           [&](size_t, const char *data, size_t size)
+                                           {
+                                               position += size;
+                                               return pipe.put(data, size);
+                                           },
+                                           readOptions);
+                                   }
+                                   if (position != offset + length)
+                                   {
+                                       throw Exception(file.paths.srcPath +
+                                                       " changed while copying");
+                                   }
+                               }
+                               catch (...)
+                               {
+                                   error = std::current_exception();
+                               }
+                               pipe.finish(error);
+                           });
+
+        std::exception_ptr writeError;
+        try
+        {
+            std::istream source(&pipe);
+            dstClient.writeFile(source, partPath(file.paths.dstPath, range), writeOptions);
+        }
+        catch (...)
+        {
+            writeError = std::current_exception();
+        }
+        pipe.abandon();
+        reader.join();
+        if (pipe.error())
+        {
+            std::rethrow_exception(pipe.error());
+        }
+        if (writeError)
+        {
+            std::rethrow_exception(writeError);
+        }
+    }
+
+    void fail(std::exception_ptr error)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_error)
+        {
+            m_error = error;
+        }
+    }
+
+    /* remove part files of not completed files (best effort), complete copy waiting for
+     * rename is kept */
+    void removeParts()
+    {
+        auto dstClient = m_dstClient.clone();
+        for (const auto &file : m_files)
+        {
+            if (file.done || file.concatenated)
+            {
+                continue;
+            }
+            for (size_t range = 0; range < file.ranges; ++range)
+            {
+                // failed writes can leave partial files, concatenated parts are gone already
+                if (file.started[range])
+                {
+                    try
+                    {
+                        dstClient.remove(partPath(file.paths.dstPath, range));
+                    }
+                    catch (const Exception &)
+                    {
+                    }
+                }
+            }
+        }
+    }
+
+    const Client &m_srcClient;
+    const Client &m_dstClient;
+    const CopyOptions m_opts;
+    std::vector<File> m_files;
+    std::deque<Range> m_ranges; // ranges to copy
+    std::exception_ptr m_error;
+    std::mutex m_mutex;
+};
+
+
+void copyBetween(const Client &srcClient, const std::string &srcPath,
+                 const Client &dstClient, const std::string &dstPath, const CopyOptions &opts)
+{
+    copyBetween(srcClient, dstClient, {CopyFile{srcPath, dstPath}}, opts);
+}
+
+void copyBetween(const Client &srcClient, const Client &dstClient,
+                 const std::vector<CopyFile> &files, const CopyOptions &opts)
+{
+    Copier(srcClient, dstClient, opts).copy(files);
+}
+
+} // namespace WebHDFS
@@ -0,0 +1,396 @@
+/**
+ * @file
+ * @brief  Incremental tracker of HDFS directories changes
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include "WebHdfsDirectoryWatcher.h"
+#include "WebHdfsEncoding.h"
+
+
+namespace WebHDFS
+{
+
+namespace
+{
+
+const char SNAPSHOT_MAGIC[] = "WHWATCH1";
+const size_t SNAPSHOT_MAGIC_SIZE = sizeof(SNAPSHOT_MAGIC) - 1;
+const char SNAPSHOT_CORRUPTED[] = "directory watcher snapshot is corrupted";
+
+using details::putUInt;
+using details::getUInt;
+
+void putString(std::string &buffer, const std::string &value)
+{
+    putUInt(buffer, value.size(), 4);
+    buffer.append(value);
+}
+
+std::string getString(const std::string &buffer, size_t &pos)
+{
+    const auto size = getUInt(buffer, pos, 4, SNAPSHOT_CORRUPTED);
+    if (pos + size > buffer.size())
+    {
+        throw Exception(SNAPSHOT_CORRUPTED);
+    }
+    pos += size;
+    return buffer.substr(pos - size, size);
+}
+
+std::string normalizeDirPath(const std::string &remoteDirPath)
+{
+    auto path = remoteDirPath;
+    while (path.size() > 1 && path.back() == '/')
+    {
+        path.pop_back();
+    }
+    return path;
+}
+
+std::string makeEntryPath(const std::string &dirPath, const std::string &name)
+{
+    return dirPath == "/" ? dirPath + name : dirPath + '/' + name;
+}
+
+} // namespace
+
+
+WatchOptions::WatchOptions()
+    : m_minInterval(1000)
+    , m_maxInterval(30000)
+    , m_fullListingPeriod(0)
+{
+}
+
+WatchOptions &WatchOptions::setMinInterval(long ms)
+{
+    m_minInterval = ms;
+    return *this;
+}
+
+WatchOptions &WatchOptions::setMaxInterval(long ms)
+{
+    m_maxInterval = ms;
+    return *this;
+}
+
+WatchOptions &WatchOptions::setFullListingPeriod(size_t polls)
+{
+    m_fullListingPeriod = polls;
+    return *this;
+}
+
+WatchOptions &WatchOptions::setSnapshotPath(const std::string &localPath)
+{
+    m_snapshotPath = localPath;
+    return *this;
+}
+
+DirectoryWatcher::DirectoryWatcher(Client &client, const WatchOptions &opts)
+    : m_client(client)
+    , m_options(opts)
+{
+    if (!m_options.m_snapshotPath.empty())
+    {
+        load(m_options.m_snapshotPath);
+    }
+}
+
+void DirectoryWatcher::watch(const std::string &remoteDirPath)
+{
+    const auto path = normalizeDirPath(remoteDirPath);
+    if (m_directories.count(path))
+    {
+        return;
+    }
+    auto &dir = m_directories[path];
+    auto snapshotIt = m_snapshot.find(path);
+    if (snapshotIt != m_snapshot.end())
+    {
+        dir = std::move(snapshotIt->second);
+        m_snapshot.erase(snapshotIt);
+    }
+    dir.interval = m_options.m_minInterval;
+    dir.nextPoll = Clock::now();
+}
+
+void DirectoryWatcher::unwatch(const std::string &remoteDirPath)
+{
+    m_directories.erase(normalizeDirPath(remoteDirPath));
+}
+
+bool DirectoryWatcher::poll(const DirectoryEventHandler &handler)
+{
+    bool changed = false;
+    bool proceed = true;
+    try
+    {
+        const auto now = Clock::now();
+        for (auto &item : m_directories)
+        {
+            auto &dir = item.second;
+            if (dir.nextPoll > now)
+            {
+                continue;
+            }
+            bool dirChanged = false;
+            proceed = pollDirectory(item.first, dir, handler, dirChanged);
+            changed = changed || dirChanged;
+            dir.interval = dirChanged ? m_options.m_minInterval
+                                      : std::min(dir.interval * 2, m_options.m_maxInterval);
+            dir.nextPoll = Clock::now() + std::chrono::milliseconds(dir.interval);
+            if (!proceed)
+            {
+                break;
+            }
+        }
+    }
+    catch (...)
+    {
+        if (changed && !m_options.m_snapshotPath.empty())
+        {
+            save(m_options.m_snapshotPath);
+        }
+        throw;
+    }
+    if (changed && !m_options.m_snapshotPath.empty())
+    {
+        save(m_options.m_snapshotPath);
+    }
+    return proceed;
+}
+
+long DirectoryWatcher::nextPollDelay() const
+{
+    if (m_directories.empty())
+    {
+        return m_options.m_maxInterval;
+    }
+    auto nextPoll = Clock::time_point::max();
+    for (const auto &item : m_directories)
+    {
+        nextPoll = std::min(nextPoll, item.second.nextPoll);
+    }
+    // rounded up, so sleeping for the delay makes the poll due
+    const auto delay =
+        std::chrono::duration_cast<std::chrono::microseconds>(nextPoll - Clock::now()).count();
+    return std::max<long>((delay + 999) / 1000, 0);
+}
+
+void DirectoryWatcher::run(const DirectoryEventHandler &handler)
+{
+    do
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(nextPollDelay()));
+    } while (poll(handler));
+}
+
+bool DirectoryWatcher::pollDirectory(const std::string &path, Directory &dir,
+                                     const DirectoryEventHandler &handler, bool &changed)
+{
+    // directory that doesn't exist (anymore) has no entries
+    auto isNotFound = [](const RemoteException &error)
+    {
+        return error.type() == "FileNotFoundException";
+    };
+
+    ++dir.pollsSinceListing;
+    long modificationTime = -1;
+    try
+    {
+        modificationTime = m_client.getFileStatus(path).modificationTime;
+    }
+    catch (const RemoteException &error)
+    {
+        if (!isNotFound(error))
+        {
+            throw;
+        }
+    }
+    const bool fullListing = m_options.m_fullListingPeriod != 0 &&
+                             dir.pollsSinceListing >= m_options.m_fullListingPeriod;
+    if (modificationTime == dir.modificationTime && modificationTime != -1 && !dir.settling &&
+        !fullListing)
+    {
+        return true;
+    }
+
+    std::vector<Entry> current;
+    if (modificationTime != -1)
+    {
+        try
+        {
+            for (const auto &item : m_client.listDir(path))
+            {
+                current.push_back(
+                    Entry{item.pathSuffix, item.type, item.length, item.modificationTime});
+            }
+        }
+        catch (const RemoteException &error)
+        {
+            if (!isNotFound(error))
+            {
+                throw;
+            }
+            modificationTime = -1;
+        }
+        std::sort(current.begin(), current.end(),
+                  [](const Entry &a, const Entry &b) { return a.name < b.name; });
+    }
+    dir.pollsSinceListing = 0;
+
+    // merge of sorted snapshot and listing, entries of not handled events keep old state
+    bool stopped = false;
+    auto report = [&](DirectoryEvent::Type type, const Entry &entry)
+    {
+        if (stopped)
+        {
+            return false;
+        }
+        DirectoryEvent event;
+        event.type = type;
+        event.path = makeEntryPath(path, entry.name);
+        event.objectType = entry.type;
+        event.length = entry.length;
+        event.modificationTime = entry.modificationTime;
+        changed = true;
+        stopped = !handler(event);
+        return true;
+    };
+
+    std::vector<Entry> entries;
+    entries.reserve(current.size());
+    auto oldIt = dir.entries.begin();
+    auto newIt = current.begin();
+    while (oldIt != dir.entries.end() || newIt != current.end())
+    {
+        if (newIt == current.end() || (oldIt != dir.entries.end() && oldIt->name < newIt->name))
+        {
+            if (!report(DirectoryEvent::Type::REMOVED, *oldIt))
+            {
+                entries.push_back(std::move(*oldIt));
+            }
+            ++oldIt;
+        }
+        else if (oldIt == dir.entries.end() || newIt->name < oldIt->name)
+        {
+            if (report(DirectoryEvent::Type::ADDED, *newIt))
+            {
+                entries.push_back(std::move(*newIt));
+            }
+            ++newIt;
+        }
+        else
+        {
+            const bool modified = oldIt->type != newIt->type || oldIt->length != newIt->length ||
+                                  oldIt->modificationTime != newIt->modificationTime;
+            if (!modified || report(DirectoryEvent::Type::MODIFIED, *newIt))
+            {
+                entries.push_back(std::move(*newIt));
+            }
+            else
+            {
+                entries.push_back(std::move(*oldIt));
+            }
+            ++oldIt;
+            ++newIt;
+        }
+    }
+    dir.entries.swap(entries);
+    dir.modificationTime = modificationTime;
+    // files could be still written, directory is listed again until it settles down
+    dir.settling = changed || stopped;
+    return !stopped;
+}
+
+/* Snapshot format: magic, directories count (8 bytes), directories.
+ * Directory: path size (4 bytes), path, modification time (8 bytes), entries count (8 bytes),
+ * entries sorted by name.
+ * Entry: name size (4 bytes), name, type (1 byte), length (8 bytes), modification time
+ * (8 bytes). */
+void DirectoryWatcher::save(const std::string &localPath) const
+{
+    std::string buffer(SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    putUInt(buffer, m_directories.size() + m_snapshot.size(), 8);
+    for (const auto *directories : {&m_directories, &m_snapshot})
+    {
+        for (const auto &item : *directories)
+        {
+            const auto &dir = item.second;
+            putString(buffer, item.first);
+            putUInt(buffer, static_cast<uint64_t>(dir.modificationTime), 8);
+            putUInt(buffer, dir.entries.size(), 8);
+            for (const auto &entry : dir.entries)
+            {
+                putString(buffer, entry.name);
+                putUInt(buffer, entry.type == FileStatus::PathObjectType::FILE ? 0 : 1, 1);
+                putUInt(buffer, entry.length, 8);
+                putUInt(buffer, static_cast<uint64_t>(entry.modificationTime), 8);
+            }
+        }
+    }
+
+    // snapshot is replaced atomically
+    const auto tmpPath = localPath + ".tmp";
+    {
+        std::ofstream ofs(tmpPath, std::ios::binary | std::ios::trunc);
+        ofs.write(buffer.data(), buffer.size());
+        ofs.flush();
+        if (!ofs)
+        {
+            throw Exception("failed to write directory watcher snapshot " + tmpPath);
+        }
+    }
+    if (std::rename(tmpPath.c_str(), localPath.c_str()) != 0)
+    {
+        throw Exception("failed to rename directory watcher snapshot " + tmpPath);
+    }
+}
+
+void DirectoryWatcher::load(const std::string &localPath)
+{
+    std::ifstream ifs(localPath, std::ios::binary);
+    if (!ifs.is_open())
+    {
+        return;
+    }
+    std::ostringstream oss;
+    oss << ifs.rdbuf();
+    const auto buffer = oss.str();
+
+    if (buffer.compare(0, SNAPSHOT_MAGIC_SIZE, SNAPSHOT_MAGIC) != 0)
+    {
+        throw Exception("directory watcher snapshot has wrong format");
+    }
+    size_t pos = SNAPSHOT_MAGIC_SIZE;
+    const auto dirCount = getUInt(buffer, pos, 8, SNAPSHOT_CORRUPTED);
+    for (uint64_t i = 0; i < dirCount; ++i)
+    {
+        const auto path = getString(buffer, pos);
+        auto &dir = m_snapshot[path];
+        dir.modificationTime = static_cast<long>(getUInt(buffer, pos, 8, SNAPSHOT_CORRUPTED));
+        const auto entryCount = getUInt(buffer, pos, 8, SNAPSHOT_CORRUPTED);
+        dir.entries.reserve(std::min<uint64_t>(entryCount, buffer.size()));
+        for (uint64_t j = 0; j < entryCount; ++j)
+        {
+            Entry entry;
+            entry.name = getString(buffer, pos);
+            entry.type = getUInt(buffer, pos, 1, SNAPSHOT_CORRUPTED) == 0
+                             ? FileStatus::PathObjectType::FILE
+                             : FileStatus::PathObjectType::DIRECTORY;
+            entry.length = getUInt(buffer, pos, 8, SNAPSHOT_CORRUPTED);
+            entry.modificationTime =
+                static_cast<long>(getUInt(buffer, pos, 8, SNAPSHOT_CORRUPTED));
+            dir.entries.push_back(std::move(entry));
+        }
+    }
+}
+
+} // namespace WebHDFS
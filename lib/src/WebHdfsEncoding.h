@@ -0,0 +1,58 @@
+/**
+ * @file
+ * @brief  Little endian integers encoding of library file formats (internal)
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#ifndef WEBHDFS_ENCODING_H
+#define WEBHDFS_ENCODING_H
+
+#include <cstdint>
+#include <string>
+#include "WebHdfsClient.h"
+
+namespace WebHDFS
+{
+
+namespace details
+{
+
+/* append value as little endian integer of the size */
+inline void putUInt(std::string &buffer, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        buffer.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+/* decode little endian integer of the size */
+inline uint64_t getUInt(const char *data, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+    return value;
+}
+
+/* decode little endian integer at the position and move past it, throws Exception with the
+ * error if buffer is too short */
+inline uint64_t getUInt(const std::string &buffer, size_t &pos, size_t bytes,
+                        const std::string &error)
+{
+    if (pos + bytes > buffer.size())
+    {
+        throw Exception(error);
+    }
+    const auto value = getUInt(buffer.data() + pos, bytes);
+    pos += bytes;
+    return value;
+}
+
+} // namespace details
+
+} // namespace WebHDFS
+
+#endif
@@ -0,0 +1,438 @@
+/**
+ * @file
+ * @brief  Local disk cache of HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "WebHdfsFileCache.h"
+#include "WebHdfsEncoding.h"
+
+
+namespace WebHDFS
+{
+
+namespace
+{
+
+const char ENTRY_MAGIC[] = "WHCACHE1";
+const size_t ENTRY_MAGIC_SIZE = sizeof(ENTRY_MAGIC) - 1;
+const char ENTRY_SUFFIX[] = ".entry";
+
+/* Entry file: file content, trailer.
+ * Trailer: remote path, remote path size (4 bytes), content length (8 bytes), modification
+ * time (8 bytes), magic. Trailer is written last, so partially written entries are ignored. */
+const size_t TRAILER_SIZE = 4 + 8 + 8 + ENTRY_MAGIC_SIZE;
+
+using details::putUInt;
+using details::getUInt;
+
+/* FNV-1a hash, it is stable between processes and builds */
+uint64_t hashPath(const std::string &path)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (const auto c : path)
+    {
+        hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+    }
+    return hash;
+}
+
+bool readAt(int fd, char *buffer, size_t size, off_t offset)
+{
+    while (size > 0)
+    {
+        const auto rc = ::pread(fd, buffer, size, offset);
+        if (rc < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (rc <= 0)
+        {
+            return false;
+        }
+        buffer += rc;
+        size -= rc;
+        offset += rc;
+    }
+    return true;
+}
+
+/* file descriptor owner */
+class FileDescriptor
+{
+public:
+    explicit FileDescriptor(int fd = -1)
+        : m_fd(fd)
+    {
+    }
+
+    ~FileDescriptor()
+    {
+        if (m_fd >= 0)
+        {
+            ::close(m_fd);
+        }
+    }
+
+    FileDescriptor(const FileDescriptor &) = delete;
+    FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+    int get() const { return m_fd; }
+
+private:
+    int m_fd;
+};
+
+/* Take exclusive lock of the lock file, returns -1 if the lock is busy and @a wait is false.
+ * Lock files are removed by eviction, so the lock is taken again if the locked file was
+ * removed while waiting. */
+int lockFile(const std::string &path, bool wait)
+{
+    while (true)
+    {
+        const int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            throw Exception("can't open " + path + ": " + std::strerror(errno));
+        }
+        if (::flock(fd, LOCK_EX | (wait ? 0 : LOCK_NB)) != 0)
+        {
+            const int error = errno;
+            ::close(fd);
+            if (error == EINTR)
+            {
+                continue;
+            }
+            if (error == EWOULDBLOCK)
+            {
+                return -1;
+            }
+            throw Exception("can't lock " + path + ": " + std::strerror(error));
+        }
+        struct stat locked, current;
+        if (::fstat(fd, &locked) == 0 && ::stat(path.c_str(), &current) == 0 &&
+            locked.st_dev == current.st_dev && locked.st_ino == current.st_ino)
+        {
+            return fd;
+        }
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+
+FileCacheOptions::FileCacheOptions()
+    : m_maxSize(1ul << 30)
+    , m_maxStaleness(0)
+{
+}
+
+FileCacheOptions &FileCacheOptions::setMaxSize(size_t bytes)
+{
+    m_maxSize = bytes;
+    return *this;
+}
+
+FileCacheOptions &FileCacheOptions::setMaxStaleness(long ms)
+{
+    m_maxStaleness = ms;
+    return *this;
+}
+
+FileCacheOptions &FileCacheOptions::setDownloadOptions(const DownloadOptions &downloadOptions)
+{
+    m_downloadOptions = downloadOptions;
+    return *this;
+}
+
+CachedFile::CachedFile(void *mapping, size_t mappingSize, size_t size)
+    : m_mapping(mapping)
+    , m_mappingSize(mappingSize)
+    , m_size(size)
+{
+}
+
+CachedFile::CachedFile(CachedFile &&other)
+    : m_mapping(other.m_mapping)
+    , m_mappingSize(other.m_mappingSize)
+    , m_size(other.m_size)
+{
+    other.m_mapping = nullptr;
+    other.m_mappingSize = 0;
+    other.m_size = 0;
+}
+
+CachedFile &CachedFile::operator=(CachedFile &&other)
+{
+    std::swap(m_mapping, other.m_mapping);
+    std::swap(m_mappingSize, other.m_mappingSize);
+    std::swap(m_size, other.m_size);
+    return *this;
+}
+
+CachedFile::~CachedFile()
+{
+    if (m_mapping)
+    {
+        ::munmap(m_mapping, m_mappingSize);
+    }
+}
+
+FileCache::FileCache(Client &client, const std::string &cacheDirPath,
+                     const FileCacheOptions &opts)
+    : m_client(client)
+    , m_dirPath(cacheDirPath)
+    , m_options(opts)
+{
+    if (::mkdir(m_dirPath.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+        throw Exception("can't create cache directory " + m_dirPath + ": " +
+                        std::strerror(errno));
+    }
+}
+
+CachedFile FileCache::get(const std::string &remotePath)
+{
+    const auto now = std::chrono::steady_clock::now();
+    CachedFile file(nullptr, 0, 0);
+
+    auto validatedIt = m_validated.find(remotePath);
+    if (validatedIt != m_validated.end() &&
+        now - validatedIt->second < std::chrono::milliseconds(m_options.m_maxStaleness) &&
+        tryGetCached(remotePath, nullptr, file))
+    {
+        return file;
+    }
+
+    const auto status = m_client.getFileStatus(remotePath);
+    if (status.type != FileStatus::PathObjectType::FILE)
+    {
+        throw Exception(remotePath + " is not a file");
+    }
+    if (!tryGetCached(remotePath, &status, file))
+    {
+        file = download(remotePath, status);
+        evict();
+    }
+    m_validated[remotePath] = now;
+    return file;
+}
+
+void FileCache::readFile(const std::string &remotePath, std::ostream &dataSink)
+{
+    const auto file = get(remotePath);
+    if (!dataSink.write(file.data(), file.size()))
+    {
+        throw Exception("failed to write " + remotePath + " content to the stream");
+    }
+}
+
+void FileCache::invalidate(const std::string &remotePath)
+{
+    const auto entryPath = makeEntryPath(remotePath);
+    FileDescriptor lock(lockFile(entryPath + ".lock", true));
+    if (::unlink(entryPath.c_str()) != 0 && errno != ENOENT)
+    {
+        throw Exception("can't remove " + entryPath + ": " + std::strerror(errno));
+    }
+    m_validated.erase(remotePath);
+}
+
+bool FileCache::tryGetCached(const std::string &remotePath, const FileStatus *status,
+                             CachedFile &file)
+{
+    const auto entryPath = makeEntryPath(remotePath);
+    FileDescriptor fd(::open(entryPath.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd.get() < 0)
+    {
+        if (errno == ENOENT)
+        {
+            return false;
+        }
+        throw Exception("can't open " + entryPath + ": " + std::strerror(errno));
+    }
+    struct stat st;
+    if (::fstat(fd.get(), &st) != 0 || static_cast<size_t>(st.st_size) < TRAILER_SIZE)
+    {
+        return false;
+    }
+    const size_t fileSize = st.st_size;
+
+    char trailer[TRAILER_SIZE];
+    if (!readAt(fd.get(), trailer, TRAILER_SIZE, fileSize - TRAILER_SIZE) ||
+        std::memcmp(trailer + TRAILER_SIZE - ENTRY_MAGIC_SIZE, ENTRY_MAGIC, ENTRY_MAGIC_SIZE) != 0)
+    {
+        return false;
+    }
+    const size_t pathSize = getUInt(trailer, 4);
+    const size_t length = getUInt(trailer + 4, 8);
+    const long modificationTime = static_cast<long>(getUInt(trailer + 12, 8));
+    if (length + pathSize + TRAILER_SIZE != fileSize)
+    {
+        return false;
+    }
+    std::string path(pathSize, '\0');
+    if (!readAt(fd.get(), &path[0], pathSize, length) || path != remotePath)
+    {
+        return false; // hash collision
+    }
+    if (status && (status->length != length || status->modificationTime != modificationTime))
+    {
+        return false;
+    }
+
+    void *mapping = ::mmap(nullptr, fileSize, PROT_READ, MAP_SHARED, fd.get(), 0);
+    if (mapping == MAP_FAILED)
+    {
+        throw Exception("can't map " + entryPath + ": " + std::strerror(errno));
+    }
+    // modification time of entry file is its last use time
+    ::futimens(fd.get(), nullptr);
+    file = CachedFile(mapping, fileSize, length);
+    return true;
+}
+
+CachedFile FileCache::download(const std::string &remotePath, const FileStatus &status)
+{
+    // entry is mapped while it is locked, so it can't be evicted before that
+    const auto entryPath = makeEntryPath(remotePath);
+    FileDescriptor lock(lockFile(entryPath + ".lock", true));
+
+    // file could be downloaded by another process while waiting for the lock
+    CachedFile file(nullptr, 0, 0);
+    if (tryGetCached(remotePath, &status, file))
+    {
+        return file;
+    }
+
+    const auto tmpPath = entryPath + "." + std::to_string(::getpid()) + ".tmp";
+    try
+    {
+        m_client.downloadToFile(remotePath, tmpPath, m_options.m_downloadOptions);
+
+        FileDescriptor fd(::open(tmpPath.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC));
+        struct stat st;
+        if (fd.get() < 0 || ::fstat(fd.get(), &st) != 0)
+        {
+            throw Exception("can't open " + tmpPath + ": " + std::strerror(errno));
+        }
+        std::string trailer(remotePath);
+        putUInt(trailer, remotePath.size(), 4);
+        putUInt(trailer, st.st_size, 8);
+        putUInt(trailer, static_cast<uint64_t>(status.modificationTime), 8);
+        trailer.append(ENTRY_MAGIC, ENTRY_MAGIC_SIZE);
+        if (::write(fd.get(), trailer.data(), trailer.size()) !=
+            static_cast<ssize_t>(trailer.size()))
+        {
+            throw Exception("can't write " + tmpPath + ": " + std::strerror(errno));
+        }
+        if (::rename(tmpPath.c_str(), entryPath.c_str()) != 0)
+        {
+            throw Exception("can't rename " + tmpPath + ": " + std::strerror(errno));
+        }
+    }
+    catch (...)
+    {
+        ::unlink(tmpPath.c_str());
+        throw;
+    }
+    // file content could be changed while downloading, it is validated on next access
+    if (!tryGetCached(remotePath, nullptr, file))
+    {
+        throw Exception("can't cache " + remotePath);
+    }
+    return file;
+}
+
+void FileCache::evict()
+{
+    // only one process scans the cache, others skip eviction
+    FileDescriptor evictionLock(lockFile(m_dirPath + "/.eviction.lock", false));
+    if (evictionLock.get() < 0)
+    {
+        return;
+    }
+
+    struct CachedEntry
+    {
+        std::string path;
+        size_t size;
+        struct timespec lastUse;
+    };
+    std::vector<CachedEntry> entries;
+    size_t totalSize = 0;
+
+    DIR *dir = ::opendir(m_dirPath.c_str());
+    if (!dir)
+    {
+        throw Exception("can't open cache directory " + m_dirPath + ": " + std::strerror(errno));
+    }
+    const size_t suffixSize = sizeof(ENTRY_SUFFIX) - 1;
+    while (const auto *dirEntry = ::readdir(dir))
+    {
+        const std::string name(dirEntry->d_name);
+        struct stat st;
+        if (name.size() <= suffixSize ||
+            name.compare(name.size() - suffixSize, suffixSize, ENTRY_SUFFIX) != 0 ||
+            ::stat((m_dirPath + '/' + name).c_str(), &st) != 0)
+        {
+            continue;
+        }
+        entries.push_back(CachedEntry{m_dirPath + '/' + name, static_cast<size_t>(st.st_size),
+                                      st.st_mtim});
+        totalSize += st.st_size;
+    }
+    ::closedir(dir);
+    if (totalSize <= m_options.m_maxSize)
+    {
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const CachedEntry &a, const CachedEntry &b)
+              {
+                  return a.lastUse.tv_sec < b.lastUse.tv_sec ||
+                         (a.lastUse.tv_sec == b.lastUse.tv_sec &&
+                          a.lastUse.tv_nsec < b.lastUse.tv_nsec);
+              });
+    for (const auto &entry : entries)
+    {
+        if (totalSize <= m_options.m_maxSize)
+        {
+            break;
+        }
+        // entries being downloaded are skipped, mapped entries stay valid after removal
+        FileDescriptor lock(lockFile(entry.path + ".lock", false));
+        if (lock.get() < 0)
+        {
+            continue;
+        }
+        if (::unlink(entry.path.c_str()) == 0)
+        {
+            totalSize -= entry.size;
+        }
+        ::unlink((entry.path + ".lock").c_str());
+    }
+}
+
+std::string FileCache::makeEntryPath(const std::string &remotePath) const
+{
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx",
+                  static_cast<unsigned long long>(hashPath(remotePath)));
+    return m_dirPath + '/' + name + ENTRY_SUFFIX;
+}
+
+} // namespace WebHDFS
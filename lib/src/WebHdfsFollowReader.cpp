@@ -0,0 +1,135 @@
+/**
+ * @file
+ * @brief  Reader of growing HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <thread>
+#include "WebHdfsFollowReader.h"
+
+
+namespace WebHDFS
+{
+
+FollowOptions::FollowOptions()
+    : m_offset(0)
+    , m_fromEnd(false)
+    , m_minInterval(100)
+    , m_maxInterval(10000)
+{
+}
+
+FollowOptions &FollowOptions::setOffset(size_t offset)
+{
+    m_offset = offset;
+    return *this;
+}
+
+FollowOptions &FollowOptions::setFromEnd(bool fromEnd)
+{
+    m_fromEnd = fromEnd;
+    return *this;
+}
+
+FollowOptions &FollowOptions::setMinInterval(long ms)
+{
+    m_minInterval = ms;
+    return *this;
+}
+
+FollowOptions &FollowOptions::setMaxInterval(long ms)
+{
+    m_maxInterval = ms;
+    return *this;
+}
+
+FollowOptions &FollowOptions::setReadOptions(const DirectReadOptions &readOptions)
+{
+    m_readOptions = readOptions;
+    return *this;
+}
+
+FollowReader::FollowReader(Client &client, const std::string &remoteFilePath,
+                           const FollowOptions &opts)
+    : m_client(client)
+    , m_path(remoteFilePath)
+    , m_options(opts)
+    , m_offset(opts.m_offset)
+    , m_started(false)
+    , m_interval(opts.m_minInterval)
+    , m_nextPoll(Clock::now())
+{
+}
+
+bool FollowReader::poll(const RangeDataHandler &dataHandler)
+{
+    if (m_nextPoll > Clock::now())
+    {
+        return true;
+    }
+    const auto length = m_client.getFileStatus(m_path).length;
+    if (!m_started)
+    {
+        m_started = true;
+        if (m_options.m_fromEnd)
+        {
+            m_offset = length;
+        }
+    }
+    if (length < m_offset)
+    {
+        throw Exception("followed file " + m_path + " was truncated");
+    }
+
+    bool proceed = true;
+    const auto offset = m_offset;
+    if (length > offset)
+    {
+        // offset is advanced by delivered data only, so failed or stopped read is resumed
+        auto readOpts = m_options.m_readOptions;
+        readOpts.setOffset(offset).setLength(length - offset).setParallelism(1);
+        try
+        {
+            m_client.readFileDirect(m_path,
+                                    [&](size_t pieceOffset, const char *data, size_t size)
+                                    {
+                                        proceed = dataHandler(pieceOffset, data, size);
+                                        m_offset = pieceOffset + size;
+                                        return proceed;
+                                    },
+                                    readOpts);
+        }
+        catch (...)
+        {
+            // read via namenode fails when handler aborts transfer
+            if (proceed)
+            {
+                m_nextPoll = Clock::now() + std::chrono::milliseconds(m_options.m_minInterval);
+                throw;
+            }
+        }
+    }
+    m_interval = m_offset != offset ? m_options.m_minInterval
+                                    : std::min(m_interval * 2, m_options.m_maxInterval);
+    m_nextPoll = Clock::now() + std::chrono::milliseconds(proceed ? m_interval : 0);
+    return proceed;
+}
+
+long FollowReader::nextPollDelay() const
+{
+    // rounded up, so sleeping for the delay makes the poll due
+    const auto delay =
+        std::chrono::duration_cast<std::chrono::microseconds>(m_nextPoll - Clock::now()).count();
+    return std::max<long>((delay + 999) / 1000, 0);
+}
+
+void FollowReader::run(const RangeDataHandler &dataHandler)
+{
+    do
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(nextPollDelay()));
+    } while (poll(dataHandler));
+}
+
+} // namespace WebHDFS
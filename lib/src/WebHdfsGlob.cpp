@@ -0,0 +1,408 @@
+/**
+ * @file
+ * @brief  Glob patterns expansion
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <map>
+#include "WebHdfsGlob.h"
+
+
+namespace WebHDFS
+{
+
+namespace
+{
+
+bool isWildcard(char c)
+{
+    return c == '*' || c == '?' || c == '[' || c == '{';
+}
+
+bool isLiteral(const std::string &component)
+{
+    for (size_t i = 0; i < component.size(); ++i)
+    {
+        if (component[i] == '\\')
+        {
+            ++i;
+        }
+        else if (isWildcard(component[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string unescape(const std::string &component)
+{
+    std::string name;
+    for (size_t i = 0; i < component.size(); ++i)
+    {
+        if (component[i] == '\\' && i + 1 < component.size())
+        {
+            ++i;
+        }
+        name.push_back(component[i]);
+    }
+    return name;
+}
+
+/* expand the first brace group and (recursively) the rest of the pattern */
+void expandBraces(const std::string &pattern, std::vector<std::string> &patterns)
+{
+    size_t open = 0;
+    while (open < pattern.size() && pattern[open] != '{')
+    {
+        open += pattern[open] == '\\' ? 2 : 1;
+    }
+    if (open >= pattern.size())
+    {
+        patterns.push_back(pattern);
+        return;
+    }
+
+    std::vector<std::string> alternatives(1);
+    int depth = 0;
+    size_t pos = open + 1;
+    for (; pos < pattern.size(); ++pos)
+    {
+        const char c = pattern[pos];
+        if (c == '\\' && pos + 1 < pattern.size())
+        {
+            alternatives.back().append(pattern, pos, 2);
+            ++pos;
+            continue;
+        }
+        if (c == '}' && depth == 0)
+        {
+            break;
+        }
+        if (c == ',' && depth == 0)
+        {
+            alternatives.emplace_back();
+            continue;
+        }
+        depth += c == '{' ? 1 : (c == '}' ? -1 : 0);
+        alternatives.back().push_back(c);
+    }
+    if (pos >= pattern.size())
+    {
+        throw Exception("unbalanced braces in glob pattern " + pattern);
+    }
+    const auto prefix = pattern.substr(0, open);
+    const auto suffix = pattern.substr(pos + 1);
+    for (const auto &alternative : alternatives)
+    {
+        expandBraces(prefix + alternative + suffix, patterns);
+    }
+}
+
+std::vector<std::string> splitPath(const std::string &path)
+{
+    std::vector<std::string> components;
+    size_t begin = 0;
+    while (begin < path.size())
+    {
+        auto end = path.find('/', begin);
+        if (end == std::string::npos)
+        {
+            end = path.size();
+        }
+        if (end > begin)
+        {
+            components.push_back(path.substr(begin, end - begin));
+        }
+        begin = end + 1;
+    }
+    return components;
+}
+
+/* match character against class starting at pattern[pos] == '[', pos is moved past the
+ * class; returns false with pos unchanged if the class isn't closed ('[' is literal then) */
+bool matchClass(const std::string &pattern, size_t &pos, char c, bool &matched)
+{
+    auto i = pos + 1;
+    const bool negated = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+    if (negated)
+    {
+        ++i;
+    }
+    matched = false;
+    bool first = true;
+    for (; i < pattern.size() && (first || pattern[i] != ']'); first = false)
+    {
+        auto low = pattern[i];
+        if (low == '\\' && i + 1 < pattern.size())
+        {
+            low = pattern[++i];
+        }
+        ++i;
+        auto high = low;
+        if (i + 1 < pattern.size() && pattern[i] == '-' && pattern[i + 1] != ']')
+        {
+            high = pattern[i + 1];
+            if (high == '\\' && i + 2 < pattern.size())
+            {
+                ++i;
+                high = pattern[i + 1];
+            }
+            i += 2;
+        }
+        matched = matched || (low <= c && c <= high);
+    }
+    if (i >= pattern.size())
+    {
+        return false;
+    }
+    matched = matched != negated;
+    pos = i + 1;
+    return true;
+}
+
+/* match one pattern character (or class) at pattern[pos], next is set to the following one */
+bool matchOne(const std::string &pattern, size_t pos, char c, size_t &next)
+{
+    switch (pattern[pos])
+    {
+    case '?':
+        next = pos + 1;
+        return true;
+    case '[':
+    {
+        bool matched = false;
+        next = pos;
+        if (matchClass(pattern, next, c, matched))
+        {
+            return matched;
+        }
+        next = pos + 1;
+        return c == '[';
+    }
+    case '\\':
+        if (pos + 1 < pattern.size())
+        {
+            next = pos + 2;
+            return c == pattern[pos + 1];
+        }
+        next = pos + 1;
+        return c == '\\';
+    default:
+        next = pos + 1;
+        return c == pattern[pos];
+    }
+}
+
+/* match name against brace-free component pattern, '*' backtracks to its last occurrence */
+bool matchComponent(const std::string &pattern, const std::string &name)
+{
+    size_t p = 0;
+    size_t n = 0;
+    size_t starP = std::string::npos;
+    size_t starN = 0;
+    while (n < name.size())
+    {
+        size_t next = 0;
+        if (p < pattern.size() && pattern[p] == '*')
+        {
+            starP = ++p;
+            starN = n;
+        }
+        else if (p < pattern.size() && matchOne(pattern, p, name[n], next))
+        {
+            p = next;
+            ++n;
+        }
+        else if (starP != std::string::npos)
+        {
+            p = starP;
+            n = ++starN;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*')
+    {
+        ++p;
+    }
+    return p == pattern.size();
+}
+
+std::string makeChildPath(const std::string &dirPath, const std::string &name)
+{
+    return dirPath == "/" ? dirPath + name : dirPath + '/' + name;
+}
+
+} // namespace
+
+
+GlobOptions::GlobOptions()
+    : m_parallelism(8)
+{
+}
+
+GlobOptions &GlobOptions::setParallelism(size_t dirs)
+{
+    m_parallelism = dirs;
+    return *this;
+}
+
+GlobPattern::GlobPattern(const std::string &pattern)
+{
+    if (pattern.empty() || pattern[0] != '/')
+    {
+        throw Exception("glob pattern should be an absolute path: " + pattern);
+    }
+    std::vector<std::string> patterns;
+    expandBraces(pattern, patterns);
+    for (const auto &item : patterns)
+    {
+        m_alternatives.push_back(splitPath(item));
+    }
+}
+
+bool GlobPattern::hasWildcards(const std::string &path)
+{
+    return !isLiteral(path);
+}
+
+bool GlobPattern::matches(const std::string &path) const
+{
+    const auto components = splitPath(path);
+    for (const auto &alternative : m_alternatives)
+    {
+        if (alternative.size() != components.size())
+        {
+            continue;
+        }
+        size_t i = 0;
+        while (i < components.size() && matchComponent(alternative[i], components[i]))
+        {
+            ++i;
+        }
+        if (i == components.size())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<GlobMatch> GlobPattern::expand(Client &client, const GlobOptions &opts) const
+{
+    // path matched by first levels of a pattern alternative
+    struct Candidate
+    {
+        std::string path;
+        size_t alternative;
+        size_t level; // number of matched components
+        bool hasStatus;
+        FileStatus status;
+    };
+
+    std::vector<Candidate> candidates;
+    for (size_t i = 0; i < m_alternatives.size(); ++i)
+    {
+        candidates.push_back(Candidate{"/", i, 0, false, FileStatus()});
+    }
+    std::map<std::string, FileStatus> matches;
+    const auto parallelism = std::max<size_t>(opts.m_parallelism, 1);
+
+    while (!candidates.empty())
+    {
+        std::vector<std::string> dirs;
+        std::vector<std::vector<Candidate>> dirCandidates; // candidates waiting for dir listing
+        std::map<std::string, size_t> dirIndices;
+        std::vector<std::string> unchecked; // matched paths which existence is unknown
+        for (auto &candidate : candidates)
+        {
+            const auto &components = m_alternatives[candidate.alternative];
+            // literal components need no listing
+            while (candidate.level < components.size() &&
+                   isLiteral(components[candidate.level]))
+            {
+                candidate.path =
+                    makeChildPath(candidate.path, unescape(components[candidate.level]));
+                candidate.hasStatus = false;
+                ++candidate.level;
+            }
+            if (candidate.level == components.size())
+            {
+                if (candidate.hasStatus)
+                {
+                    matches[candidate.path] = candidate.status;
+                }
+                else
+                {
+                    unchecked.push_back(candidate.path);
+                }
+                continue;
+            }
+            if (candidate.hasStatus && candidate.status.type == FileStatus::PathObjectType::FILE)
+            {
+                continue;
+            }
+            const auto inserted = dirIndices.insert(std::make_pair(candidate.path, dirs.size()));
+            if (inserted.second)
+            {
+                dirs.push_back(candidate.path);
+                dirCandidates.emplace_back();
+            }
+            dirCandidates[inserted.first->second].push_back(std::move(candidate));
+        }
+
+        if (!unchecked.empty())
+        {
+            std::vector<FileStatus> statuses;
+            const auto found = client.getFileStatuses(unchecked, statuses, parallelism);
+            for (size_t i = 0; i < unchecked.size(); ++i)
+            {
+                if (found[i])
+                {
+                    matches[unchecked[i]] = statuses[i];
+                }
+            }
+        }
+
+        std::vector<Candidate> next;
+        client.listDirs(
+            dirs,
+            [&](size_t dirIndex, const FileStatus &status)
+            {
+                // listing of a file returns the file itself with empty suffix
+                if (status.pathSuffix.empty())
+                {
+                    return true;
+                }
+                for (const auto &candidate : dirCandidates[dirIndex])
+                {
+                    const auto &components = m_alternatives[candidate.alternative];
+                    const bool last = candidate.level + 1 == components.size();
+                    if ((last || status.type == FileStatus::PathObjectType::DIRECTORY) &&
+                        matchComponent(components[candidate.level], status.pathSuffix))
+                    {
+                        next.push_back(Candidate{makeChildPath(candidate.path, status.pathSuffix),
+                                                 candidate.alternative, candidate.level + 1,
+                                                 true, status});
+                    }
+                }
+                return true;
+            },
+            parallelism);
+        candidates.swap(next);
+    }
+
+    std::vector<GlobMatch> result;
+    result.reserve(matches.size());
+    for (const auto &item : matches)
+    {
+        result.push_back(GlobMatch{item.first, item.second});
+    }
+    return result;
+}
+
+} // namespace WebHDFS
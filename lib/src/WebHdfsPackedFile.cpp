@@ -0,0 +1,293 @@
+/**
+ * @file
+ * @brief  Small files packing on top of WebHDFS client
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include "WebHdfsPackedFile.h"
+#include "WebHdfsEncoding.h"
+
+
+namespace WebHDFS
+{
+
+namespace
+{
+
+const char INDEX_MAGIC[] = "WHPACK01";
+const size_t INDEX_MAGIC_SIZE = sizeof(INDEX_MAGIC) - 1;
+const char INDEX_CORRUPTED[] = "packed file index is corrupted";
+
+using details::putUInt;
+using details::getUInt;
+
+std::string makeIndexPath(const std::string &remotePath)
+{
+    return remotePath + ".index";
+}
+
+/* Index format: magic, entries count (8 bytes), entries sorted by key.
+ * Entry: key size (4 bytes), key, blob offset (8 bytes), blob length (8 bytes). */
+std::string serializeIndex(const std::vector<PackedFileEntry> &entries)
+{
+    std::string buffer(INDEX_MAGIC, INDEX_MAGIC_SIZE);
+    putUInt(buffer, entries.size(), 8);
+    for (const auto &entry : entries)
+    {
+        putUInt(buffer, entry.key.size(), 4);
+        buffer.append(entry.key);
+        putUInt(buffer, entry.offset, 8);
+        putUInt(buffer, entry.length, 8);
+    }
+    return buffer;
+}
+
+std::vector<PackedFileEntry> parseIndex(const std::string &buffer)
+{
+    if (buffer.compare(0, INDEX_MAGIC_SIZE, INDEX_MAGIC) != 0)
+    {
+        throw Exception("packed file index has wrong format");
+    }
+    size_t pos = INDEX_MAGIC_SIZE;
+    const auto count = getUInt(buffer, pos, 8, INDEX_CORRUPTED);
+    std::vector<PackedFileEntry> entries;
+    entries.reserve(std::min<uint64_t>(count, buffer.size()));
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        PackedFileEntry entry;
+        const auto keySize = getUInt(buffer, pos, 4, INDEX_CORRUPTED);
+        if (pos + keySize > buffer.size())
+        {
+            throw Exception(INDEX_CORRUPTED);
+        }
+        entry.key = buffer.substr(pos, keySize);
+        pos += keySize;
+        entry.offset = getUInt(buffer, pos, 8, INDEX_CORRUPTED);
+        entry.length = getUInt(buffer, pos, 8, INDEX_CORRUPTED);
+        entries.push_back(entry);
+    }
+    return entries;
+}
+
+bool keyLess(const PackedFileEntry &entry, const std::string &key)
+{
+    return entry.key < key;
+}
+
+} // namespace
+
+
+/* local temporary file to collect blobs */
+class PackedFileWriter::Spool
+{
+public:
+    Spool()
+    {
+        const char *tmpDir = std::getenv("TMPDIR");
+        std::string path = std::string(tmpDir ? tmpDir : "/tmp") + "/webhdfs-pack-XXXXXX";
+        std::vector<char> pathBuffer(path.begin(), path.end());
+        pathBuffer.push_back('\0');
+        const int fd = ::mkstemp(pathBuffer.data());
+        if (fd < 0)
+        {
+            throw Exception(std::string("can't create spool file: ") + std::strerror(errno));
+        }
+        ::close(fd);
+        m_path = pathBuffer.data();
+        m_stream.open(m_path, std::ios::in | std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m_stream.is_open())
+        {
+            ::unlink(m_path.c_str());
+            throw Exception("can't open spool file " + m_path);
+        }
+    }
+
+    ~Spool()
+    {
+        m_stream.close();
+        ::unlink(m_path.c_str());
+    }
+
+    std::fstream &stream()
+    {
+        return m_stream;
+    }
+
+private:
+    std::string m_path;
+    std::fstream m_stream;
+};
+
+PackedFileWriter::PackedFileWriter(Client &client, const std::string &remotePath,
+                                   const WriteOptions &opts)
+    : m_client(client)
+    , m_remotePath(remotePath)
+    , m_opts(opts)
+    , m_spool(new Spool)
+    , m_entries()
+    , m_closed(false)
+{
+}
+
+PackedFileWriter::~PackedFileWriter() = default;
+
+void PackedFileWriter::add(const std::string &key, const char *data, size_t size)
+{
+    if (m_closed)
+    {
+        throw Exception("packed file " + m_remotePath + " is closed");
+    }
+    PackedFileEntry entry;
+    entry.key = key;
+    entry.offset = m_entries.empty() ? 0 : m_entries.back().offset + m_entries.back().length;
+    entry.length = size;
+    m_spool->stream().write(data, size);
+    if (!m_spool->stream().good())
+    {
+        throw Exception("can't write packed file spool");
+    }
+    m_entries.push_back(entry);
+}
+
+void PackedFileWriter::add(const std::string &key, const std::string &data)
+{
+    add(key, data.data(), data.size());
+}
+
+void PackedFileWriter::close()
+{
+    if (m_closed)
+    {
+        return;
+    }
+    std::sort(m_entries.begin(), m_entries.end(),
+              [](const PackedFileEntry &a, const PackedFileEntry &b)
+              {
+                  return a.key < b.key;
+              });
+    const auto duplicate =
+        std::adjacent_find(m_entries.begin(), m_entries.end(),
+                           [](const PackedFileEntry &a, const PackedFileEntry &b)
+                           {
+                               return a.key == b.key;
+                           });
+    if (duplicate != m_entries.end())
+    {
+        throw Exception("duplicate packed file key " + duplicate->key);
+    }
+
+    // data first, so the index never refers to missing data
+    auto &spool = m_spool->stream();
+    spool.flush();
+    spool.seekg(0);
+    m_client.writeFile(spool, m_remotePath, m_opts);
+
+    std::istringstream index(serializeIndex(m_entries));
+    m_client.writeFile(index, makeIndexPath(m_remotePath), m_opts);
+
+    m_closed = true;
+    m_spool.reset();
+}
+
+
+PackedFileReader::PackedFileReader(Client &client, const std::string &remotePath, size_t maxGap)
+    : m_client(client)
+    , m_remotePath(remotePath)
+    , m_maxGap(maxGap)
+    , m_index()
+    , m_indexLoaded(false)
+{
+}
+
+const std::vector<PackedFileEntry> &PackedFileReader::index()
+{
+    if (!m_indexLoaded)
+    {
+        std::ostringstream oss;
+        m_client.readFile(makeIndexPath(m_remotePath), oss);
+        m_index = parseIndex(oss.str());
+        m_indexLoaded = true;
+    }
+    return m_index;
+}
+
+const PackedFileEntry *PackedFileReader::find(const std::string &key)
+{
+    const auto &entries = index();
+    const auto it = std::lower_bound(entries.begin(), entries.end(), key, keyLess);
+    return (it != entries.end() && it->key == key) ? &*it : nullptr;
+}
+
+bool PackedFileReader::get(const std::string &key, std::string &data)
+{
+    auto blobs = get(std::vector<std::string>{key});
+    if (blobs.empty())
+    {
+        return false;
+    }
+    data.swap(blobs.begin()->second);
+    return true;
+}
+
+std::map<std::string, std::string> PackedFileReader::get(const std::vector<std::string> &keys)
+{
+    std::vector<const PackedFileEntry *> entries;
+    for (const auto &key : keys)
+    {
+        if (auto entry = find(key))
+        {
+            entries.push_back(entry);
+        }
+    }
+    std::sort(entries.begin(), entries.end(),
+              [](const PackedFileEntry *a, const PackedFileEntry *b)
+              {
+                  return a->offset < b->offset;
+              });
+
+    std::map<std::string, std::string> blobs;
+    size_t spanBegin = 0;
+    while (spanBegin < entries.size())
+    {
+        // coalesce blobs separated by small gaps to one read
+        auto spanEnd = spanBegin + 1;
+        auto spanEndOffset = entries[spanBegin]->offset + entries[spanBegin]->length;
+        while (spanEnd < entries.size() && entries[spanEnd]->offset <= spanEndOffset + m_maxGap)
+        {
+            spanEndOffset =
+                std::max(spanEndOffset, entries[spanEnd]->offset + entries[spanEnd]->length);
+            ++spanEnd;
+        }
+        const auto spanOffset = entries[spanBegin]->offset;
+        std::string span;
+        if (spanEndOffset > spanOffset)
+        {
+            std::ostringstream oss;
+            m_client.readFile(m_remotePath, oss, ReadOptions()
+                                                     .setOffset(spanOffset)
+                                                     .setLength(spanEndOffset - spanOffset));
+            span = oss.str();
+        }
+        if (span.size() != spanEndOffset - spanOffset)
+        {
+            throw Exception("packed file " + m_remotePath + " is truncated");
+        }
+        for (auto i = spanBegin; i < spanEnd; ++i)
+        {
+            blobs[entries[i]->key] =
+                span.substr(entries[i]->offset - spanOffset, entries[i]->length);
+        }
+        spanBegin = spanEnd;
+    }
+    return blobs;
+}
+
+} // namespace WebHDFS
@@ -0,0 +1,386 @@
+/**
+ * @file
+ * @brief  Prefetching sequential reader of many HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <streambuf>
+#include "WebHdfsPrefetchingReader.h"
+
+
+namespace WebHDFS
+{
+
+PrefetchOptions::PrefetchOptions()
+    : m_prefetchCount(2)
+    , m_memoryBudget(64 << 20)
+    , m_readOptions()
+{
+}
+
+PrefetchOptions &PrefetchOptions::setPrefetchCount(size_t files)
+{
+    m_prefetchCount = files;
+    return *this;
+}
+
+PrefetchOptions &PrefetchOptions::setMemoryBudget(size_t bytes)
+{
+    m_memoryBudget = bytes;
+    return *this;
+}
+
+PrefetchOptions &PrefetchOptions::setReadOptions(const ReadOptions &readOptions)
+{
+    m_readOptions = readOptions;
+    return *this;
+}
+
+
+/* state shared by reader, download threads and files streams (guarded by mutex) */
+class PrefetchingReader::State
+{
+public:
+    struct File
+    {
+        size_t index = 0;
+        std::string path;
+        std::deque<std::string> chunks;
+        bool frontInUse = false; // first chunk is being read by consumer
+        bool done = false;
+        bool abandoned = false;
+        std::exception_ptr error;
+    };
+
+    State(const std::vector<std::string> &remoteFilePaths, const PrefetchOptions &opts,
+          const std::shared_ptr<MemoryBudget> &sharedBudget)
+        : prefetchCount(opts.m_prefetchCount)
+        , memoryBudget(opts.m_memoryBudget)
+        , sharedBudget(sharedBudget)
+        , readOptions(opts.m_readOptions)
+    {
+        for (const auto &path : remoteFilePaths)
+        {
+            std::shared_ptr<File> file(new File);
+            file->index = files.size();
+            file->path = path;
+            files.push_back(file);
+        }
+    }
+
+    /* return memory of chunks never consumed to shared budget */
+    ~State()
+    {
+        for (const auto &file : files)
+        {
+            for (const auto &chunk : file->chunks)
+            {
+                freeMemory(chunk.size());
+            }
+        }
+    }
+
+    /* free file chunks (except the one consumer reads now) */
+    void release(File &file)
+    {
+        while (file.chunks.size() > (file.frontInUse ? 1 : 0))
+        {
+            freeMemory(file.chunks.back().size());
+            file.chunks.pop_back();
+        }
+        changed.notify_all();
+    }
+
+    void freeMemory(size_t size)
+    {
+        memoryUsed -= size;
+        if (sharedBudget)
+        {
+            sharedBudget->release(size);
+        }
+    }
+
+    /* download thread routine */
+    static void download(std::shared_ptr<State> state, Client client)
+    {
+        for (;;)
+        {
+            std::shared_ptr<File> file;
+            {
+                std::unique_lock<std::mutex> lock(state->mutex);
+                state->changed.wait(lock, [&]
+                                    {
+                                        return state->stopping ||
+                                               state->nextToStart >= state->files.size() ||
+                                               state->nextToStart <=
+                                                   state->head + state->prefetchCount;
+                                    });
+                if (state->stopping || state->nextToStart >= state->files.size())
+                {
+                    return;
+                }
+                file = state->files[state->nextToStart++];
+            }
+
+            std::exception_ptr error;
+            try
+            {
+                SinkBuffer sinkBuffer(*state, *file);
+                std::ostream sink(&sinkBuffer);
+                client.readFile(file->path, sink, state->readOptions);
+            }
+            catch (...)
+            {
+                error = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(state->mutex);
+            file->done = true;
+            file->error = error;
+            state->changed.notify_all();
+        }
+    }
+
+    /* buffer to put downloaded data to file chunks, waits for memory budget */
+    class SinkBuffer : public std::streambuf
+    {
+    public:
+        SinkBuffer(State &state, File &file)
+            : m_state(state)
+            , m_file(file)
+        {
+        }
+
+    protected:
+        std::streamsize xsputn(const char *data, std::streamsize size) override
+        {
+            std::unique_lock<std::mutex> lock(m_state.mutex);
+            auto &sharedBudget = m_state.sharedBudget;
+            for (;;)
+            {
+                if (m_state.stopping || m_file.abandoned)
+                {
+                    return 0;
+                }
+                // consumer waits for this data, it's taken regardless of budgets
+                if (m_file.index == m_state.head && m_file.chunks.empty())
+                {
+                    if (sharedBudget)
+                    {
+                        sharedBudget->forceAcquire(size);
+                    }
+                    break;
+                }
+                if (m_state.memoryUsed + size > m_state.memoryBudget)
+                {
+                    m_state.changed.wait(lock);
+                }
+                else if (!sharedBudget || sharedBudget->tryAcquire(size))
+                {
+                    break;
+                }
+                else
+                {
+                    // shared budget is released by other clients without notification
+                    m_state.changed.wait_for(lock, std::chrono::milliseconds(10));
+                }
+            }
+            m_file.chunks.push_back(std::string(data, size));
+            m_state.memoryUsed += size;
+            m_state.changed.notify_all();
+            return size;
+        }
+
+        int_type overflow(int_type c) override
+        {
+            if (traits_type::eq_int_type(c, traits_type::eof()))
+            {
+                return traits_type::not_eof(c);
+            }
+            const char ch = traits_type::to_char_type(c);
+            return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+        }
+
+    private:
+        State &m_state;
+        File &m_file;
+    };
+
+    /* buffer to read file chunks, waits for download */
+    class SourceBuffer : public std::streambuf
+    {
+    public:
+        SourceBuffer(std::shared_ptr<State> state, std::shared_ptr<File> file)
+            : m_state(state)
+            , m_file(file)
+        {
+        }
+
+        ~SourceBuffer()
+        {
+            std::lock_guard<std::mutex> lock(m_state->mutex);
+            m_file->abandoned = true;
+            m_file->frontInUse = false;
+            m_state->release(*m_file);
+        }
+
+    protected:
+        int_type underflow() override
+        {
+            std::unique_lock<std::mutex> lock(m_state->mutex);
+            auto &file = *m_file;
+            if (file.frontInUse)
+            {
+                m_state->freeMemory(file.chunks.front().size());
+                file.chunks.pop_front();
+                file.frontInUse = false;
+                m_state->changed.notify_all();
+            }
+            if (file.abandoned)
+            {
+                return traits_type::eof();
+            }
+            m_state->changed.wait(lock, [&]
+                                  {
+                                      return !file.chunks.empty() || file.done ||
+                                             m_state->stopping;
+                                  });
+            if (!file.chunks.empty())
+            {
+                auto &chunk = file.chunks.front();
+                file.frontInUse = true;
+                setg(&chunk[0], &chunk[0], &chunk[0] + chunk.size());
+                return traits_type::to_int_type(chunk[0]);
+            }
+            if (file.error)
+            {
+                std::rethrow_exception(file.error);
+            }
+            if (!file.done)
+            {
+                throw Exception("prefetching reader of " + file.path + " is destroyed");
+            }
+            return traits_type::eof();
+        }
+
+    private:
+        std::shared_ptr<State> m_state;
+        std::shared_ptr<File> m_file;
+    };
+
+    class Stream : public std::istream
+    {
+    public:
+        Stream(std::shared_ptr<State> state, std::shared_ptr<File> file)
+            : std::istream(nullptr)
+            , m_buffer(state, file)
+        {
+            rdbuf(&m_buffer);
+            exceptions(std::ios::badbit);
+        }
+
+    private:
+        SourceBuffer m_buffer;
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::vector<std::shared_ptr<File>> files;
+    std::shared_ptr<File> current; // file handed to consumer
+    size_t head = 0;               // index of the current file
+    size_t nextToStart = 0;        // index of the next file to download
+    size_t memoryUsed = 0;
+    bool stopping = false;
+    const size_t prefetchCount;
+    const size_t memoryBudget;
+    const std::shared_ptr<MemoryBudget> sharedBudget; // budget of client options
+    const ReadOptions readOptions;
+};
+
+
+PrefetchingReader::PrefetchingReader(const Client &client,
+                                     const std::vector<std::string> &remoteFilePaths,
+                                     const PrefetchOptions &opts)
+    : m_state(new State(remoteFilePaths, opts, client.memoryBudget()))
+    , m_workers()
+{
+    const auto workersCount = std::min(opts.m_prefetchCount + 1, remoteFilePaths.size());
+    try
+    {
+        for (size_t i = 0; i < workersCount; ++i)
+        {
+            m_workers.push_back(std::thread(&State::download, m_state, client.clone()));
+        }
+    }
+    catch (...)
+    {
+        stop();
+        throw;
+    }
+}
+
+PrefetchingReader::~PrefetchingReader()
+{
+    stop();
+}
+
+void PrefetchingReader::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        m_state->stopping = true;
+        m_state->changed.notify_all();
+    }
+    for (auto &worker : m_workers)
+    {
+        worker.join();
+    }
+    m_workers.clear();
+}
+
+std::unique_ptr<std::istream> PrefetchingReader::next(std::string &remoteFilePath)
+{
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->current)
+    {
+        m_state->current->abandoned = true;
+        m_state->release(*m_state->current);
+        m_state->current.reset();
+        ++m_state->head;
+    }
+    if (m_state->head >= m_state->files.size())
+    {
+        return nullptr;
+    }
+    m_state->current = m_state->files[m_state->head];
+    remoteFilePath = m_state->current->path;
+    return std::unique_ptr<std::istream>(new State::Stream(m_state, m_state->current));
+}
+
+std::vector<std::string> PrefetchingReader::listDirFiles(Client &client,
+                                                         const std::string &remoteDirPath)
+{
+    auto prefix = remoteDirPath;
+    if (prefix.empty() || prefix.back() != '/')
+    {
+        prefix.push_back('/');
+    }
+    std::vector<std::string> paths;
+    for (const auto &item : client.listDir(remoteDirPath))
+    {
+        if (item.type == FileStatus::PathObjectType::FILE)
+        {
+            paths.push_back(prefix + item.pathSuffix);
+        }
+    }
+    std::sort(paths.begin(), paths.end());
+    return paths;
+}
+
+} // namespace WebHDFS
@@ -0,0 +1,368 @@
+/**
+ * @file
+ * @brief  Delimited records reader of HDFS files
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <limits>
+#include <mutex>
+#include <streambuf>
+#include <thread>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "WebHdfsRecordReader.h"
+
+
+namespace WebHDFS
+{
+
+namespace
+{
+
+/* find delimiter in [begin, end), return end if there is no one */
+const char *findDelimiter(const char *begin, const char *end, char delimiter)
+{
+#if defined(__AVX2__)
+    const auto wideDelimiters = _mm256_set1_epi8(delimiter);
+    for (; end - begin >= 32; begin += 32)
+    {
+        const auto data = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(begin));
+        const auto mask =
+            static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(data, wideDelimiters)));
+        if (mask != 0)
+        {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const auto delimiters = _mm_set1_epi8(delimiter);
+    for (; end - begin >= 16; begin += 16)
+    {
+        const auto data = _mm_loadu_si128(reinterpret_cast<const __m128i *>(begin));
+        const auto mask =
+            static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(data, delimiters)));
+        if (mask != 0)
+        {
+            return begin + __builtin_ctz(mask);
+        }
+    }
+#endif
+    const auto found = std::memchr(begin, delimiter, end - begin);
+    return found ? static_cast<const char *>(found) : end;
+}
+
+/* Split records scanner. Records starting in [start, end) are passed to handler.
+ * Data is fed from start - 1 (or from 0 for the first split), so split's first partial
+ * record (which belongs to the previous split) is skipped. */
+class RecordScanner
+{
+public:
+    RecordScanner(char delimiter, size_t start, size_t end, const RecordHandler &handler)
+        : m_delimiter(delimiter)
+        , m_end(end)
+        , m_handler(handler)
+        , m_position(start == 0 ? 0 : start - 1)
+        , m_recordStart(start)
+        , m_skipping(start != 0)
+        , m_passedEnd(false)
+        , m_stopped(false)
+    {
+    }
+
+    /* position of next data to feed */
+    size_t position() const
+    {
+        return m_position;
+    }
+
+    /* all split records are handled or handler stopped reading */
+    bool done() const
+    {
+        return m_passedEnd || m_stopped;
+    }
+
+    bool stopped() const
+    {
+        return m_stopped;
+    }
+
+    /* feed data, return false if no more data is needed (split is done or handler stopped
+     * reading) */
+    bool feed(const char *data, size_t size)
+    {
+        const auto dataEnd = data + size;
+        auto pos = data;
+        while (pos < dataEnd && !done())
+        {
+            const auto delimiter = findDelimiter(pos, dataEnd, m_delimiter);
+            if (m_skipping)
+            {
+                if (delimiter == dataEnd)
+                {
+                    break;
+                }
+                m_skipping = false;
+                pos = delimiter + 1;
+                m_recordStart = m_position + (pos - data);
+                continue;
+            }
+            if (m_recordStart >= m_end)
+            {
+                m_passedEnd = true;
+                break;
+            }
+            if (delimiter == dataEnd)
+            {
+                // record continues in the next data chunk
+                m_carry.append(pos, dataEnd - pos);
+                break;
+            }
+            if (m_carry.empty())
+            {
+                emit(RecordView{pos, static_cast<size_t>(delimiter - pos)});
+            }
+            else
+            {
+                m_carry.append(pos, delimiter - pos);
+                emit(RecordView{m_carry.data(), m_carry.size()});
+                m_carry.clear();
+            }
+            pos = delimiter + 1;
+            m_recordStart = m_position + (pos - data);
+        }
+        m_position += size;
+        return !done();
+    }
+
+    /* handle the last record at the end of file */
+    void finish()
+    {
+        if (!done() && !m_skipping && m_recordStart < m_end && m_recordStart < m_position)
+        {
+            emit(RecordView{m_carry.data(), m_carry.size()});
+            m_carry.clear();
+        }
+        m_passedEnd = true;
+    }
+
+private:
+    void emit(const RecordView &record)
+    {
+        m_stopped = !m_handler(record);
+    }
+
+    const char m_delimiter;
+    const size_t m_end;
+    const RecordHandler &m_handler;
+    size_t m_position;
+    size_t m_recordStart;
+    bool m_skipping;
+    bool m_passedEnd;
+    bool m_stopped;
+    std::string m_carry; // start of record crossing data chunks boundary
+};
+
+/* stream buffer passing written data to scanner without copying */
+class ScannerBuffer : public std::streambuf
+{
+public:
+    explicit ScannerBuffer(RecordScanner &scanner)
+        : m_scanner(scanner)
+    {
+    }
+
+    /* rethrow record handler error */
+    void check() const
+    {
+        if (m_error)
+        {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+protected:
+    std::streamsize xsputn(const char *data, std::streamsize size) override
+    {
+        try
+        {
+            // reading is aborted as soon as split is done (or handler stopped it)
+            return m_scanner.feed(data, size) ? size : 0;
+        }
+        catch (...)
+        {
+            m_error = std::current_exception();
+            return 0;
+        }
+    }
+
+    int_type overflow(int_type c) override
+    {
+        if (traits_type::eq_int_type(c, traits_type::eof()))
+        {
+            return traits_type::not_eof(c);
+        }
+        const char ch = traits_type::to_char_type(c);
+        return xsputn(&ch, 1) == 1 ? c : traits_type::eof();
+    }
+
+private:
+    RecordScanner &m_scanner;
+    std::exception_ptr m_error;
+};
+
+/* read data range to scanner, return number of bytes fed (0 length means up to the end) */
+size_t readToScanner(Client &client, const std::string &remoteFilePath, size_t offset,
+                     size_t length, RecordScanner &scanner)
+{
+    ScannerBuffer buffer(scanner);
+    std::ostream sink(&buffer);
+    const auto startPosition = scanner.position();
+    ReadOptions opts;
+    opts.setOffset(offset);
+    if (length > 0)
+    {
+        opts.setLength(length);
+    }
+    try
+    {
+        client.readFile(remoteFilePath, sink, opts);
+    }
+    catch (const Exception &)
+    {
+        buffer.check();
+        // abort of reading not needed data is not an error
+        if (!scanner.done())
+        {
+            throw;
+        }
+    }
+    buffer.check();
+    return scanner.position() - startPosition;
+}
+
+} // namespace
+
+
+RecordReader::RecordReader(Client &client, char delimiter, size_t lookahead)
+    : m_client(client)
+    , m_delimiter(delimiter)
+    , m_lookahead(std::max<size_t>(lookahead, 1))
+{
+}
+
+void RecordReader::read(const std::string &remoteFilePath, const RecordHandler &handler)
+{
+    RecordScanner scanner(m_delimiter, 0, std::numeric_limits<size_t>::max(), handler);
+    readToScanner(m_client, remoteFilePath, 0, 0, scanner);
+    scanner.finish();
+}
+
+void RecordReader::read(const std::string &remoteFilePath, const InputSplit &split,
+                        const RecordHandler &handler)
+{
+    if (split.length == 0)
+    {
+        return;
+    }
+    RecordScanner scanner(m_delimiter, split.offset, split.offset + split.length, handler);
+    auto offset = scanner.position();
+    auto length = split.offset + split.length - offset + m_lookahead;
+    auto nextLength = m_lookahead;
+    for (;;)
+    {
+        const auto received = readToScanner(m_client, remoteFilePath, offset, length, scanner);
+        if (scanner.done())
+        {
+            return;
+        }
+        if (received < length)
+        {
+            scanner.finish();
+            return;
+        }
+        // the last record is longer than lookahead, read its rest by pieces growing
+        // geometrically from lookahead
+        offset = scanner.position();
+        length = nextLength;
+        nextLength *= 2;
+    }
+}
+
+void RecordReader::readParallel(const std::string &remoteFilePath, size_t threads,
+                                size_t splitSize, const SplitRecordHandler &handler)
+{
+    const auto status = m_client.getFileStatus(remoteFilePath);
+    if (status.type != FileStatus::PathObjectType::FILE)
+    {
+        throw Exception(remoteFilePath + " is not a file");
+    }
+    const auto splits = makeSplits(status.length, splitSize);
+
+    std::atomic<size_t> nextSplit(0);
+    std::atomic<bool> stopped(false);
+    std::mutex errorMutex;
+    std::exception_ptr error;
+    auto work = [&](Client client)
+    {
+        try
+        {
+            RecordReader reader(client, m_delimiter, m_lookahead);
+            for (auto split = nextSplit++; split < splits.size() && !stopped; split = nextSplit++)
+            {
+                reader.read(remoteFilePath, splits[split], [&](const RecordView &record)
+                            {
+                                if (stopped || !handler(split, record))
+                                {
+                                    stopped = true;
+                                }
+                                return !stopped;
+                            });
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+            stopped = true;
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 0; i < std::min(std::max<size_t>(threads, 1), splits.size()); ++i)
+    {
+        workers.push_back(std::thread(work, m_client.clone()));
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+std::vector<InputSplit> RecordReader::makeSplits(size_t fileLength, size_t splitSize)
+{
+    splitSize = std::max<size_t>(splitSize, 1);
+    std::vector<InputSplit> splits;
+    for (size_t offset = 0; offset < fileLength; offset += splitSize)
+    {
+        InputSplit split;
+        split.offset = offset;
+        split.length = std::min(splitSize, fileLength - offset);
+        splits.push_back(split);
+    }
+    return splits;
+}
+
+} // namespace WebHDFS
@@ -0,0 +1,120 @@
+/**
+ * @file
+ * @brief  WebHDFS client tracing
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <chrono>
+#include <fstream>
+#include <unistd.h>
+#include <jsoncpp/json/json.h>
+#include "WebHdfsClient.h"
+#include "WebHdfsTrace.h"
+
+
+namespace WebHDFS
+{
+
+namespace
+{
+
+/* small sequential thread id for trace tracks */
+int currentThreadId()
+{
+    static std::atomic<int> nextThreadId(1);
+    thread_local int threadId = nextThreadId++;
+    return threadId;
+}
+
+} // namespace
+
+TraceRecorder::TraceRecorder(const std::string &filePath)
+    : m_filePath(filePath)
+    , m_mutex()
+    , m_events()
+    , m_nextId(1)
+{
+}
+
+TraceRecorder::~TraceRecorder()
+{
+    try
+    {
+        flush();
+    }
+    catch (const Exception &)
+    {
+    }
+}
+
+long long TraceRecorder::now()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void TraceRecorder::addSpan(const std::string &name, const std::string &category,
+                            long long start, long long duration, const std::string &detail)
+{
+    Event event{'X', name, category, start, duration, 0, currentThreadId(), detail};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push_back(event);
+}
+
+void TraceRecorder::addAsyncSpan(const std::string &name, const std::string &category,
+                                 unsigned long id, long long start, long long duration,
+                                 const std::string &detail)
+{
+    Event begin{'b', name, category, start, 0, id, currentThreadId(), detail};
+    Event end{'e', name, category, start + duration, 0, id, begin.thread, std::string()};
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push_back(begin);
+    m_events.push_back(end);
+}
+
+unsigned long TraceRecorder::nextId()
+{
+    return m_nextId++;
+}
+
+void TraceRecorder::flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ofstream ofs(m_filePath);
+    if (!ofs.is_open())
+    {
+        throw Exception("can't open trace file " + m_filePath);
+    }
+    const auto pid = static_cast<long>(::getpid());
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    for (size_t i = 0; i < m_events.size(); ++i)
+    {
+        const auto &event = m_events[i];
+        ofs << (i == 0 ? "\n" : ",\n")
+            << "{\"name\":" << Json::valueToQuotedString(event.name.c_str())
+            << ",\"cat\":" << Json::valueToQuotedString(event.category.c_str())
+            << ",\"ph\":\"" << event.phase << "\",\"ts\":" << event.timestamp
+            << ",\"pid\":" << pid << ",\"tid\":" << event.thread;
+        if (event.phase == 'X')
+        {
+            ofs << ",\"dur\":" << event.duration;
+        }
+        else
+        {
+            ofs << ",\"id\":" << event.id;
+        }
+        if (!event.detail.empty())
+        {
+            ofs << ",\"args\":{\"detail\":" << Json::valueToQuotedString(event.detail.c_str())
+                << "}";
+        }
+        ofs << "}";
+    }
+    ofs << "\n]}\n";
+    if (!ofs.good())
+    {
+        throw Exception("can't write trace file " + m_filePath);
+    }
+}
+
+} // namespace WebHDFS
@@ -0,0 +1,757 @@
+/**
+ * @file
+ * @brief  Pluggable transport of datanode data requests
+ * @author gruzovator@gmail.com
+ * @date   2015-07-15
+ */
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <jsoncpp/json/json.h>
+#include "WebHdfsClient.h"
+#include "WebHdfsTransport.h"
+
+
+namespace WebHDFS
+{
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+const size_t MAX_ERROR_BODY_SIZE = 64 << 10;
+const int MAX_EVENTS = 64;
+const int MAX_READS_PER_EVENT = 16; // fairness of connections served by one loop
+
+struct HttpUrl
+{
+    std::string host;
+    std::string port;
+    std::string target; // path and query
+};
+
+HttpUrl parseHttpUrl(const std::string &url)
+{
+    static const std::string SCHEME = "http://";
+    if (url.compare(0, SCHEME.size(), SCHEME) != 0)
+    {
+        throw Exception("epoll transport supports plain http urls only: " + url);
+    }
+    const auto pathPos = url.find('/', SCHEME.size());
+    const auto authority = url.substr(SCHEME.size(), pathPos == std::string::npos
+                                                         ? std::string::npos
+                                                         : pathPos - SCHEME.size());
+    HttpUrl result;
+    result.target = pathPos == std::string::npos ? "/" : url.substr(pathPos);
+    result.port = "80";
+    if (!authority.empty() && authority[0] == '[')
+    {
+        // IPv6 literal
+        const auto close = authority.find(']');
+        if (close == std::string::npos)
+        {
+            throw Exception("bad url " + url);
+        }
+        result.host = authority.substr(1, close - 1);
+        if (close + 1 < authority.size() && authority[close + 1] == ':')
+        {
+            result.port = authority.substr(close + 2);
+        }
+    }
+    else
+    {
+        const auto portPos = authority.rfind(':');
+        result.host = authority.substr(0, portPos);
+        if (portPos != std::string::npos)
+        {
+            result.port = authority.substr(portPos + 1);
+        }
+    }
+    if (result.host.empty() || result.port.empty())
+    {
+        throw Exception("bad url " + url);
+    }
+    return result;
+}
+
+std::string systemError(const std::string &what, int error = errno)
+{
+    return what + ": " + std::strerror(error);
+}
+
+std::string toLower(std::string s)
+{
+    std::transform(s.begin(), s.end(), s.begin(),
+                   [](char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+std::string trim(const std::string &s)
+{
+    const auto begin = s.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+    {
+        return std::string();
+    }
+    return s.substr(begin, s.find_last_not_of(" \t") - begin + 1);
+}
+
+RemoteException makeRemoteException(long status, const std::string &body)
+{
+    Json::Value value;
+    Json::Reader reader;
+    if (reader.parse(body, value, false) && value.isMember("RemoteException"))
+    {
+        const auto exceptionValue = value["RemoteException"];
+        return RemoteException(exceptionValue.get("exception", "Unknown").asString(),
+                               exceptionValue.get("message", "").asString(), status);
+    }
+    std::string message = "unexpected server response code: " + std::to_string(status);
+    if (!body.empty())
+    {
+        message += " (" + body + ")";
+    }
+    return RemoteException("", message, status);
+}
+
+} // namespace
+
+
+/* Keep-alive connection with its receive buffer */
+class EpollTransport::Connection
+{
+public:
+    Connection(int fd, const std::string &key, size_t bufferSize)
+        : fd(fd)
+        , key(key)
+        , buffer(bufferSize)
+    {
+    }
+
+    ~Connection()
+    {
+        ::close(fd);
+    }
+
+    const int fd;
+    const std::string key; // host:port
+    std::vector<char> buffer;
+};
+
+/* State of one request: connect, send request, receive headers and body */
+class EpollTransport::Transfer
+{
+public:
+    enum class Progress
+    {
+        RUNNING,
+        DONE,
+        RETRY,    // reused connection was closed by server, request should be repeated
+        RECONNECT // connect failed, next address of the host should be tried (see error)
+    };
+
+    Transfer(size_t index, const TransportRequest &req, const HttpUrl &url,
+             std::unique_ptr<Connection> connection, size_t address, bool reused)
+        : index(index)
+        , req(req)
+        , connection(std::move(connection))
+        , address(address)
+        , reused(reused)
+        , state(reused ? State::SENDING : State::CONNECTING)
+    {
+        const auto host = url.host.find(':') == std::string::npos ? url.host
+                                                                  : '[' + url.host + ']';
+        request = "GET " + url.target + " HTTP/1.1\r\nHost: " + host + ':' + url.port +
+                  "\r\nUser-Agent: webhdfs-cpp\r\nAccept: */*\r\n\r\n";
+    }
+
+    bool connecting() const { return state == State::CONNECTING; }
+    bool sending() const { return state == State::CONNECTING || state == State::SENDING; }
+
+    Progress handle(uint32_t events)
+    {
+        const auto fd = connection->fd;
+        if (state == State::CONNECTING)
+        {
+            if (!(events & (EPOLLOUT | EPOLLERR | EPOLLHUP)))
+            {
+                return Progress::RUNNING;
+            }
+            int error = 0;
+            socklen_t errorSize = sizeof(error);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &errorSize) != 0 || error != 0)
+            {
+                connectError = std::make_exception_ptr(
+                    Exception(systemError("can't connect to " + connection->key, error)));
+                return Progress::RECONNECT;
+            }
+            state = State::SENDING;
+        }
+        if (state == State::SENDING)
+        {
+            while (sent < request.size())
+            {
+                const auto n = ::send(fd, request.data() + sent, request.size() - sent,
+                                      MSG_NOSIGNAL);
+                if (n < 0)
+                {
+                    if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    {
+                        return Progress::RUNNING;
+                    }
+                    if (reused && (errno == EPIPE || errno == ECONNRESET))
+                    {
+                        return Progress::RETRY;
+                    }
+                    throw Exception(systemError("can't send request to " + connection->key));
+                }
+                sent += static_cast<size_t>(n);
+            }
+            state = State::HEADERS;
+            return Progress::RUNNING;
+        }
+
+        auto &buffer = connection->buffer;
+        for (int i = 0; i < MAX_READS_PER_EVENT; ++i)
+        {
+            const auto n = ::recv(fd, buffer.data() + buffered, buffer.size() - buffered, 0);
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    return Progress::RUNNING;
+                }
+                if (reused && !received && errno == ECONNRESET)
+                {
+                    return Progress::RETRY;
+                }
+                throw Exception(systemError("can't receive reply from " + connection->key));
+            }
+            if (n == 0)
+            {
+                if (reused && !received)
+                {
+                    return Progress::RETRY;
+                }
+                if (state == State::BODY && framing == Framing::CLOSE)
+                {
+                    return Progress::DONE;
+                }
+                throw Exception("connection closed by " + connection->key);
+            }
+            received = true;
+            if (state == State::BODY)
+            {
+                if (consume(buffer.data(), static_cast<size_t>(n)))
+                {
+                    return Progress::DONE;
+                }
+                continue;
+            }
+
+            buffered += static_cast<size_t>(n);
+            const char terminator[] = "\r\n\r\n";
+            const auto headersEnd =
+                std::search(buffer.data(), buffer.data() + buffered, terminator, terminator + 4);
+            if (headersEnd == buffer.data() + buffered)
+            {
+                if (buffered == buffer.size())
+                {
+                    throw Exception("too large reply headers from " + connection->key);
+                }
+                continue;
+            }
+            parseHeaders(std::string(buffer.data(), headersEnd + 2));
+            state = State::BODY;
+            const auto bodySize = buffered - (headersEnd + 4 - buffer.data());
+            buffered = 0;
+            if ((framing == Framing::LENGTH && remaining == 0) ||
+                consume(headersEnd + 4, bodySize))
+            {
+                return Progress::DONE;
+            }
+        }
+        return Progress::RUNNING;
+    }
+
+    const size_t index;
+    const TransportRequest &req;
+    std::unique_ptr<Connection> connection;
+    const size_t address; // index of connected address of the host
+    const bool reused;
+    std::exception_ptr connectError;
+    long status = 0;
+    bool keepAlive = true;
+    std::string errorBody;
+    Clock::time_point deadline;
+
+private:
+    enum class State
+    {
+        CONNECTING,
+        SENDING,
+        HEADERS,
+        BODY
+    };
+
+    enum class Framing
+    {
+        LENGTH,
+        CHUNKED,
+        CLOSE
+    };
+
+    enum class ChunkState
+    {
+        SIZE,
+        DATA,
+        DATA_END,
+        TRAILER
+    };
+
+    void parseHeaders(const std::string &headers)
+    {
+        size_t lineBegin = 0;
+        size_t lineEnd = headers.find("\r\n");
+        const auto statusLine = headers.substr(0, lineEnd);
+        if (statusLine.compare(0, 5, "HTTP/") != 0 || statusLine.size() < 12)
+        {
+            throw Exception("protocol error: bad status line from " + connection->key);
+        }
+        keepAlive = statusLine.compare(5, 3, "1.0") != 0;
+        status = std::strtol(statusLine.c_str() + 9, nullptr, 10);
+        framing = Framing::CLOSE;
+        while (lineEnd + 2 < headers.size())
+        {
+            lineBegin = lineEnd + 2;
+            lineEnd = headers.find("\r\n", lineBegin);
+            const auto line = headers.substr(lineBegin, lineEnd - lineBegin);
+            const auto colon = line.find(':');
+            if (colon == std::string::npos)
+            {
+                continue;
+            }
+            const auto name = toLower(line.substr(0, colon));
+            const auto value = toLower(trim(line.substr(colon + 1)));
+            if (name == "content-length" && framing != Framing::CHUNKED)
+            {
+                framing = Framing::LENGTH;
+                remaining = std::strtoull(value.c_str(), nullptr, 10);
+            }
+            else if (name == "transfer-encoding" && value.find("chunked") != std::string::npos)
+            {
+                framing = Framing::CHUNKED;
+            }
+            else if (name == "connection")
+            {
+                keepAlive = value.find("close") == std::string::npos &&
+                            (keepAlive || value.find("keep-alive") != std::string::npos);
+            }
+        }
+        keepAlive = keepAlive && framing != Framing::CLOSE;
+    }
+
+    /* process body bytes, returns true when body is complete */
+    bool consume(const char *data, size_t size)
+    {
+        if (framing == Framing::CLOSE)
+        {
+            deliver(data, size);
+            return false;
+        }
+        if (framing == Framing::LENGTH)
+        {
+            const auto piece = std::min(size, remaining);
+            deliver(data, piece);
+            remaining -= piece;
+            // unexpected bytes after the body, connection isn't reused
+            keepAlive = keepAlive && piece == size;
+            return remaining == 0;
+        }
+        while (size > 0)
+        {
+            if (chunkState == ChunkState::DATA)
+            {
+                const auto piece = std::min(size, remaining);
+                deliver(data, piece);
+                remaining -= piece;
+                data += piece;
+                size -= piece;
+                if (remaining == 0)
+                {
+                    chunkState = ChunkState::DATA_END;
+                }
+                continue;
+            }
+            // line of chunk size, chunk end or trailer
+            const auto newLine = static_cast<const char *>(std::memchr(data, '\n', size));
+            const auto lineSize = newLine ? static_cast<size_t>(newLine - data) + 1 : size;
+            line.append(data, lineSize);
+            data += lineSize;
+            size -= lineSize;
+            if (!newLine)
+            {
+                if (line.size() > 1024)
+                {
+                    throw Exception("protocol error: bad chunk from " + connection->key);
+                }
+                continue;
+            }
+            const auto content = trim(line.substr(0, line.find_first_of("\r\n")));
+            line.clear();
+            if (chunkState == ChunkState::SIZE)
+            {
+                remaining = std::strtoull(content.c_str(), nullptr, 16);
+                chunkState = remaining > 0 ? ChunkState::DATA : ChunkState::TRAILER;
+            }
+            else if (chunkState == ChunkState::DATA_END)
+            {
+                chunkState = ChunkState::SIZE;
+            }
+            else if (content.empty())
+            {
+                keepAlive = keepAlive && size == 0;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void deliver(const char *data, size_t size)
+    {
+        if (size == 0)
+        {
+            return;
+        }
+        if (status != 200L)
+        {
+            errorBody.append(data, std::min(size, MAX_ERROR_BODY_SIZE - errorBody.size()));
+        }
+        else if (!req.dataHandler(data, size))
+        {
+            throw Exception("transfer aborted by data handler");
+        }
+    }
+
+    State state;
+    std::string request;
+    size_t sent = 0;
+    size_t buffered = 0; // headers bytes in connection buffer
+    bool received = false;
+    Framing framing = Framing::CLOSE;
+    size_t remaining = 0; // body bytes (LENGTH) or current chunk bytes (CHUNKED)
+    ChunkState chunkState = ChunkState::SIZE;
+    std::string line;
+};
+
+
+EpollTransportOptions::EpollTransportOptions()
+    : m_connectTimeout(10000)
+    , m_idleTimeout(60000)
+    , m_bufferSize(256 << 10)
+    , m_maxIdleConnections(64)
+{
+}
+
+EpollTransportOptions &EpollTransportOptions::setConnectTimeout(long ms)
+{
+    m_connectTimeout = ms;
+    return *this;
+}
+
+EpollTransportOptions &EpollTransportOptions::setIdleTimeout(long ms)
+{
+    m_idleTimeout = ms;
+    return *this;
+}
+
+EpollTransportOptions &EpollTransportOptions::setBufferSize(size_t bytes)
+{
+    m_bufferSize = bytes;
+    return *this;
+}
+
+EpollTransportOptions &EpollTransportOptions::setMaxIdleConnections(size_t connections)
+{
+    m_maxIdleConnections = connections;
+    return *this;
+}
+
+EpollTransport::EpollTransport(const EpollTransportOptions &opts)
+    : m_options(opts)
+{
+}
+
+EpollTransport::~EpollTransport()
+{
+}
+
+std::unique_ptr<EpollTransport::Connection>
+EpollTransport::acquireConnection(const std::string &host, const std::string &port,
+                                  size_t &address, bool &reused)
+{
+    const auto key = host + ':' + port;
+    if (address == 0)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_idleConnections.find(key); it != m_idleConnections.end() &&
+                                                    it->first == key;
+             it = m_idleConnections.erase(it))
+        {
+            // connection closed by server has pending EOF
+            char byte = 0;
+            const auto n = ::recv(it->second->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                auto connection = std::move(it->second);
+                m_idleConnections.erase(it);
+                reused = true;
+                return connection;
+            }
+        }
+    }
+
+    reused = false;
+    addrinfo hints;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    const auto rc = getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses);
+    if (rc != 0)
+    {
+        throw Exception("can't resolve " + host + ": " + gai_strerror(rc));
+    }
+    std::unique_ptr<addrinfo, void (*)(addrinfo *)> addressesGuard(addresses, freeaddrinfo);
+    std::string error;
+    size_t index = 0;
+    for (auto item = addresses; item; item = item->ai_next, ++index)
+    {
+        if (index < address)
+        {
+            continue;
+        }
+        const int fd = ::socket(item->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+        {
+            error = systemError("can't create socket");
+            continue;
+        }
+        std::unique_ptr<Connection> connection(new Connection(fd, key, m_options.m_bufferSize));
+        const int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        if (::connect(fd, item->ai_addr, item->ai_addrlen) == 0 || errno == EINPROGRESS)
+        {
+            address = index;
+            return connection;
+        }
+        error = systemError("can't connect to " + key);
+    }
+    if (error.empty())
+    {
+        // all addresses are tried
+        return nullptr;
+    }
+    throw Exception(error);
+}
+
+void EpollTransport::releaseConnection(std::unique_ptr<Connection> connection)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_idleConnections.size() < m_options.m_maxIdleConnections)
+    {
+        const auto key = connection->key;
+        m_idleConnections.insert(std::make_pair(key, std::move(connection)));
+    }
+}
+
+std::vector<std::exception_ptr> EpollTransport::get(const std::vector<TransportRequest> &requests,
+                                                    size_t maxParallel)
+{
+    std::vector<std::exception_ptr> errors(requests.size());
+    if (requests.empty())
+    {
+        return errors;
+    }
+    maxParallel = std::max<size_t>(maxParallel, 1);
+    const int epollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd < 0)
+    {
+        throw Exception(systemError("epoll creation failed"));
+    }
+    std::unique_ptr<int, void (*)(int *)> epollGuard(new int(epollFd), [](int *fd)
+                                                     {
+                                                         ::close(*fd);
+                                                         delete fd;
+                                                     });
+
+    std::map<int, std::unique_ptr<Transfer>> active; // by socket
+    auto watch = [&](Transfer &transfer, int op)
+    {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = transfer.sending() ? EPOLLOUT : EPOLLIN;
+        event.data.fd = transfer.connection->fd;
+        if (epoll_ctl(epollFd, op, transfer.connection->fd, &event) != 0)
+        {
+            throw Exception(systemError("epoll_ctl failed"));
+        }
+    };
+    // connection to address with the index or a next one, previous error is the error of
+    // the previous address
+    auto start = [&](size_t index, bool forceNew, size_t address,
+                     std::exception_ptr previousError)
+    {
+        try
+        {
+            const auto url = parseHttpUrl(requests[index].url);
+            if (forceNew)
+            {
+                // other keep-alive connections of the host are likely stale too
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_idleConnections.erase(url.host + ':' + url.port);
+            }
+            bool reused = false;
+            auto connection = acquireConnection(url.host, url.port, address, reused);
+            if (!connection)
+            {
+                std::rethrow_exception(previousError);
+            }
+            std::unique_ptr<Transfer> transfer(new Transfer(
+                index, requests[index], url, std::move(connection), address, reused));
+            transfer->deadline =
+                Clock::now() + std::chrono::milliseconds(reused ? m_options.m_idleTimeout
+                                                                : m_options.m_connectTimeout);
+            watch(*transfer, EPOLL_CTL_ADD);
+            const auto fd = transfer->connection->fd;
+            active[fd] = std::move(transfer);
+        }
+        catch (...)
+        {
+            errors[index] = std::current_exception();
+        }
+    };
+    // try next address of the host after failed connect
+    auto reconnect = [&](std::map<int, std::unique_ptr<Transfer>>::iterator it)
+    {
+        const auto index = it->second->index;
+        const auto address = it->second->address + 1;
+        const auto error = it->second->connectError;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->first, nullptr);
+        active.erase(it);
+        start(index, false, address, error);
+    };
+    auto finish = [&](std::map<int, std::unique_ptr<Transfer>>::iterator it)
+    {
+        auto &transfer = *it->second;
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, it->first, nullptr);
+        if (transfer.status != 200L && !errors[transfer.index])
+        {
+            errors[transfer.index] =
+                std::make_exception_ptr(makeRemoteException(transfer.status, transfer.errorBody));
+        }
+        if (transfer.keepAlive && !errors[transfer.index])
+        {
+            releaseConnection(std::move(transfer.connection));
+        }
+        active.erase(it);
+    };
+
+    size_t next = 0;
+    epoll_event events[MAX_EVENTS];
+    while (next < requests.size() || !active.empty())
+    {
+        while (active.size() < maxParallel && next < requests.size())
+        {
+            start(next++, false, 0, nullptr);
+        }
+        if (active.empty())
+        {
+            continue;
+        }
+        const int count = epoll_wait(epollFd, events, MAX_EVENTS, 100);
+        if (count < 0 && errno != EINTR)
+        {
+            throw Exception(systemError("epoll_wait failed"));
+        }
+        for (int i = 0; i < count; ++i)
+        {
+            auto it = active.find(events[i].data.fd);
+            if (it == active.end())
+            {
+                continue;
+            }
+            auto &transfer = *it->second;
+            const bool sending = transfer.sending();
+            auto progress = Transfer::Progress::RUNNING;
+            try
+            {
+                progress = transfer.handle(events[i].events);
+            }
+            catch (...)
+            {
+                errors[transfer.index] = std::current_exception();
+                transfer.keepAlive = false;
+                progress = Transfer::Progress::DONE;
+            }
+            if (progress == Transfer::Progress::RETRY)
+            {
+                const auto index = transfer.index;
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, it->first, nullptr);
+                active.erase(it);
+                start(index, true, 0, nullptr);
+            }
+            else if (progress == Transfer::Progress::RECONNECT)
+            {
+                reconnect(it);
+            }
+            else if (progress == Transfer::Progress::DONE)
+            {
+                finish(it);
+            }
+            else
+            {
+                transfer.deadline = Clock::now() + std::chrono::milliseconds(
+                                                       transfer.connecting()
+                                                           ? m_options.m_connectTimeout
+                                                           : m_options.m_idleTimeout);
+                if (sending != transfer.sending())
+                {
+                    watch(transfer, EPOLL_CTL_MOD);
+                }
+            }
+        }
+
+        const auto now = Clock::now();
+        for (auto it = active.begin(); it != active.end();)
+        {
+            auto current = it++;
+            auto &transfer = *current->second;
+            if (transfer.deadline < now && transfer.connecting())
+            {
+                transfer.connectError = std::make_exception_ptr(
+                    Exception("timeout of connect to " + transfer.connection->key));
+                reconnect(current);
+            }
+            else if (transfer.deadline < now)
+            {
+                errors[transfer.index] = std::make_exception_ptr(
+                    Exception("timeout of request to " + transfer.connection->key));
+                transfer.keepAlive = false;
+                finish(current);
+            }
+        }
+    }
+    return errors;
+}
+
+} // namespace WebHDFS